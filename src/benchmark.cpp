@@ -0,0 +1,308 @@
+// Headless benchmark: replays a camera path through the render modes at the chosen output sizes and
+// kernel sample counts, and writes frame time statistics as JSON.
+//
+//   Benchmark [--modes off,ssao,ssdo,both] [--sizes 800x800,1920x1080] [--samples 8,12,32]
+//             [--frames 300] [--warmup 30] [--path camera.path] [--lights 8] [--output benchmark.json]
+//
+// Every run renders the same frames: the path is sampled at fixed fractions instead of by the clock,
+// and the lights are seeded. A frame's time runs from the start of its commands to glFinish, so it
+// covers the GPU work; the per-pass GPU times come from the GPU profiler. The window is never shown;
+// built with -DSSDO_HEADLESS=ON, GLFW and GLEW use OSMesa and need no display or GPU at all.
+
+#include <cstdlib>
+#include <cstdio>
+#include <config.h>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+#include "gl_env.h"
+
+#include "utils_camera.h"
+#include "utils_camera_path.h"
+#include "utils_model.h"
+#include "utils_light.h"
+#include "utils_texture_loader.h"
+#include "utils_resource_registry.h"
+#include "utils_gpu_profiler.h"
+
+#include "renderer_off.h"
+#include "renderer_ssao.h"
+#include "renderer_ssdo.h"
+#include "renderer_both.h"
+
+static void error_callback(int, const char *description) {
+    fprintf(stderr, "Error: %s\n", description);
+}
+
+// one measured configuration
+struct BenchmarkRun
+{
+    std::string mode;
+    int width, height, samples;
+    std::vector<double> frameMs;
+    // mean GPU time per pass, in the order the passes first ran
+    std::vector<std::pair<std::string, double> > passMs;
+};
+
+static std::vector<std::string> split(const std::string &list)
+{
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        if (end > start)
+            items.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+    return items;
+}
+
+// nearest-rank percentile of sorted values
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    int rank = (int)std::ceil(p / 100.0 * sorted.size()) - 1;
+    return sorted[std::min(std::max(rank, 0), (int)sorted.size() - 1)];
+}
+
+// a string as the inside of a JSON string literal, e.g. a Windows path
+static std::string jsonEscape(const std::string &text)
+{
+    std::string escaped;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '"' || text[i] == '\\')
+            escaped += '\\';
+        escaped += text[i];
+    }
+    return escaped;
+}
+
+static void printUsage(const char *program)
+{
+    printf("usage: %s [--modes off,ssao,ssdo,both] [--sizes 800x800,1920x1080] [--samples 8,12,32] [--frames N] "
+           "[--warmup N] [--path camera.path] [--lights N] [--output benchmark.json]\n", program);
+}
+
+static bool writeJson(const std::string &path, const std::vector<BenchmarkRun> &runs, const std::string &cameraPath,
+                      int frames, int warmup, int lightCount)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+    {
+        std::cout << "ERROR::BENCHMARK:: cannot write " << path << std::endl;
+        return false;
+    }
+    fprintf(file, "{\n  \"renderer\": \"%s\",\n  \"version\": \"%s\",\n",
+            jsonEscape((const char *)glGetString(GL_RENDERER)).c_str(), jsonEscape((const char *)glGetString(GL_VERSION)).c_str());
+    fprintf(file, "  \"path\": \"%s\",\n  \"frames\": %d,\n  \"warmup\": %d,\n  \"lights\": %d,\n  \"runs\": [\n",
+            jsonEscape(cameraPath).c_str(), frames, warmup, lightCount);
+    for (size_t r = 0; r < runs.size(); r++)
+    {
+        const BenchmarkRun &run = runs[r];
+        std::vector<double> sorted = run.frameMs;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (size_t i = 0; i < sorted.size(); i++)
+            sum += sorted[i];
+        fprintf(file, "    {\"mode\": \"%s\", \"width\": %d, \"height\": %d, \"samples\": %d,\n",
+                run.mode.c_str(), run.width, run.height, run.samples);
+        fprintf(file, "     \"frame_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"min\": %.4f, \"max\": %.4f},\n",
+                sorted.empty() ? 0.0 : sum / sorted.size(), percentile(sorted, 50.0), percentile(sorted, 95.0),
+                percentile(sorted, 99.0), sorted.empty() ? 0.0 : sorted.front(), sorted.empty() ? 0.0 : sorted.back());
+        fprintf(file, "     \"gpu_ms\": {");
+        for (size_t i = 0; i < run.passMs.size(); i++)
+            fprintf(file, "%s\"%s\": %.4f", i ? ", " : "", jsonEscape(run.passMs[i].first).c_str(), run.passMs[i].second);
+        fprintf(file, "}}%s\n", r + 1 < runs.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> modes = split("off,ssao,ssdo,both");
+    std::vector<std::string> sizes = split("800x800");
+    std::vector<std::string> samples = split("12");
+    int frames = 300, warmup = 30;
+    unsigned int lightCount = 8;
+    std::string pathFile, output = "benchmark.json";
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (i + 1 == argc)
+        {
+            std::cout << "ERROR::BENCHMARK:: " << argv[i] << " needs a value" << std::endl;
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "--modes") == 0)
+            modes = split(argv[i + 1]);
+        else if (strcmp(argv[i], "--sizes") == 0)
+            sizes = split(argv[i + 1]);
+        else if (strcmp(argv[i], "--samples") == 0)
+            samples = split(argv[i + 1]);
+        else if (strcmp(argv[i], "--frames") == 0)
+            frames = std::max(1, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--warmup") == 0)
+            warmup = std::max(0, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--path") == 0)
+            pathFile = argv[i + 1];
+        else if (strcmp(argv[i], "--lights") == 0)
+            lightCount = (unsigned int)std::max(1, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--output") == 0)
+            output = argv[i + 1];
+        else
+        {
+            std::cout << "ERROR::BENCHMARK:: unknown option " << argv[i] << std::endl;
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // output sizes; the window is allocated at the largest so every size fits its framebuffer
+    std::vector<glm::ivec2> resolutions;
+    glm::ivec2 largest(1, 1);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        glm::ivec2 size;
+        if (sscanf(sizes[i].c_str(), "%dx%d", &size.x, &size.y) != 2 || size.x <= 0 || size.y <= 0)
+        {
+            std::cout << "ERROR::BENCHMARK:: bad size " << sizes[i] << ", expected WIDTHxHEIGHT" << std::endl;
+            return EXIT_FAILURE;
+        }
+        resolutions.push_back(size);
+        largest = glm::max(largest, size);
+    }
+
+    CameraPath path = CameraPath::orbit();
+    if (!pathFile.empty() && !path.load(pathFile))
+        return EXIT_FAILURE;
+
+    // an invisible window only for its context
+    glfwSetErrorCallback(error_callback);
+    if (!glfwInit())
+        exit(EXIT_FAILURE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef __APPLE__ // for macos
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    GLFWwindow *window = glfwCreateWindow(largest.x, largest.y, "benchmark", NULL, NULL);
+    if (!window) {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (glewInit() != GLEW_OK)
+        exit(EXIT_FAILURE);
+    glEnable(GL_DEPTH_TEST);
+    printf("benchmark: %s, %s\n", (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION));
+
+    // the viewer's scene
+    TextureLoader textureLoader;
+    Model my3DModel(DATA_DIR"/Luminaris/FBX/Luminaris.fbx", false, &textureLoader, VERTEX_LAYOUT_COMPACT, true);
+    std::vector<Light> lights = scatterLights(lightCount);
+    ResourceRegistry resourceRegistry(&textureLoader);
+    RendererOFF  rendererOFF(resourceRegistry);
+    RendererSSAO rendererSSAO(resourceRegistry);
+    RendererSSDO rendererSSDO(resourceRegistry);
+    RendererBoth rendererBoth(resourceRegistry);
+    textureLoader.finish();
+
+    Camera camera;
+    GpuProfiler &gpuProfiler = GpuProfiler::instance();
+    std::vector<BenchmarkRun> runs;
+    for (size_t m = 0; m < modes.size(); m++)
+    {
+        const std::string &mode = modes[m];
+        if (mode != "off" && mode != "ssao" && mode != "ssdo" && mode != "both")
+        {
+            std::cout << "ERROR::BENCHMARK:: unknown mode " << mode << ", expected off, ssao, ssdo or both" << std::endl;
+            return EXIT_FAILURE;
+        }
+        // the sample count means nothing without occlusion
+        size_t sampleRuns = mode == "off" ? 1 : samples.size();
+        for (size_t r = 0; r < resolutions.size(); r++)
+            for (size_t s = 0; s < sampleRuns; s++)
+            {
+                BenchmarkRun run;
+                run.mode = mode;
+                run.width = resolutions[r].x;
+                run.height = resolutions[r].y;
+                run.samples = mode == "off" ? 0 : std::max(1, atoi(samples[s].c_str()));
+                RendererSettings settings = RendererSettings::medium();
+                if (run.samples > 0)
+                    settings.kernelSize = run.samples;
+                rendererSSAO.setSettings(settings);
+                rendererSSDO.setSettings(settings);
+                rendererBoth.setSettings(settings);
+
+                for (int frame = -warmup; frame < frames; frame++)
+                {
+                    // warm-up frames stay on the first view
+                    path.apply(camera, frame <= 0 || frames == 1 ? 0.0f : frame / (float)(frames - 1));
+
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                    glViewport(0, 0, run.width, run.height);
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    if (mode == "off")
+                        rendererOFF.render(my3DModel, camera, lights, run.width, run.height, 0);
+                    else if (mode == "ssao")
+                        rendererSSAO.render(my3DModel, camera, lights, run.width, run.height, 0);
+                    else if (mode == "ssdo")
+                        rendererSSDO.render(my3DModel, camera, lights, run.width, run.height, 0);
+                    else
+                        rendererBoth.render(my3DModel, camera, lights, run.width, run.height, 0);
+                    glFinish();
+                    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                    // after glFinish the profiler always gets the previous frame's passes
+                    gpuProfiler.endFrame();
+                    glfwPollEvents();
+                    if (frame < 0)
+                        continue;
+                    run.frameMs.push_back(ms);
+                    const std::vector<GpuProfiler::PassTime> &passes = gpuProfiler.passes();
+                    for (size_t p = 0; p < passes.size(); p++)
+                    {
+                        size_t i = 0;
+                        while (i < run.passMs.size() && run.passMs[i].first != passes[p].name)
+                            i++;
+                        if (i == run.passMs.size())
+                            run.passMs.push_back(std::make_pair(passes[p].name, 0.0));
+                        run.passMs[i].second += passes[p].lastMs;
+                    }
+                }
+                for (size_t i = 0; i < run.passMs.size(); i++)
+                    run.passMs[i].second /= run.frameMs.size();
+
+                std::vector<double> sorted = run.frameMs;
+                std::sort(sorted.begin(), sorted.end());
+                printf("%-4s %5dx%-5d %2d samples: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n", run.mode.c_str(), run.width,
+                       run.height, run.samples, percentile(sorted, 50.0), percentile(sorted, 95.0), percentile(sorted, 99.0));
+                runs.push_back(run);
+            }
+    }
+
+    bool written = writeJson(output, runs, pathFile.empty() ? "orbit" : pathFile, frames, warmup, (int)lightCount);
+    if (written)
+        printf("benchmark: %d runs written to %s\n", (int)runs.size(), output.c_str());
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,458 @@
+// Golden-image harness: renders fixed views of the scene offscreen in every mode and reads them back.
+//
+//   GoldenImages [--size 512x512] [--frames 20] [--references dir] [--output golden.json] [--update]
+//                [--allow-missing] [--min-speedup X]
+//
+// Two kinds of checks, both reported with their timings:
+// - each mode at the reference quality (high, full resolution, no accumulation) against the PNGs
+//   stored under data/golden, so a change that should not alter the image is caught; --update
+//   rewrites them from this machine instead. A view without a stored image fails the check unless
+//   --allow-missing is given, which skips it with a warning (e.g. to bootstrap a new machine)
+// - each optimized variant (fewer samples, reduced resolution, accumulation, ...) against the
+//   reference render of the same view from this run. A variant is accepted when it stays within its
+//   PSNR/SSIM bounds on every view; its speedup over the reference is reported, and only gated with
+//   --min-speedup, since medians of a few frames are within noise on headless or loaded hosts
+// - the CPU reference (utils_cpu_occlusion.h) run on the g-buffer of a reference frame against the
+//   SSAO/SSDO the GPU computed from it, so a shader change that the reference does not follow, or
+//   the other way round, is caught
+// Exits with 1 when any check fails. Built with -DSSDO_HEADLESS=ON it needs no display or GPU.
+
+#include <cstdlib>
+#include <cstdio>
+#include <config.h>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+#include "gl_env.h"
+
+#include "utils_camera.h"
+#include "utils_camera_path.h"
+#include "utils_model.h"
+#include "utils_light.h"
+#include "utils_texture_loader.h"
+#include "utils_resource_registry.h"
+#include "utils_image_compare.h"
+#include "utils_gpu_profiler.h"
+#include "utils_cpu_occlusion.h"
+#include "utils_frame_capture.h"
+
+#include "renderer_off.h"
+#include "renderer_ssao.h"
+#include "renderer_ssdo.h"
+#include "renderer_both.h"
+
+static void error_callback(int, const char *description) {
+    fprintf(stderr, "Error: %s\n", description);
+}
+
+// bounds against the stored references: only driver and rounding differences may remain
+static const double REFERENCE_PSNR = 40.0;
+static const double REFERENCE_SSIM = 0.98;
+// bounds of the CPU reference against the GPU: their float math differs in the last bits, which
+// flips some of the 8-bit occlusion values and the odd sample at a depth edge
+static const double CPU_REFERENCE_PSNR = 35.0;
+static const double CPU_REFERENCE_SSIM = 0.95;
+// the views: fractions of an orbit around the model
+static const float VIEWS[] = { 0.0f, 0.25f, 0.5f, 0.75f };
+static const int VIEW_COUNT = sizeof(VIEWS) / sizeof(VIEWS[0]);
+// frames an accumulating variant gets to converge before it is read back
+static const int CONVERGE_FRAMES = 32;
+
+enum GoldenMode { GOLDEN_OFF, GOLDEN_SSAO, GOLDEN_SSDO, GOLDEN_BOTH };
+static const char *MODE_NAMES[] = { "off", "ssao", "ssdo", "both" };
+
+// an optimization of the occlusion and how far it may drift from the reference
+struct GoldenVariant
+{
+    const char *name;
+    RendererSettings settings;
+    double minPsnr, minSsim;
+    bool ssaoOnly;
+};
+
+static std::vector<GoldenVariant> variants()
+{
+    RendererSettings half = RendererSettings::medium(), quarter = RendererSettings::medium();
+    half.downsample = 2;
+    quarter.downsample = 4;
+    RendererSettings random = RendererSettings::medium();
+    random.sampling = SAMPLING_RANDOM;
+    RendererSettings horizon = RendererSettings::medium();
+    horizon.method = AO_HORIZON;
+    GoldenVariant list[] = {
+        { "medium",      RendererSettings::medium(),               32.0, 0.95, false },
+        { "low",         RendererSettings::low(),                  30.0, 0.93, false },
+        { "half-res",    half,                                     30.0, 0.93, false },
+        { "quarter-res", quarter,                                  27.0, 0.90, false },
+        { "temporal",    RendererSettings::medium().accumulated(), 32.0, 0.95, false },
+        { "random",      random,                                   30.0, 0.93, false },
+        { "horizon",     horizon,                                  27.0, 0.90, true },
+    };
+    return std::vector<GoldenVariant>(list, list + sizeof(list) / sizeof(list[0]));
+}
+
+// what one case measured over all views
+struct GoldenResult
+{
+    std::string mode, variant;
+    double minPsnr, minSsim, ms, referenceMs;
+    bool passed, skipped;
+    std::string reason;
+};
+
+class GoldenRenderer
+{
+public:
+    GoldenRenderer(ResourceRegistry &registry, Model &model, int width, int height, int timingFrames)
+        : rendererOFF(registry), rendererSSAO(registry), rendererSSDO(registry), rendererBoth(registry),
+          model(model), width(width), height(height), timingFrames(timingFrames)
+    {
+        lights = scatterLights(8);
+        // the output every renderer blits to, read back after the last frame
+        glGenFramebuffers(1, &fbo);
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::GOLDEN:: output framebuffer not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        rendererOFF.setOutput(fbo);
+        rendererSSAO.setOutput(fbo);
+        rendererSSDO.setOutput(fbo);
+        rendererBoth.setOutput(fbo);
+    }
+
+    ~GoldenRenderer()
+    {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color);
+    }
+
+    // renders a view until it is settled, then times timingFrames more; returns the last one and
+    // stores their median time in ms
+    Image render(GoldenMode mode, const RendererSettings &settings, float view, double &ms)
+    {
+        if (mode == GOLDEN_SSAO)
+            rendererSSAO.setSettings(settings);
+        else if (mode == GOLDEN_SSDO)
+            rendererSSDO.setSettings(settings);
+        else if (mode == GOLDEN_BOTH)
+            rendererBoth.setSettings(settings);
+        CameraPath::orbit().apply(camera, view);
+
+        int settleFrames = settings.temporal ? CONVERGE_FRAMES : 2;
+        std::vector<double> times;
+        for (int frame = 0; frame < settleFrames + timingFrames; frame++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            renderFrame(mode);
+            glFinish();
+            if (frame >= settleFrames)
+                times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(times.begin(), times.end());
+        ms = times.empty() ? 0.0 : times[times.size() / 2];
+
+        Image image(width, height);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &image.pixels[0]);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        return image;
+    }
+
+    // the g-buffer, occlusion and uniforms of the last frame an occlusion mode rendered
+    const FrameCapture &capture(GoldenMode mode)
+    {
+        return mode == GOLDEN_SSAO ? rendererSSAO.capture() : mode == GOLDEN_SSDO ? rendererSSDO.capture() : rendererBoth.capture();
+    }
+
+private:
+    RendererOFF  rendererOFF;
+    RendererSSAO rendererSSAO;
+    RendererSSDO rendererSSDO;
+    RendererBoth rendererBoth;
+    Model &model;
+    Camera camera;
+    std::vector<Light> lights;
+    int width, height, timingFrames;
+    GLuint fbo, color;
+
+    void renderFrame(GoldenMode mode)
+    {
+        if (mode == GOLDEN_OFF)
+            rendererOFF.render(model, camera, lights, width, height, 0);
+        else if (mode == GOLDEN_SSAO)
+            rendererSSAO.render(model, camera, lights, width, height, 0);
+        else if (mode == GOLDEN_SSDO)
+            rendererSSDO.render(model, camera, lights, width, height, 0);
+        else
+            rendererBoth.render(model, camera, lights, width, height, 0);
+    }
+};
+
+// occlusion at the 8 bits of the GPU's targets, gray for SSAO
+static Image occlusionImage(const FloatImage &occlusion)
+{
+    Image image(occlusion.width, occlusion.height);
+    for (int y = 0; y < occlusion.height; y++)
+        for (int x = 0; x < occlusion.width; x++)
+        {
+            const float *value = occlusion.at(x, y);
+            unsigned char *pixel = &image.pixels[((size_t)y * occlusion.width + x) * 4];
+            for (int c = 0; c < 3; c++)
+                pixel[c] = (unsigned char)(std::min(std::max(value[occlusion.channels == 1 ? 0 : c], 0.0f), 1.0f) * 255.0f + 0.5f);
+            pixel[3] = 255;
+        }
+    return image;
+}
+
+// runs the CPU reference on the capture's g-buffer with its setting and compares it with the GPU's
+// SSAO and SSDO over the pixels where something was rendered; the others are undefined on the GPU
+static GoldenResult checkCpuReference(const FrameCapture &capture, CpuOcclusion &occlusion, const char *mode, double referenceMs)
+{
+    GoldenResult result = { mode, "cpu reference", ImageComparison::MAX_PSNR, 1.0, 0.0, referenceMs, true, false, "" };
+    CpuGBuffer gBuffer;
+    CpuFrame frame;
+    FloatImage gpu[2], cpu[2];
+    readCapture(capture, gBuffer, frame, &gpu[0], &gpu[1]);
+    const RendererSettings &settings = capture.settings;
+    CpuOcclusionSettings cpuSettings = {
+        settings.kernel(), settings.radius, settings.noise(), settings.noiseSize(), settings.blurRadius,
+        glm::vec2(1.0f, 0.0f), glm::vec2(0.0f), true
+    };
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    occlusion.occlusion(gBuffer, frame, cpuSettings, gpu[0].empty() ? NULL : &cpu[0], gpu[1].empty() ? NULL : &cpu[1]);
+    for (int p = 0; p < 2; p++)
+        if (!gpu[p].empty())
+            occlusion.blur(cpu[p], gBuffer, settings.blurRadius, true);
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    for (int p = 0; p < 2; p++)
+    {
+        if (gpu[p].empty())
+            continue;
+        for (size_t i = 0; i < gBuffer.depth.pixels.size(); i++)
+            if (gBuffer.depth.pixels[i] <= 0.0f)
+                std::copy(&gpu[p].pixels[i * gpu[p].channels], &gpu[p].pixels[(i + 1) * gpu[p].channels], &cpu[p].pixels[i * cpu[p].channels]);
+        ImageComparison comparison = compareImages(occlusionImage(cpu[p]), occlusionImage(gpu[p]));
+        result.minPsnr = std::min(result.minPsnr, comparison.psnr);
+        result.minSsim = std::min(result.minSsim, comparison.ssim);
+    }
+    if (result.minPsnr < CPU_REFERENCE_PSNR || result.minSsim < CPU_REFERENCE_SSIM)
+    {
+        result.passed = false;
+        result.reason = "the CPU reference and the shaders disagree";
+    }
+    return result;
+}
+
+// a string as the inside of a JSON string literal
+static std::string jsonEscape(const std::string &text)
+{
+    std::string escaped;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '"' || text[i] == '\\')
+            escaped += '\\';
+        escaped += text[i];
+    }
+    return escaped;
+}
+
+static bool writeJson(const std::string &path, const std::vector<GoldenResult> &results, int width, int height)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+    {
+        std::cout << "ERROR::GOLDEN:: cannot write " << path << std::endl;
+        return false;
+    }
+    fprintf(file, "{\n  \"renderer\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"views\": %d,\n  \"cases\": [\n",
+            (const char *)glGetString(GL_RENDERER), width, height, VIEW_COUNT);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const GoldenResult &r = results[i];
+        fprintf(file, "    {\"mode\": \"%s\", \"variant\": \"%s\", \"psnr\": %.3f, \"ssim\": %.5f, \"ms\": %.4f, "
+                      "\"reference_ms\": %.4f, \"speedup\": %.3f, \"passed\": %s, \"skipped\": %s, \"reason\": \"%s\"}%s\n",
+                r.mode.c_str(), r.variant.c_str(), r.minPsnr, r.minSsim, r.ms, r.referenceMs,
+                r.ms > 0.0 ? r.referenceMs / r.ms : 0.0, r.passed ? "true" : "false", r.skipped ? "true" : "false",
+                jsonEscape(r.reason).c_str(),
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int width = 512, height = 512, timingFrames = 20;
+    bool update = false, allowMissing = false;
+    // 0 reports the speedup without requiring one
+    double minSpeedup = 0.0;
+    std::string references = DATA_DIR"/golden", output = "golden.json";
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--update") == 0)
+            update = true;
+        else if (strcmp(argv[i], "--allow-missing") == 0)
+            allowMissing = true;
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+            {
+                std::cout << "ERROR::GOLDEN:: bad size " << argv[i] << ", expected WIDTHxHEIGHT" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            timingFrames = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--min-speedup") == 0 && i + 1 < argc)
+            minSpeedup = std::max(0.0, atof(argv[++i]));
+        else if (strcmp(argv[i], "--references") == 0 && i + 1 < argc)
+            references = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else
+        {
+            std::cout << "ERROR::GOLDEN:: unknown option " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // an invisible window only for its context
+    glfwSetErrorCallback(error_callback);
+    if (!glfwInit())
+        exit(EXIT_FAILURE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef __APPLE__ // for macos
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    GLFWwindow *window = glfwCreateWindow(width, height, "golden images", NULL, NULL);
+    if (!window) {
+        glfwTerminate();
+        exit(EXIT_FAILURE);
+    }
+    glfwMakeContextCurrent(window);
+    if (glewInit() != GLEW_OK)
+        exit(EXIT_FAILURE);
+    glEnable(GL_DEPTH_TEST);
+    // the timings are taken around glFinish, the renderers' pass queries would only pile up
+    GpuProfiler::instance().enabled = false;
+
+    TextureLoader textureLoader;
+    Model my3DModel(DATA_DIR"/Luminaris/FBX/Luminaris.fbx", false, &textureLoader, VERTEX_LAYOUT_COMPACT, true);
+    ResourceRegistry resourceRegistry(&textureLoader);
+    GoldenRenderer renderer(resourceRegistry, my3DModel, width, height, timingFrames);
+    CpuOcclusion cpuOcclusion;
+    textureLoader.finish();
+
+    std::vector<GoldenVariant> variantList = variants();
+    std::vector<GoldenResult> results;
+    bool ok = true;
+    for (int m = GOLDEN_OFF; m <= GOLDEN_BOTH; m++)
+    {
+        GoldenMode mode = (GoldenMode)m;
+        // the reference quality against the stored images
+        GoldenResult reference = { MODE_NAMES[m], "reference", ImageComparison::MAX_PSNR, 1.0, 0.0, 0.0, true, false, "" };
+        int missing = 0;
+        std::vector<Image> referenceImages;
+        for (int v = 0; v < VIEW_COUNT; v++)
+        {
+            double ms;
+            referenceImages.push_back(renderer.render(mode, RendererSettings::high(), VIEWS[v], ms));
+            reference.ms += ms / VIEW_COUNT;
+            char name[64];
+            snprintf(name, sizeof(name), "/%s_view%d.png", MODE_NAMES[m], v);
+            std::string path = references + name;
+            if (update)
+            {
+                reference.passed = referenceImages.back().savePng(path) && reference.passed;
+                reference.reason = "updated";
+                continue;
+            }
+            Image stored;
+            if (!stored.loadPng(path))
+            {
+                // the views that have one are still checked
+                printf("%s::GOLDEN:: missing %s, run with --update to create it\n", allowMissing ? "WARNING" : "ERROR", path.c_str());
+                missing++;
+                continue;
+            }
+            ImageComparison comparison = compareImages(referenceImages.back(), stored);
+            reference.minPsnr = std::min(reference.minPsnr, comparison.psnr);
+            reference.minSsim = std::min(reference.minSsim, comparison.ssim);
+        }
+        reference.referenceMs = reference.ms;
+        if (reference.reason.empty() && (reference.minPsnr < REFERENCE_PSNR || reference.minSsim < REFERENCE_SSIM))
+        {
+            reference.passed = false;
+            reference.reason = "differs from the stored image";
+        }
+        else if (reference.reason.empty() && missing > 0)
+        {
+            // without the stored images nothing guards the shaders the variants share with the reference
+            reference.passed = allowMissing;
+            reference.skipped = allowMissing && missing == VIEW_COUNT;
+            reference.reason = std::to_string(missing) + " of " + std::to_string(VIEW_COUNT) + " views have no stored image";
+        }
+        results.push_back(reference);
+
+        // the CPU reference on the last reference frame
+        if (mode != GOLDEN_OFF)
+            results.push_back(checkCpuReference(renderer.capture(mode), cpuOcclusion, MODE_NAMES[m], reference.ms));
+
+        // the optimizations against this run's reference
+        for (size_t i = 0; i < variantList.size() && mode != GOLDEN_OFF; i++)
+        {
+            const GoldenVariant &variant = variantList[i];
+            if (variant.ssaoOnly && mode != GOLDEN_SSAO)
+                continue;
+            GoldenResult result = { MODE_NAMES[m], variant.name, ImageComparison::MAX_PSNR, 1.0, 0.0, reference.ms, true, false, "" };
+            for (int v = 0; v < VIEW_COUNT; v++)
+            {
+                double ms;
+                Image image = renderer.render(mode, variant.settings, VIEWS[v], ms);
+                ImageComparison comparison = compareImages(image, referenceImages[v]);
+                result.minPsnr = std::min(result.minPsnr, comparison.psnr);
+                result.minSsim = std::min(result.minSsim, comparison.ssim);
+                result.ms += ms / VIEW_COUNT;
+            }
+            if (result.minPsnr < variant.minPsnr || result.minSsim < variant.minSsim)
+                result.reason = "too far from the reference";
+            else if (minSpeedup > 0.0 && result.ms * minSpeedup > result.referenceMs)
+                result.reason = "less than " + std::to_string(minSpeedup).substr(0, 4) + "x faster than the reference";
+            result.passed = result.reason.empty();
+            results.push_back(result);
+        }
+    }
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const GoldenResult &r = results[i];
+        printf("%-4s %-12s psnr %7.2f dB  ssim %.4f  %8.3f ms  speedup %5.2fx  %s%s%s\n", r.mode.c_str(), r.variant.c_str(),
+               r.minPsnr, r.minSsim, r.ms, r.ms > 0.0 ? r.referenceMs / r.ms : 0.0, !r.passed ? "FAILED" : r.skipped ? "skipped" : "ok",
+               r.reason.empty() ? "" : ": ", r.reason.c_str());
+        ok = ok && r.passed;
+    }
+    ok = writeJson(output, results, width, height) && ok;
+    if (ok)
+        printf("golden images: ok\n");
+    else
+        printf("ERROR::GOLDEN:: some cases failed, see %s\n", output.c_str());
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -7,6 +7,7 @@
 #include <sstream>
 #include <cstring>
 #include <iostream>
+#include <algorithm>
 #include <windows.h>
 
 #include "gl_env.h"
@@ -14,10 +15,17 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "utils_camera.h"
+#include "utils_camera_path.h"
 #include "utils_shader_program.h"
 #include "utils_mesh.h"
 #include "utils_model.h"
 #include "utils_light.h"
+#include "utils_texture_loader.h"
+#include "utils_resource_registry.h"
+#include "utils_resolution_scaler.h"
+#include "utils_gpu_profiler.h"
+#include "utils_cpu_profiler.h"
+#include "utils_frame_capture.h"
 
 #include "renderer_cube_quad.h"
 #include "renderer_off.h"
@@ -45,6 +53,22 @@ float cameraLastY   =  0.0f;
 int cameraFree = 1;
 int showInfo   = 1;
 int plainModel = 0;
+// occlusion quality: 1 low, 2 medium, 3 high
+int aoQuality  = 2;
+// occlusion resolution: 1 full, 2 half, 4 quarter
+int aoDownsample = 1;
+// temporal accumulation of the occlusion: 1 on, 0 off
+int aoTemporal = 0;
+// ambient occlusion estimator: 1 hemisphere, 2 horizon, 3 both side by side
+int aoMethod = 1;
+// SSAO and SSDO of the combined mode in one pass: 1 fused, 0 separate
+int aoFused = 1;
+// sky radiance of the SSDO samples: 1 spherical harmonics, 2 prefiltered environment
+int aoSky = 1;
+// kernel sampling: 1 random kernel and 4x4 noise, 2 Halton kernel and blue noise
+int aoSampling = 2;
+// dynamic resolution: 1 follows the frame budget, 0 renders at full size
+int dynamicResolution = 0;
 
 // keyboard input
 struct InputData
@@ -59,6 +83,8 @@ float inputLastTime = 0.0f;
 
 int main(int argc, char *argv[])
 {
+    CPU_PROFILE_THREAD("main");
+
     // create and init the window
     GLFWwindow *window;
 
@@ -70,7 +96,7 @@ int main(int argc, char *argv[])
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
 
 #ifdef __APPLE__ // for macos
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -100,42 +126,82 @@ int main(int argc, char *argv[])
     // enable depth test
     glEnable(GL_DEPTH_TEST);
 
-    // load the models
-    Model my3DModel(DATA_DIR"/Luminaris/FBX/Luminaris.fbx");
+    // decode all textures in parallel while the models and renderers are being set up
+    TextureLoader textureLoader;
 
-    // lights
-    const unsigned int NR_LIGHTS = 8;
-    std::vector<Light> lights;
-    srand(114514);
-    for (unsigned int i = 0; i < NR_LIGHTS; i++)
-    {
-        // calculate slightly random offsets
-        float xPos = static_cast<float>(((rand() % 100) / 100.0) * 4.0 - 2.0);
-        float yPos = static_cast<float>(((rand() % 100) / 100.0) * 4.0 - 2.0);
-        float zPos = static_cast<float>(((rand() % 100) / 100.0) * 8.0 - 4.0);
-        // also calculate random color
-        float rColor = static_cast<float>(((rand() % 100) / 200.0f) + 0.5); // between 0.5 and 1.0
-        float gColor = static_cast<float>(((rand() % 100) / 200.0f) + 0.5); // between 0.5 and 1.0
-        float bColor = static_cast<float>(((rand() % 100) / 200.0f) + 0.5); // between 0.5 and 1.0
-        lights.push_back(Light(glm::vec3(xPos, yPos, zPos), glm::vec3(rColor, gColor, bColor)));
-    }
+    // load the models; the geometry pass only reads positions, normals and uvs
+    Model my3DModel(DATA_DIR"/Luminaris/FBX/Luminaris.fbx", false, &textureLoader, VERTEX_LAYOUT_COMPACT, true);
+
+    // lights; "--lights N" scatters N of them instead of 8, with shorter ranges so the scene keeps its brightness
+    unsigned int lightCount = 8;
+    for (int i = 1; i + 1 < argc; i++)
+        if (strcmp(argv[i], "--lights") == 0)
+            lightCount = (unsigned int)std::max(1, atoi(argv[i + 1]));
+    std::vector<Light> lights = scatterLights(lightCount);
 
     // renderers
-    RendererOFF  rendererOFF;
-    RendererSSAO rendererSSAO;
-    RendererSSDO rendererSSDO;
-    RendererBoth rendererBoth;
-    RendererImage rendererImage;
+    // the renderers share skyboxes, g-buffers and occlusion targets through the registry
+    ResourceRegistry resourceRegistry(&textureLoader);
+    RendererOFF  rendererOFF(resourceRegistry);
+    RendererSSAO rendererSSAO(resourceRegistry);
+    RendererSSDO rendererSSDO(resourceRegistry);
+    RendererBoth rendererBoth(resourceRegistry);
+    RendererImage rendererImage(&textureLoader);
+
+    int activeQuality = aoQuality;
+    int activeDownsample = aoDownsample;
+    int activeTemporal = aoTemporal;
+    int activeMethod = aoMethod;
+    int activeFused = aoFused;
+    int activeSky = aoSky;
+    int activeSampling = aoSampling;
+
+    // internal render scale driven by the frame time, aiming at 60 fps
+    ResolutionScaler resolutionScaler(16.6f, 0.5f, 1.0f);
+    resolutionScaler.setEnabled(dynamicResolution == 1);
+
+    // upload the decoded textures
+    textureLoader.finish();
+    textureLoader.printTimings();
+    resourceRegistry.printUsage();
+    ProgramCache::instance().printStats();
+
+    // GPU time per pass; "--profile-csv file" also writes every frame's passes to file
+    GpuProfiler &gpuProfiler = GpuProfiler::instance();
+    for (int i = 1; i + 1 < argc; i++)
+        if (strcmp(argv[i], "--profile-csv") == 0)
+            gpuProfiler.openCsv(argv[i + 1]);
+    float profileShownTime = 0.0f;
+    // CPU scopes of the whole run, written on exit by "--cpu-trace file.json"; needs -DSSDO_CPU_PROFILER=ON
+    std::string cpuTracePath;
+    for (int i = 1; i + 1 < argc; i++)
+        if (strcmp(argv[i], "--cpu-trace") == 0)
+            cpuTracePath = argv[i + 1];
+    // "--record-path file" saves the camera of every frame on exit, for the benchmark to replay
+    std::string recordPath;
+    CameraPath recordedPath;
+    for (int i = 1; i + 1 < argc; i++)
+        if (strcmp(argv[i], "--record-path") == 0)
+            recordPath = argv[i + 1];
+    // "--capture dir" writes the last frame's g-buffer and occlusion there on exit, for OcclusionReference
+    std::string capturePath;
+    for (int i = 1; i + 1 < argc; i++)
+        if (strcmp(argv[i], "--capture") == 0)
+            capturePath = argv[i + 1];
 
     // the main loop
     float passed_time;
     while (!glfwWindowShouldClose(window)) {
+        CPU_PROFILE_SCOPE("frame");
         passed_time = (float) glfwGetTime();
 
         // timing and process the input
         inputDeltaTime = passed_time - inputLastTime;
         inputLastTime = passed_time;
-        processInput(window, inputData);
+        {
+            CPU_PROFILE_SCOPE("processInput");
+            processInput(window, inputData);
+        }
         if (inputData.state_1 == GLFW_PRESS)
             renderMode = 1;
         else if (inputData.state_2 == GLFW_PRESS)
@@ -145,6 +211,39 @@ int main(int argc, char *argv[])
         else if (inputData.state_4 == GLFW_PRESS)
             renderMode = 4;
 
+        // switch the occlusion shader variants
+        if (aoQuality != activeQuality || aoDownsample != activeDownsample || aoTemporal != activeTemporal ||
+            aoMethod != activeMethod || aoFused != activeFused || aoSky != activeSky ||
+            aoSampling != activeSampling)
+        {
+            CPU_PROFILE_SCOPE("setSettings");
+            RendererSettings settings = aoQuality == 1 ? RendererSettings::low() : aoQuality == 2 ? RendererSettings::medium() : RendererSettings::high();
+            if (aoTemporal == 1)
+                settings = settings.accumulated();
+            settings.downsample = aoDownsample;
+            settings.method = aoMethod == 2 ? AO_HORIZON : AO_HEMISPHERE;
+            settings.fused = aoFused == 1;
+            settings.sky = aoSky == 2 ? SKY_PREFILTERED : SKY_HARMONICS;
+            settings.sampling = aoSampling == 2 ? SAMPLING_LOW_DISCREPANCY : SAMPLING_RANDOM;
+            rendererSSAO.setSettings(settings);
+            rendererSSDO.setSettings(settings);
+            rendererBoth.setSettings(settings);
+            activeQuality = aoQuality;
+            activeDownsample = aoDownsample;
+            activeTemporal = aoTemporal;
+            activeMethod = aoMethod;
+            activeFused = aoFused;
+            activeSky = aoSky;
+            activeSampling = aoSampling;
+            rendererSSAO.setCompare(aoMethod == 3);
+        }
+
+        // adapt the render scale to the last frame's time
+        if (resolutionScaler.isEnabled() != (dynamicResolution == 1))
+            resolutionScaler.setEnabled(dynamicResolution == 1);
+        resolutionScaler.update(inputDeltaTime * 1000.0f);
+        float renderScale = resolutionScaler.scale();
+
         // get width & height
         float ratio;
         int width, height;
@@ -159,19 +258,50 @@ int main(int argc, char *argv[])
 
         // render
         if (renderMode == 1)
-            rendererOFF.render(my3DModel, camera, lights, width, height, plainModel);
+            rendererOFF.render(my3DModel, camera, lights, width, height, plainModel, renderScale);
         else if (renderMode == 2)
-            rendererSSAO.render(my3DModel, camera, lights, width, height, plainModel);
+            rendererSSAO.render(my3DModel, camera, lights, width, height, plainModel, renderScale);
         else if (renderMode == 3)
-            rendererSSDO.render(my3DModel, camera, lights, width, height, plainModel);
+            rendererSSDO.render(my3DModel, camera, lights, width, height, plainModel, renderScale);
         else if (renderMode == 4)
-            rendererBoth.render(my3DModel, camera, lights, width, height, plainModel);
+            rendererBoth.render(my3DModel, camera, lights, width, height, plainModel, renderScale);
+
+        gpuProfiler.endFrame();
 
+        // the per-pass breakdown as a bar over the info image, and in the window title twice a second
         if (showInfo == 1)
+        {
             rendererImage.draw(renderMode, cameraFree);
-
-        glfwSwapBuffers(window);
+            gpuProfiler.drawOverlay();
+            if (passed_time - profileShownTime > 0.5f)
+            {
+                glfwSetWindowTitle(window, ("OpenGL output | " + gpuProfiler.summary()).c_str());
+                profileShownTime = passed_time;
+            }
+        }
+
+        {
+            // waits here when the driver is frames ahead
+            CPU_PROFILE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
+
+        if (!recordPath.empty())
+            recordedPath.record(camera, passed_time);
+    }
+
+    if (!cpuTracePath.empty())
+        CpuProfiler::instance().writeTrace(cpuTracePath);
+    if (!recordPath.empty() && recordedPath.save(recordPath))
+        printf("camera path: %d keys written to %s\n", (int)recordedPath.keys.size(), recordPath.c_str());
+    if (!capturePath.empty())
+    {
+        if (renderMode == 1)
+            std::cout << "ERROR::MAIN:: --capture needs an occlusion mode, the last frame was rendered without" << std::endl;
+        else if (saveCapture(renderMode == 2 ? rendererSSAO.capture() : renderMode == 3 ? rendererSSDO.capture() : rendererBoth.capture(),
+                             capturePath))
+            printf("capture: frame written to %s\n", capturePath.c_str());
     }
 
     glfwDestroyWindow(window);
@@ -207,6 +337,52 @@ void processInput(GLFWwindow *window, InputData &inputData)
     else if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
         plainModel = 0;
 
+    if (glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS)
+        aoQuality = 1;
+    else if (glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS)
+        aoQuality = 2;
+    else if (glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS)
+        aoQuality = 3;
+
+    if (glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS)
+        aoDownsample = 1;
+    else if (glfwGetKey(window, GLFW_KEY_F6) == GLFW_PRESS)
+        aoDownsample = 2;
+    else if (glfwGetKey(window, GLFW_KEY_F7) == GLFW_PRESS)
+        aoDownsample = 4;
+
+    if (glfwGetKey(window, GLFW_KEY_F8) == GLFW_PRESS)
+        aoTemporal = 1;
+    else if (glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS)
+        aoTemporal = 0;
+
+    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
+        aoMethod = 1;
+    else if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS)
+        aoMethod = 2;
+    else if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS)
+        aoMethod = 3;
+
+    if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS)
+        aoFused = 1;
+    else if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS)
+        aoFused = 0;
+
+    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS)
+        aoSky = 1;
+    else if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS)
+        aoSky = 2;
+
+    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS)
+        aoSampling = 1;
+    else if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS)
+        aoSampling = 2;
+
+    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
+        dynamicResolution = 1;
+    else if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
+        dynamicResolution = 0;
+
     // camera change position
     if (!cameraFree) return;
     CameraSpeed cameraSpeed = SPEED_NORMAL;
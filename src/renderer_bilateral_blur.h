@@ -0,0 +1,114 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <string>
+
+#include "utils_shader_program.h"
+#include "utils_resource_registry.h"
+#include "renderer_cube_quad.h"
+
+// Separable joint bilateral blur for the occlusion results: a horizontal and a vertical pass of
+// a gaussian whose taps are damped by depth and normal differences, read from the depth and
+// normal buffers the occlusion was computed from.
+class RendererBilateralBlur
+{
+public:
+    RendererBilateralBlur() : shaderBlur(NULL), shaderBlurPair(NULL), radius(0), pairRadius(0) {}
+
+    // switches to another radius; each is compiled once and cached afterwards
+    void setRadius(int radius)
+    {
+        if (radius == this->radius)
+            return;
+        this->radius = radius;
+        pairRadius = 0;
+        ShaderDefines defines;
+        defines["BLUR_RADIUS"] = std::to_string(radius);
+        shaderBlur = &variants.get(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/common/bilateral_blur.fs", defines);
+        shaderBlur->use();
+        shaderBlur->setInt("blurInput", 0);
+        shaderBlur->setInt("gDepth", 1);
+        shaderBlur->setInt("gNormal", 2);
+    }
+
+    // blurs input into outputFBO through the intermediate target, within the current viewport
+    void blur(GLuint input, const RenderTarget &intermediate, GLuint outputFBO,
+              GLuint gDepth, GLuint gNormal, int width, int height)
+    {
+        shaderBlur->use();
+        glUniform2i(shaderBlur->locateUnifrom("renderSize"), width, height);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, gDepth);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, gNormal);
+
+        // horizontal
+        glBindFramebuffer(GL_FRAMEBUFFER, intermediate.fbo);
+            glUniform2i(shaderBlur->locateUnifrom("direction"), 1, 0);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, input);
+            rendererCubeQuad.renderQuad();
+        // vertical
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+            glUniform2i(shaderBlur->locateUnifrom("direction"), 0, 1);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, intermediate.texture);
+            rendererCubeQuad.renderQuad();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // blurs two inputs at once with the weights computed once, through a pair of intermediate targets
+    // into the two attachments of outputFBO
+    void blurPair(GLuint input0, GLuint input1, const RenderTargetPair &intermediate, GLuint outputFBO,
+                  GLuint gDepth, GLuint gNormal, int width, int height)
+    {
+        // built on first use, most renderers never need it
+        if (pairRadius != radius)
+        {
+            ShaderDefines defines;
+            defines["BLUR_RADIUS"] = std::to_string(radius);
+            defines["BLUR_PAIR"] = "1";
+            shaderBlurPair = &variants.get(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/common/bilateral_blur.fs", defines);
+            shaderBlurPair->use();
+            shaderBlurPair->setInt("blurInput", 0);
+            shaderBlurPair->setInt("gDepth", 1);
+            shaderBlurPair->setInt("gNormal", 2);
+            shaderBlurPair->setInt("blurInput2", 3);
+            pairRadius = radius;
+        }
+        shaderBlurPair->use();
+        glUniform2i(shaderBlurPair->locateUnifrom("renderSize"), width, height);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, gDepth);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, gNormal);
+
+        // horizontal
+        glBindFramebuffer(GL_FRAMEBUFFER, intermediate.fbo);
+            glUniform2i(shaderBlurPair->locateUnifrom("direction"), 1, 0);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, input0);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, input1);
+            rendererCubeQuad.renderQuad();
+        // vertical
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+            glUniform2i(shaderBlurPair->locateUnifrom("direction"), 0, 1);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, intermediate.textures[0]);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, intermediate.textures[1]);
+            rendererCubeQuad.renderQuad();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+private:
+    ShaderProgram *shaderBlur;
+    ShaderProgram *shaderBlurPair;
+    // every radius switched to, kept to switch back
+    ShaderVariants variants;
+    int radius, pairRadius;
+
+    RendererCubeQuad rendererCubeQuad;
+};
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "gl_env.h"
-#include <stb_image.h>
+#include "utils_texture_loader.h"
+
+#include <vector>
+#include <string>
 
 class RendererCubeQuad
 {
@@ -129,34 +132,25 @@ public:
     // -Y (bottom)
     // +Z (front)
     // -Z (back)
+    // if a texture loader is given the faces are decoded in parallel and uploaded once it finishes
     // -------------------------------------------------------
-    unsigned int loadCubemap(vector<std::string> faces)
+    unsigned int loadCubemap(std::vector<std::string> faces, TextureLoader *loader = NULL)
     {
         unsigned int textureID;
         glGenTextures(1, &textureID);
         glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-        int width, height, nrChannels;
-        for (unsigned int i = 0; i < faces.size(); i++)
-        {
-            unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-            if (data)
-            {
-                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-                stbi_image_free(data);
-            }
-            else
-            {
-                std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-                stbi_image_free(data);
-            }
-        }
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
+        for (unsigned int i = 0; i < faces.size(); i++)
+        {
+            TextureJob job = { faces[i], textureID, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 3, false, false };
+            TextureLoader::load(job, loader);
+        }
+
         return textureID;
     }
 };
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <vector>
+#include <algorithm>
+
+#include "utils_shader_program.h"
+#include "utils_resource_registry.h"
+#include "renderer_cube_quad.h"
+
+// Hierarchical depth: a min/max linear-depth mip pyramid of the occlusion input, rebuilt every
+// frame. The occlusion shaders read depth through common/hiz.glsl, which picks coarser levels for
+// samples farther from the pixel, so wide kernels no longer scatter over the full-res buffer.
+class RendererHiZ
+{
+public:
+    // levels built: 0 up to HIZ_MAX_LEVEL of common/hiz.glsl, the coarsest the shaders read
+    static const int MAX_LEVELS = 6;
+
+    // the pyramid, min depth in red and max depth in green
+    GLuint texture;
+
+    RendererHiZ(ResourceRegistry &registry) : texture(0), width(0), height(0), registry(registry)
+    {
+        shaderInit   = ShaderProgram(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/common/hiz_init.fs");
+        shaderReduce = ShaderProgram(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/common/hiz_reduce.fs");
+        shaderInit.use();
+        shaderInit.setInt("gDepth", 0);
+        shaderReduce.use();
+        shaderReduce.setInt("hiZ", 0);
+    }
+
+    ~RendererHiZ()
+    {
+        release();
+    }
+
+    // follows the size of the occlusion targets
+    void resize(int width, int height)
+    {
+        release();
+        DepthPyramid pyramid = registry.acquireDepthPyramid(width, height, MAX_LEVELS);
+        texture = pyramid.texture;
+        fbos = pyramid.fbos;
+        this->width = width;
+        this->height = height;
+    }
+
+    void release()
+    {
+        if (!fbos.empty())
+            registry.releaseFramebuffer(fbos[0]);
+        fbos.clear();
+        texture = 0;
+        width = height = 0;
+    }
+
+    // rebuilds the pyramid from the g-buffer's linear depth; changes the viewport
+    void build(GLuint gDepth)
+    {
+        glViewport(0, 0, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbos[0]);
+            shaderInit.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, gDepth);
+            rendererCubeQuad.renderQuad();
+
+        // each level reads only the one below it, so the level being written is never sampled
+        shaderReduce.use();
+        glBindTexture(GL_TEXTURE_2D, texture);
+        for (int level = 1; level < (int)fbos.size(); level++)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+            glViewport(0, 0, std::max(1, width >> level), std::max(1, height >> level));
+            glBindFramebuffer(GL_FRAMEBUFFER, fbos[level]);
+            rendererCubeQuad.renderQuad();
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)fbos.size() - 1);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+private:
+    ShaderProgram shaderInit;
+    ShaderProgram shaderReduce;
+
+    std::vector<GLuint> fbos;
+    int width, height;
+
+    RendererCubeQuad rendererCubeQuad;
+    ResourceRegistry &registry;
+};
@@ -12,7 +12,7 @@
 
 #include "gl_env.h"
 #include "utils_shader_program.h"
-#include <stb_image.h>
+#include "utils_texture_loader.h"
 
 class RendererImage
 {
@@ -28,7 +28,7 @@ private:
     unsigned int ssdo_lock;
     unsigned int both_lock;
 
-    unsigned int loadTexture(const char *path)
+    unsigned int loadTexture(const char *path, TextureLoader *loader)
     {
         // load texture
         unsigned int texture;
@@ -38,19 +38,8 @@ private:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        int width, height, nrChannels;
-        stbi_set_flip_vertically_on_load(true);
-        unsigned char *data = stbi_load(path, &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-        }
-        else
-        {
-            std::cout << "Failed to load texture" << std::endl;
-        }
-        stbi_image_free(data);
+        TextureJob job = { path, texture, GL_TEXTURE_2D, GL_TEXTURE_2D, 4, true, true };
+        TextureLoader::load(job, loader);
         return texture;
     }
 
@@ -59,7 +48,7 @@ private:
 
 
 public:
-    RendererImage()
+    RendererImage(TextureLoader *textureLoader = NULL)
     {
         // shader
         //-------------------------------
@@ -88,14 +77,14 @@ public:
 
         // images
         //-------------------------------
-        off_free  = loadTexture(DATA_DIR"/image/off_free.png");
-        ssao_free = loadTexture(DATA_DIR"/image/ssao_free.png");
-        ssdo_free = loadTexture(DATA_DIR"/image/ssdo_free.png");
-        both_free = loadTexture(DATA_DIR"/image/both_free.png");
-        off_lock  = loadTexture(DATA_DIR"/image/off_lock.png");
-        ssao_lock = loadTexture(DATA_DIR"/image/ssao_lock.png");
-        ssdo_lock = loadTexture(DATA_DIR"/image/ssdo_lock.png");
-        both_lock = loadTexture(DATA_DIR"/image/both_lock.png");
+        off_free  = loadTexture(DATA_DIR"/image/off_free.png", textureLoader);
+        ssao_free = loadTexture(DATA_DIR"/image/ssao_free.png", textureLoader);
+        ssdo_free = loadTexture(DATA_DIR"/image/ssdo_free.png", textureLoader);
+        both_free = loadTexture(DATA_DIR"/image/both_free.png", textureLoader);
+        off_lock  = loadTexture(DATA_DIR"/image/off_lock.png", textureLoader);
+        ssao_lock = loadTexture(DATA_DIR"/image/ssao_lock.png", textureLoader);
+        ssdo_lock = loadTexture(DATA_DIR"/image/ssdo_lock.png", textureLoader);
+        both_lock = loadTexture(DATA_DIR"/image/both_lock.png", textureLoader);
     }
 
     void draw(int renderMode, int cameraFree)
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include <glm/glm.hpp>
+
+#include "utils_shader_program.h"
+#include "utils_light.h"
+#include "utils_cpu_profiler.h"
+
+// Clustered light culling for the deferred lighting pass. The view frustum is cut into
+// CLUSTER_X x CLUSTER_Y screen tiles and CLUSTER_Z exponentially spaced depth slices. Every frame
+// each light's attenuation sphere is tested against the clusters it can reach, and the lights, the
+// per-cluster (offset, count) and the concatenated light indices go to buffer textures that
+// common/clusters.glsl reads, so a pixel only shades the lights of its own cluster.
+class RendererLightClusters
+{
+public:
+    static const int CLUSTER_X = 16;
+    static const int CLUSTER_Y = 9;
+    static const int CLUSTER_Z = 24;
+    static const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+
+    // lights and light references of the last update
+    size_t lightCount, referenceCount;
+
+    RendererLightClusters() : lightCount(0), referenceCount(0), zNear(0.0f), zFar(0.0f), sliceScale(0.0f), maxTexels(0), truncated(false)
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        for (int i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    }
+
+    ~RendererLightClusters()
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+    // points the cluster samplers of a lighting program at three units starting from firstUnit
+    void setSamplers(ShaderProgram &program, int firstUnit)
+    {
+        program.use();
+        program.setInt("lightData", firstUnit);
+        program.setInt("clusterGrid", firstUnit + 1);
+        program.setInt("clusterLights", firstUnit + 2);
+    }
+
+    // culls the lights against the clusters of this view and projection and uploads the lists
+    void update(const std::vector<Light> &lights, const glm::mat4 &view, const glm::mat4 &projection)
+    {
+        CPU_PROFILE_SCOPE("RendererLightClusters::update");
+        if (zFar == 0.0f || projection != clusterProjection)
+            buildBounds(projection);
+
+        lightData.resize(lights.size() * 8);
+        std::fill(counts.begin(), counts.end(), 0u);
+        references.clear();
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            glm::vec3 center = glm::vec3(view * glm::vec4(lights[i].lightPos, 1.0f));
+            float radius = lights[i].radius();
+            float *data = &lightData[i * 8];
+            data[0] = center.x; data[1] = center.y; data[2] = center.z; data[3] = lights[i].linear;
+            data[4] = lights[i].lightColor.r; data[5] = lights[i].lightColor.g; data[6] = lights[i].lightColor.b; data[7] = lights[i].quadratic;
+
+            float depthMin = -center.z - radius, depthMax = -center.z + radius;
+            if (depthMax < zNear || depthMin > zFar)
+                continue;
+            int z0 = slice(std::max(depthMin, zNear)), z1 = slice(std::min(depthMax, zFar));
+            int x0 = 0, x1 = CLUSTER_X - 1, y0 = 0, y1 = CLUSTER_Y - 1;
+            // entirely in front of the near plane: only the tiles its projection can cover
+            if (depthMin > zNear)
+            {
+                tileRange(center.x, radius, depthMin, depthMax, projection[0][0], CLUSTER_X, x0, x1);
+                tileRange(center.y, radius, depthMin, depthMax, projection[1][1], CLUSTER_Y, y0, y1);
+            }
+            for (int z = z0; z <= z1; z++)
+                for (int y = y0; y <= y1; y++)
+                    for (int x = x0; x <= x1; x++)
+                    {
+                        int cluster = x + CLUSTER_X * (y + CLUSTER_Y * z);
+                        if (!sphereTouches(cluster, center, radius))
+                            continue;
+                        references.push_back(glm::uvec2((unsigned int)cluster, (unsigned int)i));
+                        counts[cluster]++;
+                    }
+        }
+
+        // counting sort of the references by cluster
+        if ((GLint)references.size() > maxTexels)
+        {
+            if (!truncated)
+                std::cout << "ERROR::LIGHT_CLUSTERS:: " << references.size() << " light references exceed the buffer texture limit of "
+                          << maxTexels << ", dropping the rest" << std::endl;
+            truncated = true;
+            for (size_t r = maxTexels; r < references.size(); r++)
+                counts[references[r].x]--;
+            references.resize(maxTexels);
+        }
+        unsigned int offset = 0;
+        for (int c = 0; c < CLUSTER_COUNT; c++)
+        {
+            grid[c * 2] = offset;
+            grid[c * 2 + 1] = counts[c];
+            offset += counts[c];
+        }
+        // counts is reused as the fill position of every cluster
+        indices.resize(references.size());
+        std::fill(counts.begin(), counts.end(), 0u);
+        for (size_t r = 0; r < references.size(); r++)
+        {
+            unsigned int cluster = references[r].x;
+            indices[grid[cluster * 2] + counts[cluster]++] = references[r].y;
+        }
+
+        upload(0, lightData.empty() ? NULL : &lightData[0], lightData.size() * sizeof(float));
+        upload(1, &grid[0], grid.size() * sizeof(unsigned int));
+        upload(2, indices.empty() ? NULL : &indices[0], indices.size() * sizeof(unsigned int));
+        lightCount = lights.size();
+        referenceCount = references.size();
+    }
+
+    // binds the lists to the units given to setSamplers() and sets the cluster uniforms
+    void bind(ShaderProgram &program, int firstUnit)
+    {
+        program.setIVec3("clusterSize", CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+        program.setVec2("clusterSlicing", glm::vec2(sliceScale, -std::log(zNear) * sliceScale));
+        for (int i = 0; i < 3; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+    }
+
+private:
+    GLuint buffers[3], textures[3];
+
+    // view-space bounds of every cluster for clusterProjection
+    glm::mat4 clusterProjection;
+    std::vector<glm::vec3> boundsMin, boundsMax;
+    float zNear, zFar, sliceScale;
+    GLint maxTexels;
+    bool truncated;
+
+    // per-frame scratch, kept to avoid reallocating
+    std::vector<float> lightData;
+    std::vector<unsigned int> counts, grid, indices;
+    std::vector<glm::uvec2> references;
+
+    int slice(float depth) const
+    {
+        int z = (int)std::floor(std::log(depth / zNear) * sliceScale);
+        return std::max(0, std::min(CLUSTER_Z - 1, z));
+    }
+
+    // tiles along one axis the sphere's projection can cover, for a view-space extent at depths in [depthMin, depthMax]
+    static void tileRange(float center, float radius, float depthMin, float depthMax, float scale, int tiles, int &first, int &last)
+    {
+        float low = std::min((center - radius) / depthMin, (center - radius) / depthMax) * scale;
+        float high = std::max((center + radius) / depthMin, (center + radius) / depthMax) * scale;
+        first = std::max(0, (int)std::floor((low * 0.5f + 0.5f) * tiles));
+        last = std::min(tiles - 1, (int)std::floor((high * 0.5f + 0.5f) * tiles));
+    }
+
+    bool sphereTouches(int cluster, const glm::vec3 &center, float radius) const
+    {
+        glm::vec3 closest = glm::clamp(center, boundsMin[cluster], boundsMax[cluster]);
+        glm::vec3 delta = closest - center;
+        return glm::dot(delta, delta) <= radius * radius;
+    }
+
+    // near and far from the perspective matrix, and the view-space box around each cluster
+    void buildBounds(const glm::mat4 &projection)
+    {
+        clusterProjection = projection;
+        zNear = projection[3][2] / (projection[2][2] - 1.0f);
+        zFar = projection[3][2] / (projection[2][2] + 1.0f);
+        sliceScale = CLUSTER_Z / std::log(zFar / zNear);
+        boundsMin.resize(CLUSTER_COUNT);
+        boundsMax.resize(CLUSTER_COUNT);
+        counts.resize(CLUSTER_COUNT);
+        grid.resize(CLUSTER_COUNT * 2);
+        for (int z = 0; z < CLUSTER_Z; z++)
+        {
+            float depths[2] = { zNear * std::pow(zFar / zNear, (float)z / CLUSTER_Z),
+                                zNear * std::pow(zFar / zNear, (float)(z + 1) / CLUSTER_Z) };
+            for (int y = 0; y < CLUSTER_Y; y++)
+                for (int x = 0; x < CLUSTER_X; x++)
+                {
+                    int cluster = x + CLUSTER_X * (y + CLUSTER_Y * z);
+                    glm::vec3 low(1e30f), high(-1e30f);
+                    // the tile's corner rays at the slice's near and far depth
+                    for (int corner = 0; corner < 8; corner++)
+                    {
+                        float ndcX = (float)(x + (corner & 1)) / CLUSTER_X * 2.0f - 1.0f;
+                        float ndcY = (float)(y + ((corner >> 1) & 1)) / CLUSTER_Y * 2.0f - 1.0f;
+                        float depth = depths[corner >> 2];
+                        glm::vec3 point(ndcX * depth / projection[0][0], ndcY * depth / projection[1][1], -depth);
+                        low = glm::min(low, point);
+                        high = glm::max(high, point);
+                    }
+                    boundsMin[cluster] = low;
+                    boundsMax[cluster] = high;
+                }
+        }
+    }
+
+    // replaces the contents of one buffer, orphaning the old storage so the GPU isn't waited on
+    void upload(int index, const void *data, size_t bytes)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[index]);
+        glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, (size_t)16), NULL, GL_STREAM_DRAW);
+        if (bytes)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <glm/glm.hpp>
+
+#include "utils_shader_program.h"
+#include "utils_resource_registry.h"
+#include "renderer_cube_quad.h"
+
+// Runs the occlusion passes below full resolution. downsample() reduces the g-buffer's depth and
+// normal to 1/factor of its size, the occlusion and blur passes then read those instead, and
+// upsample() brings their result back to full resolution with a joint bilateral filter guided by
+// the full-res depth and normals.
+class RendererLowRes
+{
+public:
+    // the reduced buffers, valid after resize() with a factor above 1
+    GLuint depth, normal;
+
+    RendererLowRes(ResourceRegistry &registry) : depth(0), normal(0), factor(1), fbo(0), registry(registry)
+    {
+        shaderDownsample = ShaderProgram(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/common/downsample.fs");
+        shaderUpsample   = ShaderProgram(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/common/upsample.fs");
+        shaderDownsample.use();
+        shaderDownsample.setInt("gDepth", 0);
+        shaderDownsample.setInt("gNormal", 1);
+        shaderUpsample.use();
+        shaderUpsample.setInt("gDepth", 0);
+        shaderUpsample.setInt("gNormal", 1);
+        shaderUpsample.setInt("lowDepth", 2);
+        shaderUpsample.setInt("lowNormal", 3);
+        shaderUpsample.setInt("lowInput", 4);
+    }
+
+    ~RendererLowRes()
+    {
+        release();
+    }
+
+    // size of a full-res extent at 1/factor, rounded up so every full-res pixel is covered
+    static int reduce(int size, int factor)
+    {
+        return (size + factor - 1) / factor;
+    }
+
+    // follows the g-buffer it reduces; factor 1 frees the reduced buffers
+    void resize(const GBuffer &gBuffer, int width, int height, int factor)
+    {
+        release();
+        gDepth = gBuffer.gDepth;
+        gNormal = gBuffer.gNormal;
+        this->factor = factor;
+        if (factor <= 1)
+            return;
+        DepthNormalTarget target = registry.acquireDepthNormalTarget(reduce(width, factor), reduce(height, factor));
+        fbo = target.fbo;
+        depth = target.depth;
+        normal = target.normal;
+    }
+
+    void release()
+    {
+        if (fbo)
+            registry.releaseFramebuffer(fbo);
+        fbo = depth = normal = 0;
+        factor = 1;
+    }
+
+    // reduces the rendered part of the g-buffer, leaving the viewport at the reduced size
+    void downsample(int renderWidth, int renderHeight)
+    {
+        glViewport(0, 0, reduce(renderWidth, factor), reduce(renderHeight, factor));
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            shaderDownsample.use();
+            shaderDownsample.setInt("factor", factor);
+            glUniform2i(shaderDownsample.locateUnifrom("renderSize"), renderWidth, renderHeight);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, gDepth);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, gNormal);
+            rendererCubeQuad.renderQuad();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // writes lowInput back at full resolution into targetFBO, leaving the viewport at the render size
+    void upsample(GLuint lowInput, GLuint targetFBO, int renderWidth, int renderHeight)
+    {
+        glViewport(0, 0, renderWidth, renderHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+            shaderUpsample.use();
+            shaderUpsample.setInt("factor", factor);
+            glUniform2i(shaderUpsample.locateUnifrom("lowSize"), reduce(renderWidth, factor), reduce(renderHeight, factor));
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, gDepth);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, gNormal);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, depth);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, normal);
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_2D, lowInput);
+            rendererCubeQuad.renderQuad();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+private:
+    ShaderProgram shaderDownsample;
+    ShaderProgram shaderUpsample;
+
+    int factor;
+    GLuint fbo;
+    GLuint gDepth, gNormal;
+
+    RendererCubeQuad rendererCubeQuad;
+    ResourceRegistry &registry;
+};
@@ -9,6 +9,7 @@
 #include <cstring>
 #include <iostream>
 #include <random>
+#include <algorithm>
 
 #include "gl_env.h"
 
@@ -19,6 +20,10 @@
 #include "utils_model.h"
 
 #include "renderer_cube_quad.h"
+#include "renderer_light_clusters.h"
+#include "utils_resource_registry.h"
+#include "utils_gpu_profiler.h"
+#include "utils_cpu_profiler.h"
 
 class RendererOFF
 {
@@ -30,74 +35,49 @@ private:
     ShaderProgram shaderLightBox;
     ShaderProgram shaderSkyBox;
 
+    // per-cluster light lists of the lighting pass
+    RendererLightClusters lightClusters;
+
     // g-buffer
-    GLuint gBuffer, gPosition, gNormal, gAlbedo;
+    GLuint gBuffer, gDepth, gNormal, gAlbedo;
+
+    // lit scene before it is upscaled to the output
+    GLuint sceneFBO, sceneColor;
+    // size the targets are allocated at, 0 until the first frame
+    int targetWidth, targetHeight;
 
     // skybox
     GLuint skyBoxTexture;
 
+    // framebuffer the upscaled image goes to, the window's unless setOutput() says otherwise
+    GLuint outputFBO;
+
     RendererCubeQuad rendererCubeQuad;
+    ResourceRegistry &registry;
 
 public:
-    RendererOFF()
+    RendererOFF(ResourceRegistry &registry)
+        : targetWidth(0), targetHeight(0), registry(registry)
     {
+        CPU_PROFILE_SCOPE("RendererOFF::RendererOFF");
+        outputFBO = 0;
         // load, compile and link shaders
         // ------------------------------
-        shaderGeometryPass      = ShaderProgram(SRC_DIR"/src/shader/off/geometry.vs", SRC_DIR"/src/shader/off/geometry.fs");
-        shaderGeometryPlainPass = ShaderProgram(SRC_DIR"/src/shader/off/geometry.vs", SRC_DIR"/src/shader/off/geometry_plain.fs");
-        shaderLightingPass      = ShaderProgram(SRC_DIR"/src/shader/off/lighting.vs", SRC_DIR"/src/shader/off/lighting.fs");
-        shaderLightBox          = ShaderProgram(SRC_DIR"/src/shader/off/light_box.vs", SRC_DIR"/src/shader/off/light_box.fs");
-        shaderSkyBox            = ShaderProgram(SRC_DIR"/src/shader/off/sky_box.vs", SRC_DIR"/src/shader/off/sky_box.fs");
-
-        // configure g-buffer framebuffer
-        // ------------------------------
-        glGenFramebuffers(1, &gBuffer);
-        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-        // position color buffer
-        glGenTextures(1, &gPosition);
-        glBindTexture(GL_TEXTURE_2D, gPosition);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 800, 800, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
-        // normal color buffer
-        glGenTextures(1, &gNormal);
-        glBindTexture(GL_TEXTURE_2D, gNormal);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 800, 800, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
-        // color + specular color buffer
-        glGenTextures(1, &gAlbedo);
-        glBindTexture(GL_TEXTURE_2D, gAlbedo);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 800, 800, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gAlbedo, 0);
-        // tell OpenGL which color attachments we'll use (of this framebuffer) for rendering
-        unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-        glDrawBuffers(3, attachments);
-        // create and attach depth buffer (renderbuffer)
-        unsigned int rboDepth;
-        glGenRenderbuffers(1, &rboDepth);
-        glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, 800, 800);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-        // finally check if framebuffer is complete
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Framebuffer not complete!" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        shaderGeometryPass      = ShaderProgram(SRC_DIR"/src/shader/common/geometry.vs", SRC_DIR"/src/shader/common/geometry.fs");
+        shaderGeometryPlainPass = ShaderProgram(SRC_DIR"/src/shader/common/geometry.vs", SRC_DIR"/src/shader/common/geometry_plain.fs");
+        shaderLightingPass      = ShaderProgram(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/common/lighting.fs");
+        shaderLightBox          = ShaderProgram(SRC_DIR"/src/shader/common/light_box.vs", SRC_DIR"/src/shader/common/light_box.fs");
+        shaderSkyBox            = ShaderProgram(SRC_DIR"/src/shader/common/sky_box.vs", SRC_DIR"/src/shader/common/sky_box.fs");
 
         // shader configuration
         // --------------------
         shaderLightingPass.use();
-        shaderLightingPass.setInt("gPosition", 0);
+        shaderLightingPass.setInt("gDepth", 0);
         shaderLightingPass.setInt("gNormal", 1);
         shaderLightingPass.setInt("gAlbedo", 2);
         shaderSkyBox.use();
         shaderSkyBox.setInt("skybox", 0);
+        lightClusters.setSamplers(shaderLightingPass, 5);
 
         // skybox
         // --------------------
@@ -108,13 +88,71 @@ public:
             DATA_DIR"/skybox/bottom.jpg",
             DATA_DIR"/skybox/front.jpg",
             DATA_DIR"/skybox/back.jpg"};
-        skyBoxTexture = rendererCubeQuad.loadCubemap(skyBoxFaces);
+        skyBoxTexture = registry.acquireCubemap(skyBoxFaces);
     }
 
-    void render(Model &my3DModel, Camera &camera, std::vector<Light> &lights, int width, int height, int plainModel)
+    ~RendererOFF()
     {
+        // hand the shared resources back
+        releaseTargets();
+        registry.releaseTexture(skyBoxTexture);
+    }
+
+    // (re)allocates the render targets at the output size when it changes; a lower internal
+    // resolution renders into the bottom-left corner of them
+    void resizeTargets(int width, int height)
+    {
+        if (width == targetWidth && height == targetHeight)
+            return;
+        releaseTargets();
+
+        // shared g-buffer framebuffer
+        // ------------------------------
+        GBuffer gBufferTargets = registry.acquireGBuffer(width, height);
+        gBuffer = gBufferTargets.fbo;
+        gDepth = gBufferTargets.gDepth;
+        gNormal = gBufferTargets.gNormal;
+        gAlbedo = gBufferTargets.gAlbedo;
+
+        // lit scene at the internal resolution; shares the g-buffer's depth so lights and skybox are depth-tested directly
+        // ------------------------------
+        RenderTarget sceneTarget = registry.acquireRenderTarget("scene", width, height, GL_RGBA8, GL_RGBA, gBufferTargets.rboDepth);
+        sceneFBO = sceneTarget.fbo;
+        sceneColor = sceneTarget.texture;
+
+        targetWidth = width;
+        targetHeight = height;
+    }
+
+    void releaseTargets()
+    {
+        if (targetWidth == 0)
+            return;
+        registry.releaseFramebuffer(gBuffer);
+        registry.releaseFramebuffer(sceneFBO);
+        targetWidth = targetHeight = 0;
+    }
+
+    // sends the final image to framebuffer instead of the window, e.g. to read it back
+    void setOutput(GLuint framebuffer)
+    {
+        outputFBO = framebuffer;
+    }
+
+    void render(Model &my3DModel, Camera &camera, std::vector<Light> &lights, int width, int height, int plainModel,
+                float renderScale = 1.0f)
+    {
+        CPU_PROFILE_SCOPE("RendererOFF::render");
+        // render at renderScale of the output size, then upscale
+        resizeTargets(width, height);
+        int renderWidth  = std::max(1, (int)(width * renderScale + 0.5f));
+        int renderHeight = std::max(1, (int)(height * renderScale + 0.5f));
+        glm::vec2 uvScale((float)renderWidth / (float)width, (float)renderHeight / (float)height);
+        glViewport(0, 0, renderWidth, renderHeight);
+
         // 1. geometry pass: render scene's geometry/color data into gbuffer
         // -----------------------------------------------------------------
+        GpuProfiler::instance().pass("geometry");
         glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             glm::mat4 projection = glm::perspective(glm::radians(camera.getFov()), (float)width / (float)height, 0.1f, 100.0f);
@@ -142,41 +180,29 @@ public:
 
         // 2. lighting pass: calculate lighting by iterating over a screen filled quad pixel-by-pixel using the gbuffer's content.
         // -----------------------------------------------------------------------------------------------------------------------
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        GpuProfiler::instance().pass("lighting");
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        glClear(GL_COLOR_BUFFER_BIT);
         shaderLightingPass.use();
+        shaderLightingPass.setVec2("uvScale", uvScale);
+        shaderLightingPass.setMat4("invProjection", glm::inverse(projection));
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gPosition);
+        glBindTexture(GL_TEXTURE_2D, gDepth);
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, gNormal);
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_2D, gAlbedo);
-        // send light relevant uniforms
-        for (unsigned int i = 0; i < lights.size(); i++)
-        {
-            glm::vec3 lightPosView = glm::vec3(camera.getView() * glm::vec4(lights[i].lightPos, 1.0));
-            shaderLightingPass.setVec3("lights[" + std::to_string(i) + "].Position", lightPosView);
-            shaderLightingPass.setVec3("lights[" + std::to_string(i) + "].Color", lights[i].lightColor);
-            // update attenuation parameters and calculate radius
-            const float linear = 0.7f;
-            const float quadratic = 1.8f;
-            shaderLightingPass.setFloat("lights[" + std::to_string(i) + "].Linear", linear);
-            shaderLightingPass.setFloat("lights[" + std::to_string(i) + "].Quadratic", quadratic);
-        }
-        // finally render quad
+        // cull the lights into clusters and bind their lists
+        lightClusters.update(lights, view, projection);
+        lightClusters.bind(shaderLightingPass, 5);
+        // finally render quad, keeping the g-buffer depth intact
+        glDisable(GL_DEPTH_TEST);
         rendererCubeQuad.renderQuad();
-
-        // 2.5. copy content of geometry's depth buffer to default framebuffer's depth buffer
-        // ----------------------------------------------------------------------------------
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // write to default framebuffer
-        // blit to default framebuffer. Note that this may or may not work as the internal formats of both the FBO and default framebuffer have to match.
-        // the internal formats are implementation defined. This works on all of my systems, but if it doesn't on yours you'll likely have to write to the
-        // depth buffer in another shader stage (or somehow see to match the default framebuffer's internal format with the FBO's internal format).
-        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glEnable(GL_DEPTH_TEST);
 
         // 3. render lights on top of scene
         // --------------------------------
+        GpuProfiler::instance().pass("lights");
         shaderLightBox.use();
         shaderLightBox.setMat4("projection", projection);
         shaderLightBox.setMat4("view", view);
@@ -191,6 +217,7 @@ public:
         }
 
         // 4. draw skybox as last
+        GpuProfiler::instance().pass("skybox");
         glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
         shaderSkyBox.use();
         view = glm::mat4(glm::mat3(camera.getView())); // remove translation from the view matrix
@@ -201,5 +228,15 @@ public:
         glBindTexture(GL_TEXTURE_CUBE_MAP, skyBoxTexture);
         rendererCubeQuad.renderCube();
         glDepthFunc(GL_LESS); // set depth function back to default
+
+        // 5. upscale the internal resolution to the output
+        // --------------------------------
+        GpuProfiler::instance().pass("upscale");
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputFBO);
+        glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT,
+                          renderWidth == width && renderHeight == height ? GL_NEAREST : GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
     }
 };
\ No newline at end of file
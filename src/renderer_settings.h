@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "utils_shader_program.h"
+#include "utils_sampling.h"
+
+// estimator of the ambient occlusion pass
+enum AOMethod
+{
+    // random samples in the normal-oriented hemisphere, tested against the depth buffer (ssao/ssao.fs)
+    AO_HEMISPHERE,
+    // horizon angles marched along a few screen directions and integrated per slice (ssao/gtao.fs)
+    AO_HORIZON
+};
+
+// where SSDO's unoccluded samples take the sky's radiance from (common/sky.glsl)
+enum SkyLighting
+{
+    // second-order spherical harmonics of the skybox, no texture fetch (utils_sky_sh.h)
+    SKY_HARMONICS,
+    // the prefiltered mip chain of the skybox at the level of a sample's solid angle (renderer_sky_prefilter.h)
+    SKY_PREFILTERED
+};
+
+// sample pattern of the occlusion kernels and of their per-pixel rotation
+enum KernelSampling
+{
+    // white-noise kernel and 4x4 random rotations
+    SAMPLING_RANDOM,
+    // Halton kernel and the 64x64 blue-noise rotations (utils_sampling.h)
+    SAMPLING_LOW_DISCREPANCY
+};
+
+// quality knobs of the occlusion passes. Kernel size and radius are baked into the shaders as defines,
+// so every distinct setting is its own variant with the kernel loop unrolled and the constants folded.
+struct RendererSettings
+{
+    int kernelSize;    // hemisphere samples per pixel
+    float radius;      // sample radius in view space
+    int downsample;    // occlusion runs at 1/downsample of the render size: 1, 2 or 4
+    int blurRadius;    // taps on each side of the bilateral blur
+    bool temporal;     // accumulate the occlusion over frames
+    AOMethod method;   // ambient occlusion estimator
+    bool fused;        // RendererBoth computes SSAO and SSDO in one sample loop (hemisphere estimator only)
+    SkyLighting sky;   // sky radiance of the SSDO samples
+    KernelSampling sampling; // kernel and rotation pattern
+
+    // the edge-aware blur hides the noise of small kernels, so fewer samples get a wider blur
+    static RendererSettings low()    { RendererSettings s = { 8,  0.5f, 1, 4, false, AO_HEMISPHERE, true, SKY_HARMONICS, SAMPLING_LOW_DISCREPANCY }; return s; }
+    static RendererSettings medium() { RendererSettings s = { 12, 0.5f, 1, 3, false, AO_HEMISPHERE, true, SKY_HARMONICS, SAMPLING_LOW_DISCREPANCY }; return s; }
+    static RendererSettings high()   { RendererSettings s = { 32, 0.5f, 1, 2, false, AO_HEMISPHERE, true, SKY_HARMONICS, SAMPLING_LOW_DISCREPANCY }; return s; }
+
+    // the same quality accumulated over frames: the history supplies the samples, so each
+    // frame takes at most 8 and needs less blur
+    RendererSettings accumulated() const
+    {
+        RendererSettings s = *this;
+        s.temporal = true;
+        s.kernelSize = std::min(kernelSize, 8);
+        s.blurRadius = std::min(blurRadius, 2);
+        return s;
+    }
+
+    // the defines common/kernel.glsl reads
+    ShaderDefines defines() const
+    {
+        ShaderDefines defines;
+        defines["KERNEL_SIZE"] = std::to_string(kernelSize);
+        defines["RADIUS"] = std::to_string(radius);
+        defines["NOISE_SIZE"] = std::to_string(noiseSize()) + ".0";
+        return defines;
+    }
+
+    // kernel and rotation noise of the sampling pattern
+    std::vector<glm::vec3> kernel() const
+    {
+        return sampling == SAMPLING_LOW_DISCREPANCY ? generateHaltonKernel(kernelSize) : generateSampleKernel(kernelSize);
+    }
+    int noiseSize() const { return sampling == SAMPLING_LOW_DISCREPANCY ? BLUE_NOISE_SIZE : 4; }
+    std::string noiseName() const { return sampling == SAMPLING_LOW_DISCREPANCY ? "blue noise rotation" : "kernel rotation"; }
+    std::vector<glm::vec3> noise() const
+    {
+        return sampling == SAMPLING_LOW_DISCREPANCY ? blueNoiseRotations() : generateKernelNoise();
+    }
+
+    // the SSDO shaders also pick their sky source
+    ShaderDefines skyDefines() const
+    {
+        ShaderDefines defines = this->defines();
+        if (sky == SKY_PREFILTERED)
+            defines["SKY_PREFILTERED"] = "1";
+        return defines;
+    }
+
+    // the horizon estimator spends about the same depth fetches as the hemisphere kernel:
+    // 2 slices, each marched both ways
+    int horizonSlices() const { return 2; }
+    int horizonSteps() const { return std::max(2, kernelSize / 4); }
+
+    ShaderDefines horizonDefines() const
+    {
+        ShaderDefines defines = this->defines();
+        defines["HORIZON_SLICES"] = std::to_string(horizonSlices());
+        defines["HORIZON_STEPS"] = std::to_string(horizonSteps());
+        return defines;
+    }
+
+    // texture fetches per pixel of each estimator, including position, normal and noise of the pixel itself
+    int hemisphereFetches() const { return kernelSize + 3; }
+    int horizonFetches() const { return 2 * horizonSlices() * horizonSteps() + 3; }
+
+    bool operator==(const RendererSettings &other) const
+    {
+        return kernelSize == other.kernelSize && radius == other.radius && downsample == other.downsample &&
+               blurRadius == other.blurRadius && temporal == other.temporal &&
+               method == other.method && fused == other.fused && sky == other.sky &&
+               sampling == other.sampling;
+    }
+    bool operator!=(const RendererSettings &other) const { return !(*this == other); }
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include "utils_shader_program.h"
+#include "utils_resource_registry.h"
+#include "renderer_cube_quad.h"
+
+// Prefiltered environment for SSDO's sky samples. Level 0 is the skybox box filtered down to at
+// most MAX_SIZE, and every further level convolves the one above with a cosine-power lobe about as
+// wide as four of its own texels, ending in a plain cosine lobe at 1x1. common/sky.glsl then reads
+// the level whose lobe matches the solid angle a kernel sample stands for. The chain is shared
+// through the registry and filtered once per skybox.
+class RendererSkyPrefilter
+{
+public:
+    static const int MAX_SIZE = 256;
+
+    // the filtered chain, 0 until update()
+    GLuint texture;
+
+    RendererSkyPrefilter(ResourceRegistry &registry) : texture(0), source(0), registry(registry)
+    {
+        shaderPrefilter = ShaderProgram(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/common/sky_prefilter.fs");
+        shaderPrefilter.use();
+        shaderPrefilter.setInt("environment", 0);
+        glGenFramebuffers(1, &fbo);
+    }
+
+    ~RendererSkyPrefilter()
+    {
+        release();
+        glDeleteFramebuffers(1, &fbo);
+    }
+
+    // follows the skybox, filtering it the first time any renderer asks; must run after its upload.
+    // changes the viewport
+    void update(GLuint cubemap)
+    {
+        if (cubemap == source)
+            return;
+        release();
+        GLint sourceSize = 0;
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+        glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &sourceSize);
+        if (sourceSize <= 0)
+        {
+            std::cout << "ERROR::SKY_PREFILTER:: cubemap " << cubemap << " has no pixels to filter" << std::endl;
+            return;
+        }
+        int size = std::min(sourceSize, (GLint)MAX_SIZE);
+        bool created;
+        texture = registry.acquirePrefilteredCubemap(cubemap, size, created);
+        source = cubemap;
+        if (created)
+            filter(cubemap, sourceSize, size);
+    }
+
+    void release()
+    {
+        if (texture)
+            registry.releaseTexture(texture);
+        texture = source = 0;
+    }
+
+private:
+    ShaderProgram shaderPrefilter;
+    GLuint fbo;
+    GLuint source;
+
+    RendererCubeQuad rendererCubeQuad;
+    ResourceRegistry &registry;
+
+    void filter(GLuint cubemap, int sourceSize, int size)
+    {
+        // lets the lobes reach across face edges; this is global state, and the skybox benefits too
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        int levels = 1;
+        while ((size >> levels) > 0)
+            levels++;
+
+        shaderPrefilter.use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        for (int level = 0; level < levels; level++)
+        {
+            int levelSize = std::max(1, size >> level);
+            if (level == 0)
+            {
+                glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+                shaderPrefilter.setInt("footprint", sourceSize / size);
+            }
+            else
+            {
+                // each level reads only the one above it, so the level being written is never sampled
+                glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, level - 1);
+                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, level - 1);
+                // a cos^n lobe covers 2*pi/(n+1) sr, matched to four texels of 4*pi/(6*size^2) each
+                shaderPrefilter.setInt("footprint", 0);
+                shaderPrefilter.setFloat("exponent", std::max(1.0f, 0.75f * levelSize * levelSize - 1.0f));
+            }
+            glViewport(0, 0, levelSize, levelSize);
+            for (int face = 0; face < 6; face++)
+            {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, texture, level);
+                shaderPrefilter.setInt("face", face);
+                rendererCubeQuad.renderQuad();
+            }
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
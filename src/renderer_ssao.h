@@ -9,6 +9,7 @@
 #include <cstring>
 #include <iostream>
 #include <random>
+#include <algorithm>
 
 #include "gl_env.h"
 
@@ -19,10 +20,16 @@
 #include "utils_model.h"
 
 #include "renderer_cube_quad.h"
-
-#ifndef MY_LERP
-#define MY_LERP(a, b, f) ((a) + (f) * ((b) - (a)))
-#endif
+#include "renderer_light_clusters.h"
+#include "renderer_settings.h"
+#include "renderer_low_res.h"
+#include "renderer_bilateral_blur.h"
+#include "renderer_temporal.h"
+#include "renderer_hi_z.h"
+#include "utils_resource_registry.h"
+#include "utils_frame_capture.h"
+#include "utils_gpu_profiler.h"
+#include "utils_cpu_profiler.h"
 
 class RendererSSAO
 {
@@ -30,18 +37,32 @@ private:
     // shader programs
     ShaderProgram shaderGeometryPass;
     ShaderProgram shaderGeometryPlainPass;
-    ShaderProgram shaderSSAO;
-    ShaderProgram shaderBlur;
+    ShaderProgram *shaderSSAO;
+    ShaderProgram *shaderHorizon;
     ShaderProgram shaderLightingPass;
     ShaderProgram shaderLightBox;
     ShaderProgram shaderSkyBox;
+    // every quality variant the occlusion programs above were switched to, kept to switch back
+    ShaderVariants occlusionVariants;
+
+    // per-cluster light lists of the lighting pass
+    RendererLightClusters lightClusters;
 
     // g-buffer
-    GLuint gBuffer, gPosition, gNormal, gAlbedo;
+    GLuint gBuffer, gDepth, gNormal, gAlbedo;
+
+    // lit scene before it is upscaled to the output
+    GLuint sceneFBO, sceneColor;
+    // size and occlusion downsampling the targets are allocated for, 0 until the first frame
+    int targetWidth, targetHeight, targetDownsample;
 
     // framebuffer to hold ssao & blur output
     GLuint ssaoFBO, ssaoBlurFBO;
     GLuint ssaoColorBuffer, ssaoColorBufferBlur;
+    // between the horizontal and vertical blur pass
+    RenderTarget ssaoBlurIntermediate;
+    // full-res SSAO when it is computed at a reduced resolution, and what the lighting pass reads
+    GLuint ssaoUpsampleFBO, ssaoResult;
 
     // the ssao kernel & noise
     std::vector<glm::vec3> ssaoKernel;
@@ -50,136 +71,69 @@ private:
     // skybox
     GLuint skyBoxTexture;
 
+    // framebuffer the upscaled image goes to, the window's unless setOutput() says otherwise
+    GLuint outputFBO;
+
+    // kernel size and radius the occlusion shaders are built with
+    RendererSettings settings;
+    // the targets and uniforms of the last frame, for capture()
+    FrameCapture frameCapture;
+
+    // side-by-side comparison of the estimators: hemisphere on the left half, horizon on the right,
+    // each a pass of the GPU profiler, reported every COMPARE_FRAMES frames
+    static const int COMPARE_FRAMES = 60;
+    bool compare;
+    int compareFrames;
+
     RendererCubeQuad rendererCubeQuad;
+    ResourceRegistry &registry;
+    // edge-aware denoising of the occlusion
+    RendererBilateralBlur bilateralBlur;
+    // depth/normal downsampling and bilateral upsampling for the reduced-resolution occlusion
+    RendererLowRes lowRes;
+    // history of the occlusion for the temporal mode
+    RendererTemporal ssaoTemporal;
+    // min/max depth pyramid the occlusion samples read
+    RendererHiZ hiZ;
 
 public:
-    RendererSSAO()
+    RendererSSAO(ResourceRegistry &registry, const RendererSettings &settings = RendererSettings::medium())
+        : shaderSSAO(NULL), shaderHorizon(NULL), targetWidth(0), targetHeight(0), targetDownsample(1), registry(registry),
+          lowRes(registry), ssaoTemporal(registry, "ssao"), hiZ(registry)
     {
-        // load, compile and link shaders
-        // ------------------------------
-        shaderGeometryPass      = ShaderProgram(SRC_DIR"/src/shader/ssao/geometry.vs", SRC_DIR"/src/shader/ssao/geometry.fs");
-        shaderGeometryPlainPass = ShaderProgram(SRC_DIR"/src/shader/ssao/geometry.vs", SRC_DIR"/src/shader/ssao/geometry_plain.fs");
-        shaderSSAO              = ShaderProgram(SRC_DIR"/src/shader/ssao/ssao.vs", SRC_DIR"/src/shader/ssao/ssao.fs");
-        shaderBlur              = ShaderProgram(SRC_DIR"/src/shader/ssao/blur.vs", SRC_DIR"/src/shader/ssao/blur.fs");
-        shaderLightingPass      = ShaderProgram(SRC_DIR"/src/shader/ssao/lighting.vs", SRC_DIR"/src/shader/ssao/lighting.fs");
-        shaderLightBox          = ShaderProgram(SRC_DIR"/src/shader/ssao/light_box.vs", SRC_DIR"/src/shader/ssao/light_box.fs");
-        shaderSkyBox            = ShaderProgram(SRC_DIR"/src/shader/ssao/sky_box.vs", SRC_DIR"/src/shader/ssao/sky_box.fs");
-
+        CPU_PROFILE_SCOPE("RendererSSAO::RendererSSAO");
+        outputFBO = 0;
+        compare = false;
+        compareFrames = 0;
 
-        // configure g-buffer framebuffer
+        // load, compile and link shaders
         // ------------------------------
-        glGenFramebuffers(1, &gBuffer);
-        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-        // position color buffer
-        glGenTextures(1, &gPosition);
-        glBindTexture(GL_TEXTURE_2D, gPosition);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 800, 800, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
-        // normal color buffer
-        glGenTextures(1, &gNormal);
-        glBindTexture(GL_TEXTURE_2D, gNormal);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 800, 800, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
-        // color + specular color buffer
-        glGenTextures(1, &gAlbedo);
-        glBindTexture(GL_TEXTURE_2D, gAlbedo);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 800, 800, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gAlbedo, 0);
-        // tell OpenGL which color attachments we'll use (of this framebuffer) for rendering
-        unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-        glDrawBuffers(3, attachments);
-        // create and attach depth buffer (renderbuffer)
-        unsigned int rboDepth;
-        glGenRenderbuffers(1, &rboDepth);
-        glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, 800, 800);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-        // finally check if framebuffer is complete
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Framebuffer not complete!" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        shaderGeometryPass      = ShaderProgram(SRC_DIR"/src/shader/common/geometry.vs", SRC_DIR"/src/shader/common/geometry.fs");
+        shaderGeometryPlainPass = ShaderProgram(SRC_DIR"/src/shader/common/geometry.vs", SRC_DIR"/src/shader/common/geometry_plain.fs");
+        shaderLightingPass      = ShaderProgram(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/common/lighting.fs", ShaderDefines{{"USE_SSAO", "1"}});
+        shaderLightBox          = ShaderProgram(SRC_DIR"/src/shader/common/light_box.vs", SRC_DIR"/src/shader/common/light_box.fs");
+        shaderSkyBox            = ShaderProgram(SRC_DIR"/src/shader/common/sky_box.vs", SRC_DIR"/src/shader/common/sky_box.fs");
 
-        // also create framebuffer to hold SSAO processing stage
-        // -----------------------------------------------------
-        glGenFramebuffers(1, &ssaoFBO);  glGenFramebuffers(1, &ssaoBlurFBO);
-        glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
-        // SSAO color buffer
-        glGenTextures(1, &ssaoColorBuffer);
-        glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 800, 800, 0, GL_RGB, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoColorBuffer, 0);
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "SSAO Framebuffer not complete!" << std::endl;
-        // and blur stage
-        glBindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
-        glGenTextures(1, &ssaoColorBufferBlur);
-        glBindTexture(GL_TEXTURE_2D, ssaoColorBufferBlur);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 800, 800, 0, GL_RGB, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoColorBufferBlur, 0);
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "SSAO Blur Framebuffer not complete!" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-        // generate sample kernel
+        // kernel rotation noise
         // ----------------------
-        std::uniform_real_distribution<GLfloat> randomFloats(0.0, 1.0); // generates random floats between 0.0 and 1.0
-        std::default_random_engine generator;
-        for (unsigned int i = 0; i < 32; ++i)
-        {
-            glm::vec3 sample(randomFloats(generator) * 2.0 - 1.0, randomFloats(generator) * 2.0 - 1.0, randomFloats(generator));
-            sample = glm::normalize(sample);
-            sample *= randomFloats(generator);
-            float scale = float(i) / 32.0f;
-
-            // scale samples s.t. they're more aligned to center of kernel
-            scale = MY_LERP(0.1f, 1.0f, scale * scale);
-            sample *= scale;
-            ssaoKernel.push_back(sample);
-        }
-
-        // generate noise texture
-        // ----------------------
-        std::vector<glm::vec3> ssaoNoise;
-        for (unsigned int i = 0; i < 16; i++)
-        {
-            glm::vec3 noise(randomFloats(generator) * 2.0 - 1.0, randomFloats(generator) * 2.0 - 1.0, 0.0f); // rotate around z-axis (in tangent space)
-            ssaoNoise.push_back(noise);
-        }
-        glGenTextures(1, &noiseTexture);
-        glBindTexture(GL_TEXTURE_2D, noiseTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 4, 4, 0, GL_RGB, GL_FLOAT, &ssaoNoise[0]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        // follows the sampling pattern, acquired by setSettings()
+        noiseTexture = 0;
 
         // shader configuration
         // --------------------
         shaderLightingPass.use();
-        shaderLightingPass.setInt("gPosition", 0);
+        shaderLightingPass.setInt("gDepth", 0);
         shaderLightingPass.setInt("gNormal", 1);
         shaderLightingPass.setInt("gAlbedo", 2);
         shaderLightingPass.setInt("ssao", 3);
-        shaderSSAO.use();
-        shaderSSAO.setInt("gPosition", 0);
-        shaderSSAO.setInt("gNormal", 1);
-        shaderSSAO.setInt("texNoise", 2);
-        shaderBlur.use();
-        shaderBlur.setInt("ssaoInput", 0);
         shaderSkyBox.use();
         shaderSkyBox.setInt("skybox", 0);
+        lightClusters.setSamplers(shaderLightingPass, 5);
+
+        // kernel size & radius variants
+        // --------------------
+        setSettings(settings);
 
         // skybox
         // --------------------
@@ -190,13 +144,157 @@ public:
             DATA_DIR"/skybox/bottom.jpg",
             DATA_DIR"/skybox/front.jpg",
             DATA_DIR"/skybox/back.jpg"};
-        skyBoxTexture = rendererCubeQuad.loadCubemap(skyBoxFaces);
+        skyBoxTexture = registry.acquireCubemap(skyBoxFaces);
+    }
+
+    ~RendererSSAO()
+    {
+        // hand the shared resources back
+        releaseTargets();
+        registry.releaseTexture(noiseTexture);
+        registry.releaseTexture(skyBoxTexture);
+    }
+
+    // switches the occlusion shaders to another quality variant; each is compiled on first use and cached afterwards
+    void setSettings(const RendererSettings &settings)
+    {
+        this->settings = settings;
+        bilateralBlur.setRadius(settings.blurRadius);
+        ShaderDefines defines = settings.defines();
+        shaderSSAO = &occlusionVariants.get(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/ssao/ssao.fs", defines);
+        shaderSSAO->use();
+        shaderSSAO->setInt("gDepth", 0);
+        shaderSSAO->setInt("gNormal", 1);
+        shaderSSAO->setInt("texNoise", 2);
+        shaderSSAO->setInt("hiZ", 3);
+        shaderHorizon = &occlusionVariants.get(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/ssao/gtao.fs", settings.horizonDefines());
+        shaderHorizon->use();
+        shaderHorizon->setInt("gDepth", 0);
+        shaderHorizon->setInt("gNormal", 1);
+        shaderHorizon->setInt("texNoise", 2);
+        shaderHorizon->setInt("hiZ", 3);
+        ssaoKernel = settings.kernel();
+        // acquired before the old one is released, so an unchanged pattern keeps its texture
+        GLuint noise = registry.acquireNoiseTexture(settings.noiseName(), settings.noise());
+        if (noiseTexture)
+            registry.releaseTexture(noiseTexture);
+        noiseTexture = noise;
+    }
+
+    // splits the screen between the two estimators and prints their cost
+    void setCompare(bool compare)
+    {
+        this->compare = compare;
+        compareFrames = 0;
     }
 
-    void render(Model &my3DModel, Camera &camera, std::vector<Light> &lights, int width, int height, int plainModel)
+    // (re)allocates the render targets at the output size when it or the occlusion downsampling
+    // changes; a lower internal resolution renders into the bottom-left corner of them
+    void resizeTargets(int width, int height)
     {
+        if (width == targetWidth && height == targetHeight && settings.downsample == targetDownsample)
+            return;
+        releaseTargets();
+
+        // shared g-buffer framebuffer
+        // ------------------------------
+        GBuffer gBufferTargets = registry.acquireGBuffer(width, height);
+        gBuffer = gBufferTargets.fbo;
+        gDepth = gBufferTargets.gDepth;
+        gNormal = gBufferTargets.gNormal;
+        gAlbedo = gBufferTargets.gAlbedo;
+
+        // lit scene at the internal resolution; shares the g-buffer's depth so lights and skybox are depth-tested directly
+        // ------------------------------
+        RenderTarget sceneTarget = registry.acquireRenderTarget("scene", width, height, GL_RGBA8, GL_RGBA, gBufferTargets.rboDepth);
+        sceneFBO = sceneTarget.fbo;
+        sceneColor = sceneTarget.texture;
+
+        // occlusion inputs at 1/downsample of the size
+        // ------------------------------
+        lowRes.resize(gBufferTargets, width, height, settings.downsample);
+        int aoWidth = RendererLowRes::reduce(width, settings.downsample);
+        int aoHeight = RendererLowRes::reduce(height, settings.downsample);
+        hiZ.resize(aoWidth, aoHeight);
+
+        // SSAO processing stage and blur stage
+        // -----------------------------------------------------
+        RenderTarget ssaoTarget = registry.acquireRenderTarget("ssao", aoWidth, aoHeight, GL_RED, GL_RED);
+        ssaoFBO = ssaoTarget.fbo;
+        ssaoColorBuffer = ssaoTarget.texture;
+        RenderTarget ssaoBlurTarget = registry.acquireRenderTarget("ssao blur", aoWidth, aoHeight, GL_RED, GL_RED);
+        ssaoBlurFBO = ssaoBlurTarget.fbo;
+        ssaoColorBufferBlur = ssaoBlurTarget.texture;
+        ssaoBlurIntermediate = registry.acquireRenderTarget("ssao blur intermediate", aoWidth, aoHeight, GL_RED, GL_RED);
+        ssaoUpsampleFBO = 0;
+        ssaoResult = ssaoColorBufferBlur;
+        if (settings.downsample > 1)
+        {
+            RenderTarget ssaoUpsampleTarget = registry.acquireRenderTarget("ssao upsampled", width, height, GL_RED, GL_RED);
+            ssaoUpsampleFBO = ssaoUpsampleTarget.fbo;
+            ssaoResult = ssaoUpsampleTarget.texture;
+        }
+
+        frameCapture.setTargets(gDepth, gNormal, gAlbedo, ssaoResult, 0);
+
+        targetWidth = width;
+        targetHeight = height;
+        targetDownsample = settings.downsample;
+    }
+
+    void releaseTargets()
+    {
+        if (targetWidth == 0)
+            return;
+        registry.releaseFramebuffer(gBuffer);
+        registry.releaseFramebuffer(sceneFBO);
+        registry.releaseFramebuffer(ssaoFBO);
+        registry.releaseFramebuffer(ssaoBlurFBO);
+        registry.releaseFramebuffer(ssaoBlurIntermediate.fbo);
+        if (ssaoUpsampleFBO)
+            registry.releaseFramebuffer(ssaoUpsampleFBO);
+        lowRes.release();
+        hiZ.release();
+        ssaoTemporal.release();
+        targetWidth = targetHeight = 0;
+        frameCapture = FrameCapture();
+    }
+
+    // sends the final image to framebuffer instead of the window, e.g. to read it back
+    void setOutput(GLuint framebuffer)
+    {
+        outputFBO = framebuffer;
+    }
+
+    // the last frame's g-buffer, occlusion and uniforms, for readCapture() and saveCapture()
+    const FrameCapture &capture()
+    {
+        frameCapture.setSky(registry.acquireSkySH(skyBoxTexture));
+        return frameCapture;
+    }
+
+    void render(Model &my3DModel, Camera &camera, std::vector<Light> &lights, int width, int height, int plainModel,
+                float renderScale = 1.0f)
+    {
+        CPU_PROFILE_SCOPE("RendererSSAO::render");
+        // render at renderScale of the output size, then upscale
+        resizeTargets(width, height);
+        int renderWidth  = std::max(1, (int)(width * renderScale + 0.5f));
+        int renderHeight = std::max(1, (int)(height * renderScale + 0.5f));
+        glm::vec2 uvScale((float)renderWidth / (float)width, (float)renderHeight / (float)height);
+        glViewport(0, 0, renderWidth, renderHeight);
+        // and the occlusion at 1/downsample of that
+        int aoWidth  = RendererLowRes::reduce(renderWidth, targetDownsample);
+        int aoHeight = RendererLowRes::reduce(renderHeight, targetDownsample);
+        int aoTargetWidth  = RendererLowRes::reduce(width, targetDownsample);
+        int aoTargetHeight = RendererLowRes::reduce(height, targetDownsample);
+        glm::vec2 aoScale((float)aoWidth / (float)aoTargetWidth, (float)aoHeight / (float)aoTargetHeight);
+        GLuint aoDepth  = targetDownsample > 1 ? lowRes.depth : gDepth;
+        GLuint aoNormal = targetDownsample > 1 ? lowRes.normal : gNormal;
+
         // 1. geometry pass: render scene's geometry/color data into gbuffer
         // -----------------------------------------------------------------
+        GpuProfiler::instance().pass("geometry");
         glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             glm::mat4 projection = glm::perspective(glm::radians(camera.getFov()), (float)width / (float)height, 0.1f, 100.0f);
@@ -222,75 +320,95 @@ public:
             }
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+        // 1.5. reduce depth and normals for the occlusion passes, and build their depth pyramid
+        // ------------------------
+        GpuProfiler::instance().pass("hiz");
+        if (targetDownsample > 1)
+            lowRes.downsample(renderWidth, renderHeight);
+        hiZ.build(aoDepth);
+        glViewport(0, 0, aoWidth, aoHeight);
+
         // 2. generate SSAO
         // ------------------------
+        GpuProfiler::instance().pass("ssao");
+        readComparison();
         glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
             glClear(GL_COLOR_BUFFER_BIT);
-            shaderSSAO.use();
-            // Send kernel + rotation
-            for (unsigned int i = 0; i < 32; ++i)
-                shaderSSAO.setVec3("samples[" + std::to_string(i) + "]", ssaoKernel[i]);
-            shaderSSAO.setMat4("projection", projection);
             glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, gPosition);
+            glBindTexture(GL_TEXTURE_2D, aoDepth);
             glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, gNormal);
+            glBindTexture(GL_TEXTURE_2D, aoNormal);
             glActiveTexture(GL_TEXTURE2);
             glBindTexture(GL_TEXTURE_2D, noiseTexture);
-            rendererCubeQuad.renderQuad();
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, hiZ.texture);
+            if (compare)
+            {
+                glEnable(GL_SCISSOR_TEST);
+                glScissor(0, 0, aoWidth / 2, aoHeight);
+                GpuProfiler::instance().pass("ssao hemisphere");
+                renderOcclusion(*shaderSSAO, projection, aoScale);
+                glScissor(aoWidth / 2, 0, aoWidth - aoWidth / 2, aoHeight);
+                GpuProfiler::instance().pass("ssao horizon");
+                renderOcclusion(*shaderHorizon, projection, aoScale);
+                glDisable(GL_SCISSOR_TEST);
+            }
+            else
+                renderOcclusion(settings.method == AO_HORIZON ? *shaderHorizon : *shaderSSAO, projection, aoScale);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
-        // 3. blur SSAO texture to remove noise
+        // 2.5. accumulate SSAO over frames, reprojected into this one
         // ------------------------------------
-        glBindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
-            glClear(GL_COLOR_BUFFER_BIT);
-            shaderBlur.use();
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
-            rendererCubeQuad.renderQuad();
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GpuProfiler::instance().pass("temporal");
+        GLuint ssaoInput = ssaoColorBuffer;
+        if (settings.temporal)
+            ssaoInput = ssaoTemporal.accumulate(ssaoColorBuffer, aoDepth, aoNormal, view, projection,
+                                                aoTargetWidth, aoTargetHeight, aoWidth, aoHeight);
+        else
+            ssaoTemporal.release();
+
+        // 3. blur SSAO texture to remove noise, keeping depth and normal edges
+        // ------------------------------------
+        GpuProfiler::instance().pass("blur");
+        bilateralBlur.blur(ssaoInput, ssaoBlurIntermediate, ssaoBlurFBO, aoDepth, aoNormal, aoWidth, aoHeight);
 
 
+        // 3.5. bring the occlusion back to full resolution
+        // ------------------------------------
+        GpuProfiler::instance().pass("upsample");
+        if (targetDownsample > 1)
+            lowRes.upsample(ssaoColorBufferBlur, ssaoUpsampleFBO, renderWidth, renderHeight);
+        glViewport(0, 0, renderWidth, renderHeight);
+
         // 4. lighting pass: traditional deferred Blinn-Phong lighting with added screen-space ambient occlusion
         // -----------------------------------------------------------------------------------------------------
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        GpuProfiler::instance().pass("lighting");
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        glClear(GL_COLOR_BUFFER_BIT);
         shaderLightingPass.use();
+        shaderLightingPass.setVec2("uvScale", uvScale);
+        shaderLightingPass.setMat4("invProjection", glm::inverse(projection));
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gPosition);
+        glBindTexture(GL_TEXTURE_2D, gDepth);
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, gNormal);
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_2D, gAlbedo);
         glActiveTexture(GL_TEXTURE3); // add extra SSAO texture to lighting pass
-        glBindTexture(GL_TEXTURE_2D, ssaoColorBufferBlur);
-        // send light relevant uniforms
-        for (unsigned int i = 0; i < lights.size(); i++)
-        {
-            glm::vec3 lightPosView = glm::vec3(camera.getView() * glm::vec4(lights[i].lightPos, 1.0));
-            shaderLightingPass.setVec3("lights[" + std::to_string(i) + "].Position", lightPosView);
-            shaderLightingPass.setVec3("lights[" + std::to_string(i) + "].Color", lights[i].lightColor);
-            // update attenuation parameters and calculate radius
-            const float linear = 0.7f;
-            const float quadratic = 1.8f;
-            shaderLightingPass.setFloat("lights[" + std::to_string(i) + "].Linear", linear);
-            shaderLightingPass.setFloat("lights[" + std::to_string(i) + "].Quadratic", quadratic);
-        }
-        // finally render quad
+        glBindTexture(GL_TEXTURE_2D, ssaoResult);
+        // cull the lights into clusters and bind their lists
+        lightClusters.update(lights, view, projection);
+        lightClusters.bind(shaderLightingPass, 5);
+        // finally render quad, keeping the g-buffer depth intact
+        glDisable(GL_DEPTH_TEST);
         rendererCubeQuad.renderQuad();
-
-        // 4.5. copy content of geometry's depth buffer to default framebuffer's depth buffer
-        // ----------------------------------------------------------------------------------
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // write to default framebuffer
-        // blit to default framebuffer. Note that this may or may not work as the internal formats of both the FBO and default framebuffer have to match.
-        // the internal formats are implementation defined. This works on all of my systems, but if it doesn't on yours you'll likely have to write to the
-        // depth buffer in another shader stage (or somehow see to match the default framebuffer's internal format with the FBO's internal format).
-        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glEnable(GL_DEPTH_TEST);
+        frameCapture.setFrame(projection, view, lights, settings, renderWidth, renderHeight);
 
         // 5. render lights on top of scene
         // --------------------------------
+        GpuProfiler::instance().pass("lights");
         shaderLightBox.use();
         shaderLightBox.setMat4("projection", projection);
         shaderLightBox.setMat4("view", view);
@@ -305,6 +423,7 @@ public:
         }
 
         // 6. draw skybox as last
+        GpuProfiler::instance().pass("skybox");
         glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
         shaderSkyBox.use();
         view = glm::mat4(glm::mat3(camera.getView())); // remove translation from the view matrix
@@ -316,5 +435,42 @@ public:
         rendererCubeQuad.renderCube();
         glDepthFunc(GL_LESS); // set depth function back to default
 
+        // 7. upscale the internal resolution to the output
+        // --------------------------------
+        GpuProfiler::instance().pass("upscale");
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputFBO);
+        glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT,
+                          renderWidth == width && renderHeight == height ? GL_NEAREST : GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+
+    }
+
+private:
+    // one occlusion estimator over the current viewport, inputs already bound
+    void renderOcclusion(ShaderProgram &program, const glm::mat4 &projection, const glm::vec2 &uvScale)
+    {
+        CPU_PROFILE_SCOPE("RendererSSAO::renderOcclusion");
+        program.use();
+        program.setVec2("uvScale", uvScale);
+        ssaoTemporal.setNoise(program, settings.temporal);
+        // Send kernel + rotation
+        program.setVec3Array("samples", &ssaoKernel[0], (GLsizei)ssaoKernel.size());
+        program.setMat4("projection", projection);
+        program.setMat4("invProjection", glm::inverse(projection));
+        rendererCubeQuad.renderQuad();
+    }
+
+    // prints the profiler's rolling times of the two halves every COMPARE_FRAMES frames
+    void readComparison()
+    {
+        if (!compare || ++compareFrames < COMPARE_FRAMES)
+            return;
+        const GpuProfiler &profiler = GpuProfiler::instance();
+        printf("ao compare (half screen each): hemisphere %.3f ms, %d fetches/px | horizon %.3f ms, %d fetches/px\n",
+               profiler.averageMs("ssao hemisphere"), settings.hemisphereFetches(),
+               profiler.averageMs("ssao horizon"), settings.horizonFetches());
+        compareFrames = 0;
     }
 };
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <cstring>
 #include <iostream>
 #include <random>
+#include <algorithm>
 
 #include "gl_env.h"
 
@@ -19,10 +20,17 @@
 #include "utils_model.h"
 
 #include "renderer_cube_quad.h"
-
-#ifndef MY_LERP
-#define MY_LERP(a, b, f) ((a) + (f) * ((b) - (a)))
-#endif
+#include "renderer_light_clusters.h"
+#include "renderer_settings.h"
+#include "renderer_low_res.h"
+#include "renderer_bilateral_blur.h"
+#include "renderer_temporal.h"
+#include "renderer_hi_z.h"
+#include "renderer_sky_prefilter.h"
+#include "utils_resource_registry.h"
+#include "utils_frame_capture.h"
+#include "utils_gpu_profiler.h"
+#include "utils_cpu_profiler.h"
 
 class RendererSSDO
 {
@@ -30,18 +38,31 @@ private:
     // shader programs
     ShaderProgram shaderGeometryPass;
     ShaderProgram shaderGeometryPlainPass;
-    ShaderProgram shaderSSDO;
-    ShaderProgram shaderBlur;
+    ShaderProgram *shaderSSDO;
     ShaderProgram shaderLightingPass;
     ShaderProgram shaderLightBox;
     ShaderProgram shaderSkyBox;
+    // every quality variant the occlusion programs above were switched to, kept to switch back
+    ShaderVariants occlusionVariants;
+
+    // per-cluster light lists of the lighting pass
+    RendererLightClusters lightClusters;
 
     // g-buffer
-    GLuint gBuffer, gPosition, gNormal, gAlbedo;
+    GLuint gBuffer, gDepth, gNormal, gAlbedo;
+
+    // lit scene before it is upscaled to the output
+    GLuint sceneFBO, sceneColor;
+    // size and occlusion downsampling the targets are allocated for, 0 until the first frame
+    int targetWidth, targetHeight, targetDownsample;
 
     // framebuffer to hold ssdo & blur output
     GLuint ssdoFBO, ssdoBlurFBO;
     GLuint ssdoColorBuffer, ssdoColorBufferBlur;
+    // between the horizontal and vertical blur pass
+    RenderTarget ssdoBlurIntermediate;
+    // full-res SSDO when it is computed at a reduced resolution, and what the lighting pass reads
+    GLuint ssdoUpsampleFBO, ssdoResult;
 
     // the ssdo kernel & noise
     std::vector<glm::vec3> ssdoKernel;
@@ -50,138 +71,62 @@ private:
     // skybox
     GLuint skyBoxTexture;
 
+    // framebuffer the upscaled image goes to, the window's unless setOutput() says otherwise
+    GLuint outputFBO;
+
+    // kernel size and radius the occlusion shaders are built with
+    RendererSettings settings;
+    // the targets and uniforms of the last frame, for capture()
+    FrameCapture frameCapture;
+
     RendererCubeQuad rendererCubeQuad;
+    ResourceRegistry &registry;
+    // edge-aware denoising of the occlusion
+    RendererBilateralBlur bilateralBlur;
+    // depth/normal downsampling and bilateral upsampling for the reduced-resolution occlusion
+    RendererLowRes lowRes;
+    // history of the occlusion for the temporal mode
+    RendererTemporal ssdoTemporal;
+    // min/max depth pyramid the occlusion samples read
+    RendererHiZ hiZ;
+    // mip chain of the skybox for the prefiltered sky
+    RendererSkyPrefilter skyPrefilter;
 
 public:
-    RendererSSDO()
+    RendererSSDO(ResourceRegistry &registry, const RendererSettings &settings = RendererSettings::medium())
+        : shaderSSDO(NULL), targetWidth(0), targetHeight(0), targetDownsample(1), registry(registry), lowRes(registry),
+          ssdoTemporal(registry, "ssdo"), hiZ(registry), skyPrefilter(registry)
     {
+        CPU_PROFILE_SCOPE("RendererSSDO::RendererSSDO");
+        outputFBO = 0;
         // load, compile and link shaders
         // ------------------------------
-        shaderGeometryPass      = ShaderProgram(SRC_DIR"/src/shader/ssdo/geometry.vs", SRC_DIR"/src/shader/ssdo/geometry.fs");
-        shaderGeometryPlainPass = ShaderProgram(SRC_DIR"/src/shader/ssdo/geometry.vs", SRC_DIR"/src/shader/ssdo/geometry_plain.fs");
-        shaderSSDO              = ShaderProgram(SRC_DIR"/src/shader/ssdo/ssdo.vs", SRC_DIR"/src/shader/ssdo/ssdo.fs");
-        shaderBlur              = ShaderProgram(SRC_DIR"/src/shader/ssdo/blur.vs", SRC_DIR"/src/shader/ssdo/blur.fs");
-        shaderLightingPass      = ShaderProgram(SRC_DIR"/src/shader/ssdo/lighting.vs", SRC_DIR"/src/shader/ssdo/lighting.fs");
-        shaderLightBox          = ShaderProgram(SRC_DIR"/src/shader/ssdo/light_box.vs", SRC_DIR"/src/shader/ssdo/light_box.fs");
-        shaderSkyBox            = ShaderProgram(SRC_DIR"/src/shader/ssdo/sky_box.vs", SRC_DIR"/src/shader/ssdo/sky_box.fs");
+        shaderGeometryPass      = ShaderProgram(SRC_DIR"/src/shader/common/geometry.vs", SRC_DIR"/src/shader/common/geometry.fs");
+        shaderGeometryPlainPass = ShaderProgram(SRC_DIR"/src/shader/common/geometry.vs", SRC_DIR"/src/shader/common/geometry_plain.fs");
+        shaderLightingPass      = ShaderProgram(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/common/lighting.fs", ShaderDefines{{"USE_SSDO", "1"}});
+        shaderLightBox          = ShaderProgram(SRC_DIR"/src/shader/common/light_box.vs", SRC_DIR"/src/shader/common/light_box.fs");
+        shaderSkyBox            = ShaderProgram(SRC_DIR"/src/shader/common/sky_box.vs", SRC_DIR"/src/shader/common/sky_box.fs");
 
 
-        // configure g-buffer framebuffer
-        // ------------------------------
-        glGenFramebuffers(1, &gBuffer);
-        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-        // position color buffer
-        glGenTextures(1, &gPosition);
-        glBindTexture(GL_TEXTURE_2D, gPosition);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 800, 800, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
-        // normal color buffer
-        glGenTextures(1, &gNormal);
-        glBindTexture(GL_TEXTURE_2D, gNormal);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 800, 800, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
-        // color + specular color buffer
-        glGenTextures(1, &gAlbedo);
-        glBindTexture(GL_TEXTURE_2D, gAlbedo);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 800, 800, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gAlbedo, 0);
-        // tell OpenGL which color attachments we'll use (of this framebuffer) for rendering
-        unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-        glDrawBuffers(3, attachments);
-        // create and attach depth buffer (renderbuffer)
-        unsigned int rboDepth;
-        glGenRenderbuffers(1, &rboDepth);
-        glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, 800, 800);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-        // finally check if framebuffer is complete
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Framebuffer not complete!" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        // also create framebuffer to hold SSDO processing stage
-        // -----------------------------------------------------
-        glGenFramebuffers(1, &ssdoFBO);  glGenFramebuffers(1, &ssdoBlurFBO);
-        glBindFramebuffer(GL_FRAMEBUFFER, ssdoFBO);
-        // SSDO color buffer
-        glGenTextures(1, &ssdoColorBuffer);
-        glBindTexture(GL_TEXTURE_2D, ssdoColorBuffer);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 800, 800, 0, GL_RGB, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssdoColorBuffer, 0);
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "SSDO Framebuffer not complete!" << std::endl;
-        // and blur stage
-        glBindFramebuffer(GL_FRAMEBUFFER, ssdoBlurFBO);
-        glGenTextures(1, &ssdoColorBufferBlur);
-        glBindTexture(GL_TEXTURE_2D, ssdoColorBufferBlur);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 800, 800, 0, GL_RGB, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssdoColorBufferBlur, 0);
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "SSDO Blur Framebuffer not complete!" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        // generate sample kernel
+        // kernel rotation noise
         // ----------------------
-        std::uniform_real_distribution<GLfloat> randomFloats(0.0, 1.0); // generates random floats between 0.0 and 1.0
-        std::default_random_engine generator;
-        for (unsigned int i = 0; i < 32; ++i)
-        {
-            glm::vec3 sample(randomFloats(generator) * 2.0 - 1.0, randomFloats(generator) * 2.0 - 1.0, randomFloats(generator));
-            sample = glm::normalize(sample);
-            sample *= randomFloats(generator);
-            float scale = float(i) / 32.0f;
-
-            // scale samples s.t. they're more aligned to center of kernel
-            scale = MY_LERP(0.1f, 1.0f, scale * scale);
-            sample *= scale;
-            ssdoKernel.push_back(sample);
-        }
-
-        // generate noise texture
-        // ----------------------
-        std::vector<glm::vec3> ssdoNoise;
-        for (unsigned int i = 0; i < 16; i++)
-        {
-            glm::vec3 noise(randomFloats(generator) * 2.0 - 1.0, randomFloats(generator) * 2.0 - 1.0, 0.0f); // rotate around z-axis (in tangent space)
-            ssdoNoise.push_back(noise);
-        }
-        glGenTextures(1, &noiseTexture);
-        glBindTexture(GL_TEXTURE_2D, noiseTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 4, 4, 0, GL_RGB, GL_FLOAT, &ssdoNoise[0]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        // follows the sampling pattern, acquired by setSettings()
+        noiseTexture = 0;
 
         // shader configuration
         // --------------------
         shaderLightingPass.use();
-        shaderLightingPass.setInt("gPosition", 0);
+        shaderLightingPass.setInt("gDepth", 0);
         shaderLightingPass.setInt("gNormal", 1);
         shaderLightingPass.setInt("gAlbedo", 2);
         shaderLightingPass.setInt("ssdo", 3);
-        shaderSSDO.use();
-        shaderSSDO.setInt("gPosition", 0);
-        shaderSSDO.setInt("gNormal", 1);
-        shaderSSDO.setInt("gAlbedo", 2);
-        shaderSSDO.setInt("texNoise", 3);
-        shaderSSDO.setInt("skybox", 4);
-        shaderBlur.use();
-        shaderBlur.setInt("ssdoInput", 0);
         shaderSkyBox.use();
         shaderSkyBox.setInt("skybox", 0);
+        lightClusters.setSamplers(shaderLightingPass, 5);
+
+        // kernel size & radius variants
+        // --------------------
+        setSettings(settings);
 
         // skybox
         // --------------------
@@ -192,14 +137,152 @@ public:
             DATA_DIR"/skybox/bottom.jpg",
             DATA_DIR"/skybox/front.jpg",
             DATA_DIR"/skybox/back.jpg"};
-        skyBoxTexture = rendererCubeQuad.loadCubemap(skyBoxFaces);
+        skyBoxTexture = registry.acquireCubemap(skyBoxFaces);
+
+    }
+
+    ~RendererSSDO()
+    {
+        // hand the shared resources back
+        releaseTargets();
+        registry.releaseTexture(noiseTexture);
+        registry.releaseTexture(skyBoxTexture);
+    }
 
+    // switches the occlusion shaders to another quality variant; each is compiled on first use and cached afterwards
+    void setSettings(const RendererSettings &settings)
+    {
+        this->settings = settings;
+        bilateralBlur.setRadius(settings.blurRadius);
+        shaderSSDO = &occlusionVariants.get(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/ssdo/ssdo.fs", settings.skyDefines());
+        shaderSSDO->use();
+        shaderSSDO->setInt("gDepth", 0);
+        shaderSSDO->setInt("gNormal", 1);
+        shaderSSDO->setInt("gAlbedo", 2);
+        shaderSSDO->setInt("texNoise", 3);
+        shaderSSDO->setInt("hiZ", 4);
+        shaderSSDO->setInt("skyEnvironment", 5);
+        ssdoKernel = settings.kernel();
+        // acquired before the old one is released, so an unchanged pattern keeps its texture
+        GLuint noise = registry.acquireNoiseTexture(settings.noiseName(), settings.noise());
+        if (noiseTexture)
+            registry.releaseTexture(noiseTexture);
+        noiseTexture = noise;
     }
 
-    void render(Model &my3DModel, Camera &camera, std::vector<Light> &lights, int width, int height, int plainModel)
+    // (re)allocates the render targets at the output size when it or the occlusion downsampling
+    // changes; a lower internal resolution renders into the bottom-left corner of them
+    void resizeTargets(int width, int height)
     {
+        if (width == targetWidth && height == targetHeight && settings.downsample == targetDownsample)
+            return;
+        releaseTargets();
+
+        // shared g-buffer framebuffer
+        // ------------------------------
+        GBuffer gBufferTargets = registry.acquireGBuffer(width, height);
+        gBuffer = gBufferTargets.fbo;
+        gDepth = gBufferTargets.gDepth;
+        gNormal = gBufferTargets.gNormal;
+        gAlbedo = gBufferTargets.gAlbedo;
+
+        // lit scene at the internal resolution; shares the g-buffer's depth so lights and skybox are depth-tested directly
+        // ------------------------------
+        RenderTarget sceneTarget = registry.acquireRenderTarget("scene", width, height, GL_RGBA8, GL_RGBA, gBufferTargets.rboDepth);
+        sceneFBO = sceneTarget.fbo;
+        sceneColor = sceneTarget.texture;
+
+        // occlusion inputs at 1/downsample of the size
+        // ------------------------------
+        lowRes.resize(gBufferTargets, width, height, settings.downsample);
+        int aoWidth = RendererLowRes::reduce(width, settings.downsample);
+        int aoHeight = RendererLowRes::reduce(height, settings.downsample);
+        hiZ.resize(aoWidth, aoHeight);
+
+        // SSDO processing stage and blur stage
+        // -----------------------------------------------------
+        RenderTarget ssdoTarget = registry.acquireRenderTarget("ssdo", aoWidth, aoHeight, GL_RGB, GL_RGB);
+        ssdoFBO = ssdoTarget.fbo;
+        ssdoColorBuffer = ssdoTarget.texture;
+        RenderTarget ssdoBlurTarget = registry.acquireRenderTarget("ssdo blur", aoWidth, aoHeight, GL_RGB, GL_RGB);
+        ssdoBlurFBO = ssdoBlurTarget.fbo;
+        ssdoColorBufferBlur = ssdoBlurTarget.texture;
+        ssdoBlurIntermediate = registry.acquireRenderTarget("ssdo blur intermediate", aoWidth, aoHeight, GL_RGB, GL_RGB);
+        ssdoUpsampleFBO = 0;
+        ssdoResult = ssdoColorBufferBlur;
+        if (settings.downsample > 1)
+        {
+            RenderTarget ssdoUpsampleTarget = registry.acquireRenderTarget("ssdo upsampled", width, height, GL_RGB, GL_RGB);
+            ssdoUpsampleFBO = ssdoUpsampleTarget.fbo;
+            ssdoResult = ssdoUpsampleTarget.texture;
+        }
+
+        frameCapture.setTargets(gDepth, gNormal, gAlbedo, 0, ssdoResult);
+
+        targetWidth = width;
+        targetHeight = height;
+        targetDownsample = settings.downsample;
+    }
+
+    void releaseTargets()
+    {
+        if (targetWidth == 0)
+            return;
+        registry.releaseFramebuffer(gBuffer);
+        registry.releaseFramebuffer(sceneFBO);
+        registry.releaseFramebuffer(ssdoFBO);
+        registry.releaseFramebuffer(ssdoBlurFBO);
+        registry.releaseFramebuffer(ssdoBlurIntermediate.fbo);
+        if (ssdoUpsampleFBO)
+            registry.releaseFramebuffer(ssdoUpsampleFBO);
+        lowRes.release();
+        hiZ.release();
+        ssdoTemporal.release();
+        targetWidth = targetHeight = 0;
+        frameCapture = FrameCapture();
+    }
+
+    // sends the final image to framebuffer instead of the window, e.g. to read it back
+    void setOutput(GLuint framebuffer)
+    {
+        outputFBO = framebuffer;
+    }
+
+    // the last frame's g-buffer, occlusion and uniforms, for readCapture() and saveCapture()
+    const FrameCapture &capture()
+    {
+        frameCapture.setSky(registry.acquireSkySH(skyBoxTexture));
+        return frameCapture;
+    }
+
+    void render(Model &my3DModel, Camera &camera, std::vector<Light> &lights, int width, int height, int plainModel,
+                float renderScale = 1.0f)
+    {
+        CPU_PROFILE_SCOPE("RendererSSDO::render");
+        // the sky of the SSDO samples, filtered once the skybox is uploaded
+        if (settings.sky == SKY_PREFILTERED)
+            skyPrefilter.update(skyBoxTexture);
+        else
+            skyPrefilter.release();
+
+        // render at renderScale of the output size, then upscale
+        resizeTargets(width, height);
+        int renderWidth  = std::max(1, (int)(width * renderScale + 0.5f));
+        int renderHeight = std::max(1, (int)(height * renderScale + 0.5f));
+        glm::vec2 uvScale((float)renderWidth / (float)width, (float)renderHeight / (float)height);
+        glViewport(0, 0, renderWidth, renderHeight);
+        // and the occlusion at 1/downsample of that
+        int aoWidth  = RendererLowRes::reduce(renderWidth, targetDownsample);
+        int aoHeight = RendererLowRes::reduce(renderHeight, targetDownsample);
+        int aoTargetWidth  = RendererLowRes::reduce(width, targetDownsample);
+        int aoTargetHeight = RendererLowRes::reduce(height, targetDownsample);
+        glm::vec2 aoScale((float)aoWidth / (float)aoTargetWidth, (float)aoHeight / (float)aoTargetHeight);
+        GLuint aoDepth  = targetDownsample > 1 ? lowRes.depth : gDepth;
+        GLuint aoNormal = targetDownsample > 1 ? lowRes.normal : gNormal;
+
         // 1. geometry pass: render scene's geometry/color data into gbuffer
         // -----------------------------------------------------------------
+        GpuProfiler::instance().pass("geometry");
         glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             glm::mat4 projection = glm::perspective(glm::radians(camera.getFov()), (float)width / (float)height, 0.1f, 100.0f);
@@ -225,80 +308,97 @@ public:
             }
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+        // 1.5. reduce depth and normals for the occlusion passes, and build their depth pyramid
+        // ------------------------
+        GpuProfiler::instance().pass("hiz");
+        if (targetDownsample > 1)
+            lowRes.downsample(renderWidth, renderHeight);
+        hiZ.build(aoDepth);
+        glViewport(0, 0, aoWidth, aoHeight);
+
         // 2. generate SSDO
         // ------------------------
+        GpuProfiler::instance().pass("ssdo");
         glBindFramebuffer(GL_FRAMEBUFFER, ssdoFBO);
             glClear(GL_COLOR_BUFFER_BIT);
-            shaderSSDO.use();
+            shaderSSDO->use();
+            shaderSSDO->setVec2("uvScale", aoScale);
+            ssdoTemporal.setNoise(*shaderSSDO, settings.temporal);
             // Send kernel + rotation
-            for (unsigned int i = 0; i < 32; ++i)
-                shaderSSDO.setVec3("samples[" + std::to_string(i) + "]", ssdoKernel[i]);
-            shaderSSDO.setMat4("projection", projection);
-            shaderSSDO.setMat4("iview", glm::inverse(view));
+            shaderSSDO->setVec3Array("samples", &ssdoKernel[0], (GLsizei)ssdoKernel.size());
+            shaderSSDO->setMat4("projection", projection);
+            shaderSSDO->setMat4("invProjection", glm::inverse(projection));
+            shaderSSDO->setMat4("iview", glm::inverse(view));
+            // the sky as spherical harmonics of the skybox, or its prefiltered mip chain below
+            if (settings.sky == SKY_HARMONICS)
+                shaderSSDO->setVec3Array("skySH", registry.acquireSkySH(skyBoxTexture).coefficients, SkySH::COEFFICIENTS);
             glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, gPosition);
+            glBindTexture(GL_TEXTURE_2D, aoDepth);
             glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, gNormal);
+            glBindTexture(GL_TEXTURE_2D, aoNormal);
             glActiveTexture(GL_TEXTURE2);
             glBindTexture(GL_TEXTURE_2D, gAlbedo);
             glActiveTexture(GL_TEXTURE3);
             glBindTexture(GL_TEXTURE_2D, noiseTexture);
             glActiveTexture(GL_TEXTURE4);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, skyBoxTexture);
+            glBindTexture(GL_TEXTURE_2D, hiZ.texture);
+            glActiveTexture(GL_TEXTURE5);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, skyPrefilter.texture);
             rendererCubeQuad.renderQuad();
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
-        // 3. blur SSDO texture to remove noise
+        // 2.5. accumulate SSDO over frames, reprojected into this one
         // ------------------------------------
-        glBindFramebuffer(GL_FRAMEBUFFER, ssdoBlurFBO);
-            glClear(GL_COLOR_BUFFER_BIT);
-            shaderBlur.use();
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, ssdoColorBuffer);
-            rendererCubeQuad.renderQuad();
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GpuProfiler::instance().pass("temporal");
+        GLuint ssdoInput = ssdoColorBuffer;
+        if (settings.temporal)
+            ssdoInput = ssdoTemporal.accumulate(ssdoColorBuffer, aoDepth, aoNormal, view, projection,
+                                                aoTargetWidth, aoTargetHeight, aoWidth, aoHeight);
+        else
+            ssdoTemporal.release();
+
+        // 3. blur SSDO texture to remove noise, keeping depth and normal edges
+        // ------------------------------------
+        GpuProfiler::instance().pass("blur");
+        bilateralBlur.blur(ssdoInput, ssdoBlurIntermediate, ssdoBlurFBO, aoDepth, aoNormal, aoWidth, aoHeight);
+
 
+        // 3.5. bring the occlusion back to full resolution
+        // ------------------------------------
+        GpuProfiler::instance().pass("upsample");
+        if (targetDownsample > 1)
+            lowRes.upsample(ssdoColorBufferBlur, ssdoUpsampleFBO, renderWidth, renderHeight);
+        glViewport(0, 0, renderWidth, renderHeight);
 
         // 4. lighting pass: traditional deferred Blinn-Phong lighting with added screen-space directional occlusion
         // -----------------------------------------------------------------------------------------------------
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        GpuProfiler::instance().pass("lighting");
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+        glClear(GL_COLOR_BUFFER_BIT);
         shaderLightingPass.use();
+        shaderLightingPass.setVec2("uvScale", uvScale);
+        shaderLightingPass.setMat4("invProjection", glm::inverse(projection));
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, gPosition);
+        glBindTexture(GL_TEXTURE_2D, gDepth);
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, gNormal);
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_2D, gAlbedo);
         glActiveTexture(GL_TEXTURE3); // add extra SSDO texture to lighting pass
-        glBindTexture(GL_TEXTURE_2D, ssdoColorBufferBlur);
-        // send light relevant uniforms
-        for (unsigned int i = 0; i < lights.size(); i++)
-        {
-            glm::vec3 lightPosView = glm::vec3(camera.getView() * glm::vec4(lights[i].lightPos, 1.0));
-            shaderLightingPass.setVec3("lights[" + std::to_string(i) + "].Position", lightPosView);
-            shaderLightingPass.setVec3("lights[" + std::to_string(i) + "].Color", lights[i].lightColor);
-            // update attenuation parameters and calculate radius
-            const float linear = 0.7f;
-            const float quadratic = 1.8f;
-            shaderLightingPass.setFloat("lights[" + std::to_string(i) + "].Linear", linear);
-            shaderLightingPass.setFloat("lights[" + std::to_string(i) + "].Quadratic", quadratic);
-        }
-        // finally render quad
+        glBindTexture(GL_TEXTURE_2D, ssdoResult);
+        // cull the lights into clusters and bind their lists
+        lightClusters.update(lights, view, projection);
+        lightClusters.bind(shaderLightingPass, 5);
+        // finally render quad, keeping the g-buffer depth intact
+        glDisable(GL_DEPTH_TEST);
         rendererCubeQuad.renderQuad();
-
-        // 4.5. copy content of geometry's depth buffer to default framebuffer's depth buffer
-        // ----------------------------------------------------------------------------------
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // write to default framebuffer
-        // blit to default framebuffer. Note that this may or may not work as the internal formats of both the FBO and default framebuffer have to match.
-        // the internal formats are implementation defined. This works on all of my systems, but if it doesn't on yours you'll likely have to write to the
-        // depth buffer in another shader stage (or somehow see to match the default framebuffer's internal format with the FBO's internal format).
-        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glEnable(GL_DEPTH_TEST);
+        frameCapture.setFrame(projection, view, lights, settings, renderWidth, renderHeight);
 
         // 5. render lights on top of scene
         // --------------------------------
+        GpuProfiler::instance().pass("lights");
         shaderLightBox.use();
         shaderLightBox.setMat4("projection", projection);
         shaderLightBox.setMat4("view", view);
@@ -313,6 +413,7 @@ public:
         }
 
         // 6. draw skybox as last
+        GpuProfiler::instance().pass("skybox");
         glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
         shaderSkyBox.use();
         view = glm::mat4(glm::mat3(camera.getView())); // remove translation from the view matrix
@@ -323,5 +424,15 @@ public:
         glBindTexture(GL_TEXTURE_CUBE_MAP, skyBoxTexture);
         rendererCubeQuad.renderCube();
         glDepthFunc(GL_LESS); // set depth function back to default
+
+        // 7. upscale the internal resolution to the output
+        // --------------------------------
+        GpuProfiler::instance().pass("upscale");
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputFBO);
+        glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT,
+                          renderWidth == width && renderHeight == height ? GL_NEAREST : GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
     }
 };
\ No newline at end of file
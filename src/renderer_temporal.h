@@ -0,0 +1,126 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <string>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "utils_shader_program.h"
+#include "utils_resource_registry.h"
+#include "renderer_cube_quad.h"
+
+// Temporal accumulation of one occlusion result. Every frame the noise is rotated and shifted so
+// the kernel samples new directions, and accumulate() blends the new result into a history that is
+// reprojected from the previous view and projection. Where the previous frame saw a different
+// depth or normal the history is dropped, so disocclusions restart from the current frame.
+class RendererTemporal
+{
+public:
+    RendererTemporal(ResourceRegistry &registry, const std::string &name)
+        : name(name), current(0), width(0), height(0), valid(false), frameIndex(0), registry(registry)
+    {
+        shaderTemporal = ShaderProgram(SRC_DIR"/src/shader/common/quad.vs", SRC_DIR"/src/shader/common/temporal.fs");
+        shaderTemporal.use();
+        shaderTemporal.setInt("current", 0);
+        shaderTemporal.setInt("gDepth", 1);
+        shaderTemporal.setInt("gNormal", 2);
+        shaderTemporal.setInt("prevHistory", 3);
+        shaderTemporal.setInt("prevGuide", 4);
+    }
+
+    ~RendererTemporal()
+    {
+        release();
+    }
+
+    void release()
+    {
+        if (width == 0)
+            return;
+        registry.releaseFramebuffer(history[0].fbo);
+        registry.releaseFramebuffer(history[1].fbo);
+        width = height = 0;
+        valid = false;
+    }
+
+    // rotates and shifts the kernel noise of an occlusion program; the identity when not accumulating.
+    // set every frame, as the rotation moves on while accumulating and goes back to the identity when not
+    void setNoise(ShaderProgram &program, bool enabled)
+    {
+        // golden angle steps spread the rotations evenly over any number of frames
+        float angle = enabled ? 2.39996323f * (float)(frameIndex % 64) : 0.0f;
+        program.setVec2("noiseRotation", glm::vec2(std::cos(angle), std::sin(angle)));
+        // and the R2 sequence shifts whole texels across the largest noise tile; 64 is a multiple of every tile size
+        float shiftX = std::fmod(0.5f + 0.75487767f * (float)(frameIndex % 4096), 1.0f);
+        float shiftY = std::fmod(0.5f + 0.56984029f * (float)(frameIndex % 4096), 1.0f);
+        program.setVec2("noiseOffset", enabled ? glm::floor(glm::vec2(shiftX, shiftY) * 64.0f) : glm::vec2(0.0f));
+    }
+
+    // blends input into the history and returns the accumulated texture. targetWidth/Height is the
+    // allocated size of the occlusion targets, renderWidth/Height the part rendered this frame.
+    GLuint accumulate(GLuint input, GLuint gDepth, GLuint gNormal, const glm::mat4 &view, const glm::mat4 &projection,
+                      int targetWidth, int targetHeight, int renderWidth, int renderHeight)
+    {
+        if (targetWidth != width || targetHeight != height)
+        {
+            release();
+            history[0] = registry.acquireHistoryTarget(name + " 0", targetWidth, targetHeight);
+            history[1] = registry.acquireHistoryTarget(name + " 1", targetWidth, targetHeight);
+            width = targetWidth;
+            height = targetHeight;
+        }
+        // a different internal resolution moves every pixel, start over
+        glm::vec2 uvScale((float)renderWidth / (float)width, (float)renderHeight / (float)height);
+        if (uvScale != prevScale)
+            valid = false;
+
+        const HistoryTarget &prev = history[current];
+        current = 1 - current;
+        glBindFramebuffer(GL_FRAMEBUFFER, history[current].fbo);
+            shaderTemporal.use();
+            shaderTemporal.setMat4("iview", glm::inverse(view));
+            shaderTemporal.setMat4("invProjection", glm::inverse(projection));
+            shaderTemporal.setMat4("prevView", prevView);
+            shaderTemporal.setMat4("prevProjection", prevProjection);
+            shaderTemporal.setVec2("uvScale", uvScale);
+            shaderTemporal.setInt("resetHistory", valid ? 0 : 1);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, input);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, gDepth);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, gNormal);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, prev.value);
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_2D, prev.guide);
+            rendererCubeQuad.renderQuad();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        prevView = view;
+        prevProjection = projection;
+        prevScale = uvScale;
+        valid = true;
+        frameIndex++;
+        return history[current].value;
+    }
+
+private:
+    ShaderProgram shaderTemporal;
+    std::string name;
+
+    // ping-pong: history[current] holds the latest result
+    HistoryTarget history[2];
+    int current;
+    int width, height;
+
+    bool valid;
+    unsigned int frameIndex;
+    glm::mat4 prevView, prevProjection;
+    glm::vec2 prevScale;
+
+    RendererCubeQuad rendererCubeQuad;
+    ResourceRegistry &registry;
+};
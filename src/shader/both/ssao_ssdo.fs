@@ -0,0 +1,80 @@
+#version 330 core
+// ssao/ssao.fs and ssdo/ssdo.fs in one sample loop: every kernel sample is projected and its
+// depth read once, and both results go out through two render targets
+layout (location = 0) out vec3 AmbientOcclusion;
+layout (location = 1) out vec3 DirectionalOcclusion;
+
+in vec2 TexCoords;
+
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedo;
+uniform sampler2D texNoise;
+
+#include "../common/kernel.glsl"
+#include "../common/hiz.glsl"
+#include "../common/gbuffer.glsl"
+#include "../common/sky.glsl"
+
+uniform mat4 projection;
+uniform mat4 iview; // inverse of view to world-space
+
+void main()
+{
+    // this pixel's own texel, which also lines up when the pass runs on a downsampled g-buffer
+    vec3 fragPos = viewPosition(TexCoords / uvScale, texelFetch(gDepth, ivec2(gl_FragCoord.xy), 0).r);
+    vec3 normal = decodeNormal(texelFetch(gNormal, ivec2(gl_FragCoord.xy), 0).rg);
+    vec3 randomVec = normalize(kernelNoise(texNoise));
+    // create TBN change-of-basis matrix: from tangent-space to view-space
+    vec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
+    vec3 bitangent = cross(normal, tangent);
+    mat3 TBN = mat3(tangent, bitangent, normal);
+    // and on to world space for the sky
+    mat3 worldTBN = mat3(iview) * TBN;
+    float occlusion = 0.0;
+    vec3 directLight = vec3(0.0, 0.0, 0.0);
+    vec3 indirectLight = vec3(0.0, 0.0, 0.0);
+    for(int i = 0; i < kernelSize; ++i)
+    {
+        // get sample position
+        vec3 samplePos = TBN * samples[i]; // from tangent to view-space
+        samplePos = fragPos + samplePos * radius;
+
+        // project sample position (to sample texture) (to get position on screen/texture)
+        vec4 offset = vec4(samplePos, 1.0);
+        offset = projection * offset; // from view to clip-space
+        offset.xyz /= offset.w; // perspective divide
+        offset.xyz = offset.xyz * 0.5 + 0.5; // transform to range 0.0 - 1.0
+        vec2 sampleScreen = offset.xy;
+        offset.xy *= uvScale; // and into the rendered part of the targets
+
+        // get sample depth
+        // get depth value of kernel sample: the farthest surface under it decides occlusion, and the
+        // nearest one how far in front of the pixel an occluder may be
+        vec2 sampleRange = -hiZRange(TexCoords, offset.xy);
+        float sampleDepth = sampleRange.y;
+
+        // range check & accumulate
+        float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleRange.x));
+        if (sampleDepth >= samplePos.z)
+        {
+            occlusion += rangeCheck;
+            // the occluder's surface is only needed for the indirect bounce
+            vec3 samplePos1 = viewPosition(sampleScreen, textureLod(gDepth, offset.xy, 0.0).r);
+            vec3 sampleNormal = decodeNormal(textureLod(gNormal, offset.xy, 0.0).rg);
+            vec3 sampleColor = textureLod(gAlbedo, offset.xy, 0.0).xyz;
+            indirectLight += rangeCheck * max(dot(sampleNormal, normalize(fragPos - samplePos1)), 0.0) * sampleColor;
+        }
+        else
+        {
+            vec3 skyboxColor = skyRadiance(normalize(worldTBN * samples[i]));
+            directLight += rangeCheck * skyboxColor * dot(normal, normalize(samplePos - fragPos));
+        }
+    }
+    occlusion = 1.0 - (occlusion / float(kernelSize));
+    directLight = 0.5 * (directLight / float(kernelSize));
+    indirectLight = 5.0 * (indirectLight / float(kernelSize));
+
+    AmbientOcclusion = vec3(occlusion, 0.0, 0.0);
+    DirectionalOcclusion = directLight + indirectLight;
+}
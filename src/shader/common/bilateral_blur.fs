@@ -0,0 +1,67 @@
+#version 330 core
+layout (location = 0) out vec3 FragColor;
+
+uniform sampler2D blurInput;
+// BLUR_PAIR blurs a second input into a second target with the same weights
+#ifdef BLUR_PAIR
+layout (location = 1) out vec3 FragColor2;
+uniform sampler2D blurInput2;
+#endif
+uniform sampler2D gDepth;     // guides at the resolution of the input
+uniform sampler2D gNormal;
+
+uniform ivec2 direction;      // (1, 0) for the horizontal pass, (0, 1) for the vertical one
+uniform ivec2 renderSize;     // rendered part of the input
+
+// taps on each side of the center; override through ShaderProgram defines
+#ifndef BLUR_RADIUS
+#define BLUR_RADIUS 4
+#endif
+// how fast the weight falls off with relative depth difference
+#ifndef BLUR_DEPTH_SHARPNESS
+#define BLUR_DEPTH_SHARPNESS 50.0
+#endif
+// exponent on the normal similarity
+#ifndef BLUR_NORMAL_SHARPNESS
+#define BLUR_NORMAL_SHARPNESS 8.0
+#endif
+
+#include "gbuffer.glsl"
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = max(texelFetch(gDepth, pixel, 0).r, 1e-3);
+    vec3 normal = decodeNormal(texelFetch(gNormal, pixel, 0).rg);
+
+    // gaussian along one axis, damped where depth or normal differ from the center so
+    // occlusion doesn't bleed across edges
+    const float sigma = (float(BLUR_RADIUS) + 1.0) * 0.5;
+    vec3 result = texelFetch(blurInput, pixel, 0).rgb;
+#ifdef BLUR_PAIR
+    vec3 result2 = texelFetch(blurInput2, pixel, 0).rgb;
+#endif
+    float total = 1.0;
+    for (int i = 1; i <= BLUR_RADIUS; ++i)
+    {
+        float spatial = exp(-float(i * i) / (2.0 * sigma * sigma));
+        for (int side = -1; side <= 1; side += 2)
+        {
+            ivec2 texel = clamp(pixel + direction * (i * side), ivec2(0), renderSize - 1);
+            float sampleDepth = texelFetch(gDepth, texel, 0).r;
+            vec3 sampleNormal = decodeNormal(texelFetch(gNormal, texel, 0).rg);
+            float depthWeight = exp(-abs(sampleDepth - depth) / depth * BLUR_DEPTH_SHARPNESS);
+            float normalWeight = pow(max(dot(normal, sampleNormal), 0.0), BLUR_NORMAL_SHARPNESS);
+            float weight = spatial * depthWeight * normalWeight;
+            result += texelFetch(blurInput, texel, 0).rgb * weight;
+#ifdef BLUR_PAIR
+            result2 += texelFetch(blurInput2, texel, 0).rgb * weight;
+#endif
+            total += weight;
+        }
+    }
+    FragColor = result / total;
+#ifdef BLUR_PAIR
+    FragColor2 = result2 / total;
+#endif
+}
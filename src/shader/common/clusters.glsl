@@ -0,0 +1,14 @@
+// clustered light lists built by RendererLightClusters
+uniform samplerBuffer lightData;       // per light: view-space position + linear, color + quadratic
+uniform usamplerBuffer clusterGrid;    // per cluster: offset into clusterLights, light count
+uniform usamplerBuffer clusterLights;  // light indices of all clusters, back to back
+uniform ivec3 clusterSize;             // clusters along x, y and depth
+uniform vec2 clusterSlicing;           // depth slice = log(depth) * x + y
+
+// cluster of a pixel at screen coordinates in [0, 1] over the rendered part and a linear depth
+int clusterIndex(vec2 screen, float depth)
+{
+    ivec2 tile = clamp(ivec2(screen * vec2(clusterSize.xy)), ivec2(0), clusterSize.xy - 1);
+    int slice = clamp(int(floor(log(max(depth, 1e-4)) * clusterSlicing.x + clusterSlicing.y)), 0, clusterSize.z - 1);
+    return tile.x + clusterSize.x * (tile.y + clusterSize.y * slice);
+}
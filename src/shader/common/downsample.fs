@@ -0,0 +1,37 @@
+#version 330 core
+layout (location = 0) out float lowDepth;
+layout (location = 1) out vec2 lowNormal;
+
+// g-buffer depth and packed normal, written in the same layout (see gbuffer.glsl)
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+
+uniform int factor;        // full-res texels per low-res texel along each axis
+uniform ivec2 renderSize;  // rendered part of the g-buffer
+
+void main()
+{
+    // keep one real surface sample per block instead of averaging positions and normals into one that
+    // doesn't exist; alternating nearest and farthest in a checkerboard keeps both sides of depth edges
+    ivec2 low = ivec2(gl_FragCoord.xy);
+    bool nearest = ((low.x + low.y) & 1) == 0;
+    ivec2 best = min(low * factor, renderSize - 1);
+    float bestDepth = nearest ? 1e20 : -1.0;
+    for (int y = 0; y < factor; ++y)
+    {
+        for (int x = 0; x < factor; ++x)
+        {
+            ivec2 texel = min(low * factor + ivec2(x, y), renderSize - 1);
+            float depth = texelFetch(gDepth, texel, 0).r;
+            if (depth <= 0.0)
+                depth = 1e19; // nothing rendered here, treat as far away
+            if (nearest ? depth < bestDepth : depth > bestDepth)
+            {
+                best = texel;
+                bestDepth = depth;
+            }
+        }
+    }
+    lowDepth = texelFetch(gDepth, best, 0).r;
+    lowNormal = texelFetch(gNormal, best, 0).rg;
+}
@@ -0,0 +1,38 @@
+// compact g-buffer layout shared by every pass that writes or reads it:
+//   gDepth   R32F   linear view depth, 0 where nothing was rendered
+//   gNormal  RG16   octahedral view-space normal
+//   gAlbedo  RGBA8  diffuse color, specular intensity in alpha
+// view-space positions are rebuilt from the depth with the inverse projection
+
+// inverse of the projection the g-buffer was rendered with
+uniform mat4 invProjection;
+
+vec2 octWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// unit normal to [0, 1]^2
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.0 ? n.xy : octWrap(n.xy);
+    return e * 0.5 + 0.5;
+}
+
+vec3 decodeNormal(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = octWrap(n.xy);
+    return normalize(n);
+}
+
+// view-space position at screen coordinates in [0, 1] over the rendered part and a linear depth
+vec3 viewPosition(vec2 screen, float depth)
+{
+    vec4 nearPoint = invProjection * vec4(screen * 2.0 - 1.0, -1.0, 1.0);
+    vec3 ray = nearPoint.xyz / nearPoint.w;
+    return ray * (depth / -ray.z);
+}
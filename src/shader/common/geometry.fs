@@ -1,6 +1,6 @@
 #version 330 core
-layout (location = 0) out vec3 gPosition;
-layout (location = 1) out vec3 gNormal;
+layout (location = 0) out float gDepth;
+layout (location = 1) out vec2 gNormal;
 layout (location = 2) out vec4 gAlbedo;
 
 in vec2 TexCoords;
@@ -10,12 +10,14 @@ in vec3 Normal;
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
 
+#include "gbuffer.glsl"
+
 void main()
 {
-    // store the fragment position vector in the first gbuffer texture
-    gPosition = FragPos;
+    // store linear depth, the position is rebuilt from it
+    gDepth = -FragPos.z;
     // also store the per-fragment normals into the gbuffer
-    gNormal = normalize(Normal);
+    gNormal = encodeNormal(normalize(Normal));
     // and the diffuse per-fragment color
     gAlbedo.rgb = texture(texture_diffuse1, TexCoords).rgb;
     // store specular intensity in gAlbedo's alpha component
@@ -0,0 +1,40 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec3 FragPos;
+out vec2 TexCoords;
+out vec3 Normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// vertex layout decoding (see VertexEncoder)
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+uniform bool octNormals;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main()
+{
+    vec3 position = positionOffset + aPos * positionScale;
+    vec3 normal = octNormals ? octDecode(aNormal.xy) : aNormal;
+
+    vec4 viewPos = view * model * vec4(position, 1.0);
+    FragPos = viewPos.xyz;
+    TexCoords = aTexCoords;
+
+    mat3 normalMatrix = transpose(inverse(mat3(view * model)));
+    Normal = normalMatrix * normal;
+
+    gl_Position = projection * viewPos;
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+// min/max linear depth pyramid of the occlusion input, built by RendererHiZ
+uniform sampler2D hiZ;
+
+// samples within 2^HIZ_LOG_OFFSET texels read full detail, farther ones a coarser level, which
+// keeps the footprint of one pixel's samples small enough to stay in the texture cache
+#ifndef HIZ_LOG_OFFSET
+#define HIZ_LOG_OFFSET 3.0
+#endif
+#ifndef HIZ_MAX_LEVEL
+#define HIZ_MAX_LEVEL 5.0
+#endif
+
+float hiZLevel(vec2 fromCoords, vec2 toCoords)
+{
+    float texels = length((toCoords - fromCoords) * vec2(textureSize(hiZ, 0)));
+    return clamp(floor(log2(max(texels, 1.0))) - HIZ_LOG_OFFSET, 0.0, HIZ_MAX_LEVEL);
+}
+
+// nearest (x) and farthest (y) linear depth around coords, at the level for a sample that far from
+// the pixel at center. At level 0 both are the depth itself; at coarser levels one near texel would
+// stand for the whole footprint, so whether a sample is occluded is tested against the farthest
+// surface, which only counts it when all of the footprint is in front of it
+vec2 hiZRange(vec2 center, vec2 coords)
+{
+    return textureLod(hiZ, coords, hiZLevel(center, coords)).rg;
+}
@@ -0,0 +1,13 @@
+#version 330 core
+out vec2 FragColor;
+
+uniform sampler2D gDepth;
+
+void main()
+{
+    float depth = texelFetch(gDepth, ivec2(gl_FragCoord.xy), 0).r;
+    // nothing rendered here: as far as the pyramid is concerned it is infinitely far away
+    if (depth <= 0.0)
+        depth = 10000.0;
+    FragColor = vec2(depth, depth);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+out vec2 FragColor;
+
+// only the level below the one being written is visible, see RendererHiZ::build
+uniform sampler2D hiZ;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 prevSize = textureSize(hiZ, 0);
+    ivec2 size = max(prevSize / 2, ivec2(1));
+    // a texel covers 2x2 of the level below, and the last row/column also takes the odd one out
+    ivec2 extent = ivec2(2) + ivec2(equal(pixel, size - 1)) * (prevSize & 1);
+    vec2 range = vec2(1e20, 0.0);
+    for (int y = 0; y < extent.y; ++y)
+    {
+        for (int x = 0; x < extent.x; ++x)
+        {
+            vec2 texel = texelFetch(hiZ, min(pixel * 2 + ivec2(x, y), prevSize - 1), 0).rg;
+            range = vec2(min(range.x, texel.x), max(range.y, texel.y));
+        }
+    }
+    FragColor = range;
+}
@@ -0,0 +1,31 @@
+// sample kernel parameters shared by the occlusion passes; override through ShaderProgram defines
+#ifndef KERNEL_SIZE
+#define KERNEL_SIZE 32
+#endif
+#ifndef RADIUS
+#define RADIUS 0.5
+#endif
+#ifndef NOISE_SIZE
+#define NOISE_SIZE 4.0
+#endif
+
+uniform vec3 samples[KERNEL_SIZE];
+
+// parameters
+const int kernelSize = KERNEL_SIZE;
+const float radius = RADIUS;
+
+// part of the render targets covered by the current internal resolution, see quad.vs
+uniform vec2 uvScale = vec2(1.0);
+
+// per-frame rotation (cos, sin) and tile offset of the noise, so temporal accumulation sees new directions
+uniform vec2 noiseRotation = vec2(1.0, 0.0);
+uniform vec2 noiseOffset = vec2(0.0);
+
+// tile noise texture over screen: one noise texel per pixel, whatever the resolution
+vec3 kernelNoise(sampler2D texNoise)
+{
+    vec3 noise = texture(texNoise, (gl_FragCoord.xy + noiseOffset) / NOISE_SIZE).xyz;
+    return vec3(noise.x * noiseRotation.x - noise.y * noiseRotation.y,
+                noise.x * noiseRotation.y + noise.y * noiseRotation.x, noise.z);
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedo;
+#ifdef USE_SSAO
+uniform sampler2D ssao;
+#endif
+#ifdef USE_SSDO
+uniform sampler2D ssdo;
+#endif
+
+#include "gbuffer.glsl"
+#include "clusters.glsl"
+
+// part of the render targets covered by the current internal resolution, see quad.vs
+uniform vec2 uvScale = vec2(1.0);
+
+void main()
+{
+    // retrieve data from gbuffer
+    vec2 screen = TexCoords / uvScale;
+    float depth = texture(gDepth, TexCoords).r;
+    vec3 FragPos = viewPosition(screen, depth);
+    vec3 Normal = decodeNormal(texture(gNormal, TexCoords).rg);
+    vec4 AlbedoSpec = texture(gAlbedo, TexCoords);
+    vec3 Diffuse = AlbedoSpec.rgb;
+    float Specular = AlbedoSpec.a;
+#ifdef USE_SSAO
+    float AmbientOcclusion = texture(ssao, TexCoords).r;
+#else
+    float AmbientOcclusion = 1.0;
+#endif
+#ifdef USE_SSDO
+    vec3 DirectionalOcclusion = texture(ssdo, TexCoords).rgb;
+#else
+    vec3 DirectionalOcclusion = vec3(0.0);
+#endif
+
+    // then calculate lighting as usual
+    vec3 lighting  = vec3(Diffuse * 0.5 * AmbientOcclusion + DirectionalOcclusion); // hard-coded ambient and directional component
+    vec3 viewDir  = normalize(-FragPos); // viewpos is (0.0.0)
+    // only the lights whose range reaches this pixel's cluster
+    uvec2 cluster = texelFetch(clusterGrid, clusterIndex(screen, depth)).rg;
+    for(uint i = 0u; i < cluster.y; ++i)
+    {
+        int light = int(texelFetch(clusterLights, int(cluster.x + i)).r);
+        vec4 positionLinear = texelFetch(lightData, 2 * light);
+        vec4 colorQuadratic = texelFetch(lightData, 2 * light + 1);
+        // diffuse
+        vec3 lightDir = normalize(positionLinear.xyz - FragPos);
+        vec3 diffuse = max(dot(Normal, lightDir), 0.0) * Diffuse * colorQuadratic.rgb;
+        // specular
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        float spec = pow(max(dot(Normal, halfwayDir), 0.0), 16.0);
+        vec3 specular = colorQuadratic.rgb * spec * Specular;
+        // attenuation
+        float distance = length(positionLinear.xyz - FragPos);
+        float attenuation = 1.0 / (1.0 + positionLinear.w * distance + colorQuadratic.w * distance * distance);
+        diffuse *= attenuation;
+        specular *= attenuation;
+        lighting += diffuse + specular;
+    }
+    FragColor = vec4(lighting, 1.0);
+}
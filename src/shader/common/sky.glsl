@@ -0,0 +1,34 @@
+// radiance of the skybox for SSDO's unoccluded samples, either from the prefiltered environment
+// of RendererSkyPrefilter (SKY_PREFILTERED) or as second-order spherical harmonics projected on
+// the CPU by utils_sky_sh.h. Needs common/kernel.glsl for the kernel size.
+#ifdef SKY_PREFILTERED
+uniform samplerCube skyEnvironment;
+
+// world-space unit direction
+vec3 skyRadiance(vec3 dir)
+{
+    // a kernel sample stands for 2*pi/kernelSize sr of the hemisphere; the level whose lobe
+    // spans that much is 0.5*log2 of it over four level 0 texels of 4*pi/(6*size^2) sr
+    float size = float(textureSize(skyEnvironment, 0).x);
+    float lod = 0.5 * log2(0.75 * size * size / float(kernelSize));
+    return textureLod(skyEnvironment, dir, lod).rgb;
+}
+#else
+uniform vec3 skySH[9];
+
+// world-space unit direction
+vec3 skyRadiance(vec3 dir)
+{
+    vec3 radiance = skySH[0] * 0.282095
+                  + skySH[1] * (0.488603 * dir.y)
+                  + skySH[2] * (0.488603 * dir.z)
+                  + skySH[3] * (0.488603 * dir.x)
+                  + skySH[4] * (1.092548 * dir.x * dir.y)
+                  + skySH[5] * (1.092548 * dir.y * dir.z)
+                  + skySH[6] * (0.315392 * (3.0 * dir.z * dir.z - 1.0))
+                  + skySH[7] * (1.092548 * dir.x * dir.z)
+                  + skySH[8] * (0.546274 * (dir.x * dir.x - dir.y * dir.y));
+    // the truncated series rings below zero opposite bright spots
+    return max(radiance, vec3(0.0));
+}
+#endif
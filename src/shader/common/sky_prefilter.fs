@@ -0,0 +1,73 @@
+#version 330 core
+out vec3 FragColor;
+
+in vec2 TexCoords;
+
+// the skybox for level 0, then only the level above the one being written, see RendererSkyPrefilter
+uniform samplerCube environment;
+uniform int face;
+// level 0: source texels per written texel along each axis, box filtered
+uniform int footprint;
+// other levels: cosine power of the lobe the level above is convolved with
+uniform float exponent;
+
+const int LOBE_SAMPLES = 64;
+const float PI = 3.14159265359;
+
+// direction through face coordinates in [0, 1], in the face layout of the GL spec
+vec3 faceDirection(vec2 st)
+{
+    st = st * 2.0 - 1.0;
+    if (face == 0) return vec3(1.0, -st.y, -st.x);
+    if (face == 1) return vec3(-1.0, -st.y, st.x);
+    if (face == 2) return vec3(st.x, 1.0, st.y);
+    if (face == 3) return vec3(st.x, -1.0, -st.y);
+    if (face == 4) return vec3(st.x, -st.y, 1.0);
+    return vec3(-st.x, -st.y, -1.0);
+}
+
+// Hammersley point i of LOBE_SAMPLES
+vec2 hammersley(uint i)
+{
+    uint bits = i;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return vec2(float(i) / float(LOBE_SAMPLES), float(bits) * 2.3283064365386963e-10);
+}
+
+void main()
+{
+    vec2 size = vec2(textureSize(environment, 0));
+    if (footprint > 0)
+    {
+        // average the source texels under this one
+        vec2 texel = gl_FragCoord.xy - 0.5;
+        vec2 written = size / float(footprint);
+        vec3 sum = vec3(0.0);
+        for (int y = 0; y < footprint; ++y)
+            for (int x = 0; x < footprint; ++x)
+                sum += textureLod(environment, faceDirection((texel + (vec2(x, y) + 0.5) / float(footprint)) / written), 0.0).rgb;
+        FragColor = sum / float(footprint * footprint);
+        return;
+    }
+
+    // importance sample the lobe around this texel's direction, each sample weighing the same
+    vec3 normal = normalize(faceDirection(TexCoords));
+    vec3 up = abs(normal.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, normal));
+    vec3 bitangent = cross(normal, tangent);
+    vec3 sum = vec3(0.0);
+    for (int i = 0; i < LOBE_SAMPLES; ++i)
+    {
+        vec2 xi = hammersley(uint(i));
+        float cosTheta = pow(1.0 - xi.y, 1.0 / (exponent + 1.0));
+        float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+        float phi = 2.0 * PI * xi.x;
+        vec3 direction = tangent * (sinTheta * cos(phi)) + bitangent * (sinTheta * sin(phi)) + normal * cosTheta;
+        sum += textureLod(environment, direction, 0.0).rgb;
+    }
+    FragColor = sum / float(LOBE_SAMPLES);
+}
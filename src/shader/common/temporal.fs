@@ -0,0 +1,58 @@
+#version 330 core
+layout (location = 0) out vec4 history; // accumulated value, frames accumulated in alpha
+layout (location = 1) out vec4 guide;   // world-space normal, linear depth in alpha
+
+uniform sampler2D current;      // this frame's occlusion
+uniform sampler2D gDepth;       // guides at the resolution of the occlusion
+uniform sampler2D gNormal;
+uniform sampler2D prevHistory;
+uniform sampler2D prevGuide;
+
+uniform mat4 iview;             // current view to world-space
+uniform mat4 prevView;
+uniform mat4 prevProjection;
+uniform vec2 uvScale;           // rendered part of the targets, the same last frame
+uniform bool resetHistory;
+
+// frames the running average converges to; more is smoother but slower to follow changes
+#ifndef MAX_HISTORY
+#define MAX_HISTORY 16.0
+#endif
+
+#include "gbuffer.glsl"
+
+in vec2 TexCoords;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    vec3 worldNormal = normalize(mat3(iview) * decodeNormal(texelFetch(gNormal, pixel, 0).rg));
+    vec3 value = texelFetch(current, pixel, 0).rgb;
+    guide = vec4(worldNormal, depth);
+
+    // where this surface was on screen last frame
+    vec4 world = iview * vec4(viewPosition(TexCoords / uvScale, depth), 1.0);
+    vec4 prevClip = prevProjection * prevView * world;
+    vec2 prevUV = prevClip.xy / prevClip.w * 0.5 + 0.5;
+    float prevDepth = -(prevView * world).z;
+
+    float frames = 0.0;
+    vec3 accumulated = value;
+    bool onScreen = all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThan(prevUV, vec2(1.0)));
+    if (!resetHistory && depth > 0.0 && prevClip.w > 0.0 && onScreen)
+    {
+        vec2 uv = prevUV * uvScale;
+        vec4 prevSurface = texture(prevGuide, uv);
+        // disoccluded: last frame saw another surface there
+        bool sameDepth = abs(prevSurface.w - prevDepth) < 0.05 * prevDepth;
+        bool sameNormal = dot(prevSurface.xyz, worldNormal) > 0.9;
+        if (sameDepth && sameNormal)
+        {
+            vec4 prev = texture(prevHistory, uv);
+            frames = min(prev.a, MAX_HISTORY - 1.0);
+            accumulated = mix(prev.rgb, value, 1.0 / (frames + 1.0));
+        }
+    }
+    history = vec4(accumulated, frames + 1.0);
+}
@@ -0,0 +1,41 @@
+#version 330 core
+out vec3 FragColor;
+
+uniform sampler2D gDepth;      // full-res guides
+uniform sampler2D gNormal;
+uniform sampler2D lowDepth;    // the guides the low-res pass saw
+uniform sampler2D lowNormal;
+uniform sampler2D lowInput;    // low-res occlusion to bring back
+
+#include "gbuffer.glsl"
+
+uniform int factor;
+uniform ivec2 lowSize;         // rendered part of the low-res targets
+
+void main()
+{
+    float depth = max(texelFetch(gDepth, ivec2(gl_FragCoord.xy), 0).r, 1e-3);
+    vec3 normal = decodeNormal(texelFetch(gNormal, ivec2(gl_FragCoord.xy), 0).rg);
+
+    // the 2x2 low-res texels around this pixel, weighted bilinearly and by how well their
+    // depth and normal match this pixel's, so occlusion doesn't leak across edges
+    vec2 lowCoord = gl_FragCoord.xy / float(factor) - 0.5;
+    ivec2 base = ivec2(floor(lowCoord));
+    vec2 f = lowCoord - vec2(base);
+    vec3 result = vec3(0.0);
+    float total = 0.0;
+    for (int y = 0; y < 2; ++y)
+    {
+        for (int x = 0; x < 2; ++x)
+        {
+            ivec2 texel = clamp(base + ivec2(x, y), ivec2(0), lowSize - 1);
+            float bilinear = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+            float depthWeight = 1.0 / (1e-3 + abs(depth - texelFetch(lowDepth, texel, 0).r) / depth);
+            float normalWeight = pow(max(dot(normal, decodeNormal(texelFetch(lowNormal, texel, 0).rg)), 0.0), 16.0);
+            float weight = max(bilinear * depthWeight * normalWeight, 1e-5);
+            result += texelFetch(lowInput, texel, 0).rgb * weight;
+            total += weight;
+        }
+    }
+    FragColor = result / total;
+}
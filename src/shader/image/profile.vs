@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+
+// left, bottom, right, top in normalized device coordinates
+uniform vec4 rect;
+
+void main()
+{
+	gl_Position = vec4(mix(rect.xy, rect.zw, aCorner), 0.0, 1.0);
+}
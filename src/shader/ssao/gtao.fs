@@ -0,0 +1,94 @@
+#version 330 core
+out vec3 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+uniform sampler2D texNoise;
+
+#include "../common/kernel.glsl"
+#include "../common/hiz.glsl"
+#include "../common/gbuffer.glsl"
+
+// screen-space directions, each marched both ways, and depth samples per direction and side
+#ifndef HORIZON_SLICES
+#define HORIZON_SLICES 2
+#endif
+#ifndef HORIZON_STEPS
+#define HORIZON_STEPS 4
+#endif
+
+uniform mat4 projection;
+
+const float PI = 3.14159265;
+const float HALF_PI = 1.57079633;
+
+// view-space position of the surface at a screen position, from the depth pyramid; the farthest of a
+// coarse texel's footprint, so one near texel does not raise the horizon over all of it
+vec3 horizonPosition(vec2 screen)
+{
+    return viewPosition(screen, hiZRange(TexCoords, screen * uvScale).y);
+}
+
+// cosine-weighted visibility of the arc between the view vector and horizon angle h, for normal angle n
+float integrateArc(float h, float n)
+{
+    return 0.25 * (cos(n) + 2.0 * h * sin(n) - cos(2.0 * h - n));
+}
+
+void main()
+{
+    // this pixel's own texel, which also lines up when the pass runs on a downsampled g-buffer
+    vec3 fragPos = viewPosition(TexCoords / uvScale, texelFetch(gDepth, ivec2(gl_FragCoord.xy), 0).r);
+    vec3 normal = decodeNormal(texelFetch(gNormal, ivec2(gl_FragCoord.xy), 0).rg);
+    vec3 viewDir = normalize(-fragPos);
+    // slice and step jitter from the same per-pixel noise the hemisphere kernel is rotated by
+    vec2 jitter = fract(kernelNoise(texNoise).xy * 0.5 + 0.5);
+
+    // the radius projected to screen, in [0, 1] screen coordinates
+    vec2 screenRadius = radius * vec2(projection[0][0], projection[1][1]) * 0.5 / max(-fragPos.z, 1e-3);
+    vec2 screenPos = TexCoords / uvScale;
+
+    float visibility = 0.0;
+    for (int slice = 0; slice < HORIZON_SLICES; ++slice)
+    {
+        // the slice plane through the view vector and a screen direction
+        float phi = (float(slice) + jitter.x) * PI / float(HORIZON_SLICES);
+        vec2 omega = vec2(cos(phi), sin(phi));
+        vec3 direction = vec3(omega, 0.0);
+        vec3 orthoDirection = direction - dot(direction, viewDir) * viewDir;
+        vec3 axis = normalize(cross(direction, viewDir));
+        vec3 projectedNormal = normal - axis * dot(normal, axis);
+        float projectedLength = length(projectedNormal);
+        float cosNormal = clamp(dot(projectedNormal, viewDir) / max(projectedLength, 1e-4), -1.0, 1.0);
+        float n = sign(dot(orthoDirection, projectedNormal)) * acos(cosNormal);
+
+        // highest horizon on each side, starting from the tangent plane
+        float horizonCos0 = cos(n + HALF_PI);
+        float horizonCos1 = cos(n - HALF_PI);
+        for (int step = 0; step < HORIZON_STEPS; ++step)
+        {
+            float s = (float(step) + jitter.y) / float(HORIZON_STEPS);
+            vec2 offset = omega * screenRadius * (s * s);
+            vec3 delta0 = horizonPosition(screenPos + offset) - fragPos;
+            vec3 delta1 = horizonPosition(screenPos - offset) - fragPos;
+            float length0 = length(delta0);
+            float length1 = length(delta1);
+            // samples beyond the radius fade back to the tangent plane
+            float weight0 = clamp((radius - length0) / (0.4 * radius), 0.0, 1.0);
+            float weight1 = clamp((radius - length1) / (0.4 * radius), 0.0, 1.0);
+            horizonCos0 = max(horizonCos0, mix(cos(n + HALF_PI), dot(delta0, viewDir) / max(length0, 1e-4), weight0));
+            horizonCos1 = max(horizonCos1, mix(cos(n - HALF_PI), dot(delta1, viewDir) / max(length1, 1e-4), weight1));
+        }
+
+        float h0 = -acos(horizonCos1);
+        float h1 = acos(horizonCos0);
+        h0 = n + max(h0 - n, -HALF_PI);
+        h1 = n + min(h1 - n, HALF_PI);
+        visibility += projectedLength * (integrateArc(h0, n) + integrateArc(h1, n));
+    }
+    visibility /= float(HORIZON_SLICES);
+
+    FragColor = vec3(visibility, 0.0, 0.0);
+}
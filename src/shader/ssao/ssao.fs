@@ -3,27 +3,23 @@ out vec3 FragColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D gPosition;
+uniform sampler2D gDepth;
 uniform sampler2D gNormal;
 uniform sampler2D texNoise;
 
-uniform vec3 samples[32];
-
-// parameters
-int kernelSize = 32;
-float radius = 0.5;
-
-// tile noise texture over screen based on screen dimensions divided by noise size
-const vec2 noiseScale = vec2(800.0/4.0, 800.0/4.0);
+#include "../common/kernel.glsl"
+#include "../common/hiz.glsl"
+#include "../common/gbuffer.glsl"
 
 uniform mat4 projection;
 
 void main()
 {
     // get input for SSAO algorithm
-    vec3 fragPos = texture(gPosition, TexCoords).xyz;
-    vec3 normal = normalize(texture(gNormal, TexCoords).rgb);
-    vec3 randomVec = normalize(texture(texNoise, TexCoords * noiseScale).xyz);
+    // this pixel's own texel, which also lines up when the pass runs on a downsampled g-buffer
+    vec3 fragPos = viewPosition(TexCoords / uvScale, texelFetch(gDepth, ivec2(gl_FragCoord.xy), 0).r);
+    vec3 normal = decodeNormal(texelFetch(gNormal, ivec2(gl_FragCoord.xy), 0).rg);
+    vec3 randomVec = normalize(kernelNoise(texNoise));
     // create TBN change-of-basis matrix: from tangent-space to view-space
     vec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
     vec3 bitangent = cross(normal, tangent);
@@ -41,15 +37,19 @@ void main()
         offset = projection * offset; // from view to clip-space
         offset.xyz /= offset.w; // perspective divide
         offset.xyz = offset.xyz * 0.5 + 0.5; // transform to range 0.0 - 1.0
+        offset.xy *= uvScale; // and into the rendered part of the targets
 
         // get sample depth
-        float sampleDepth = -texture(gPosition, offset.xy).w; // get depth value of kernel sample
+        // get depth value of kernel sample: the farthest surface under it decides occlusion, and the
+        // nearest one how far in front of the pixel an occluder may be
+        vec2 sampleRange = -hiZRange(TexCoords, offset.xy);
+        float sampleDepth = sampleRange.y;
 
         // range check & accumulate
-        float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
+        float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleRange.x));
         occlusion += (sampleDepth >= samplePos.z ? 1.0 : 0.0) * rangeCheck;
     }
-    occlusion = 1.0 - (occlusion / kernelSize);
+    occlusion = 1.0 - (occlusion / float(kernelSize));
 
     FragColor = vec3(occlusion, 0.0, 0.0);
 }
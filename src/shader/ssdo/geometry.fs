@@ -1,33 +0,0 @@
-#version 330 core
-layout (location = 0) out vec4 gPosition;
-layout (location = 1) out vec3 gNormal;
-layout (location = 2) out vec4 gAlbedo;
-
-in vec2 TexCoords;
-in vec3 FragPos;
-in vec3 Normal;
-
-uniform sampler2D texture_diffuse1;
-uniform sampler2D texture_specular1;
-
-const float NEAR = 0.1; // Projection matrix's near plane distance
-const float FAR = 100.0f; // Projection matrix's far plane distance
-float LinearizeDepth(float depth)
-{
-    float z = depth * 2.0 - 1.0; // Back to NDC
-    return (2.0 * NEAR * FAR) / (FAR + NEAR - z * (FAR - NEAR));
-}
-
-void main()
-{
-    // store the fragment position vector in the first gbuffer texture
-    gPosition.xyz = FragPos;
-    // store linear depth into gPositionDepth's alpha component
-    gPosition.a = LinearizeDepth(gl_FragCoord.z);
-    // also store the per-fragment normals into the gbuffer
-    gNormal = normalize(Normal);
-    // and the diffuse per-fragment color
-    gAlbedo.rgb = texture(texture_diffuse1, TexCoords).rgb;
-    // store specular intensity in gAlbedo's alpha component
-    gAlbedo.a = texture(texture_specular1, TexCoords).r;
-}
\ No newline at end of file
@@ -3,20 +3,15 @@ out vec3 FragColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D gPosition;
+uniform sampler2D gDepth;
 uniform sampler2D gNormal;
 uniform sampler2D gAlbedo;
 uniform sampler2D texNoise;
-uniform samplerCube skybox;
 
-uniform vec3 samples[32];
-
-// parameters
-int kernelSize = 32;
-float radius = 0.5;
-
-// tile noise texture over screen based on screen dimensions divided by noise size
-const vec2 noiseScale = vec2(800.0/4.0, 800.0/4.0);
+#include "../common/kernel.glsl"
+#include "../common/hiz.glsl"
+#include "../common/gbuffer.glsl"
+#include "../common/sky.glsl"
 
 uniform mat4 projection;
 uniform mat4 iview; // inverse of view to world-space
@@ -24,13 +19,16 @@ uniform mat4 iview; // inverse of view to world-space
 void main()
 {
     // get input for SSDO algorithm
-    vec3 fragPos = texture(gPosition, TexCoords).xyz;
-    vec3 normal = normalize(texture(gNormal, TexCoords).rgb);
-    vec3 randomVec = normalize(texture(texNoise, TexCoords * noiseScale).xyz);
+    // this pixel's own texel, which also lines up when the pass runs on a downsampled g-buffer
+    vec3 fragPos = viewPosition(TexCoords / uvScale, texelFetch(gDepth, ivec2(gl_FragCoord.xy), 0).r);
+    vec3 normal = decodeNormal(texelFetch(gNormal, ivec2(gl_FragCoord.xy), 0).rg);
+    vec3 randomVec = normalize(kernelNoise(texNoise));
     // create TBN change-of-basis matrix: from tangent-space to view-space
     vec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
     vec3 bitangent = cross(normal, tangent);
     mat3 TBN = mat3(tangent, bitangent, normal);
+    // and on to world space for the sky
+    mat3 worldTBN = mat3(iview) * TBN;
     // iterate over the sample kernel and calculate SSDO's indirect light
     vec3 directLight = vec3(0.0, 0.0, 0.0);
     vec3 indirectLight = vec3(0.0, 0.0, 0.0);
@@ -45,28 +43,33 @@ void main()
         offset = projection * offset; // from view to clip-space
         offset.xyz /= offset.w; // perspective divide
         offset.xyz = offset.xyz * 0.5 + 0.5; // transform to range 0.0 - 1.0
+        vec2 sampleScreen = offset.xy;
+        offset.xy *= uvScale; // and into the rendered part of the targets
 
-        // get sample info
-        float sampleDepth = -texture(gPosition, offset.xy).w; // get depth value of kernel sample
-		vec3 samplePos1 = texture(gPosition, offset.xy).xyz;
-        vec3 sampleNormal = texture(gNormal, offset.xy).rgb;
-		vec3 sampleColor = texture(gAlbedo, offset.xy).xyz;
+        // get sample depth
+        // get depth value of kernel sample: the farthest surface under it decides occlusion, and the
+        // nearest one how far in front of the pixel an occluder may be
+        vec2 sampleRange = -hiZRange(TexCoords, offset.xy);
+        float sampleDepth = sampleRange.y;
 
         // range check & accumulate
-        float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
+        float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleRange.x));
         if (sampleDepth >= samplePos.z)
         {
+            // the occluder's surface is only needed for the indirect bounce
+            vec3 samplePos1 = viewPosition(sampleScreen, textureLod(gDepth, offset.xy, 0.0).r);
+            vec3 sampleNormal = decodeNormal(textureLod(gNormal, offset.xy, 0.0).rg);
+            vec3 sampleColor = textureLod(gAlbedo, offset.xy, 0.0).xyz;
     		indirectLight += rangeCheck * max(dot(sampleNormal, normalize(fragPos - samplePos1)), 0.0) * sampleColor;
         }
         else
         {
-            vec4 skyboxDirection = iview * vec4(samplePos - fragPos, 0.0);
-			vec3 skyboxColor = texture(skybox, skyboxDirection.xyz).xyz;
+            vec3 skyboxColor = skyRadiance(normalize(worldTBN * samples[i]));
 			directLight += rangeCheck * skyboxColor * dot(normal, normalize(samplePos - fragPos));
         }
     }
-    directLight = 0.5 * (directLight / kernelSize);
-    indirectLight = 5.0 * (indirectLight / kernelSize);
+    directLight = 0.5 * (directLight / float(kernelSize));
+    indirectLight = 5.0 * (indirectLight / float(kernelSize));
 
     FragColor = directLight + indirectLight;
 }
\ No newline at end of file
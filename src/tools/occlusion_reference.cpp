@@ -0,0 +1,152 @@
+// Runs the CPU reference of the occlusion pipeline (utils_cpu_occlusion.h) over captured g-buffers.
+//
+//   OcclusionReference [--mode ssao|ssdo|both] [--samples N] [--radius R] [--blur N]
+//                      [--sampling random|low-discrepancy] [--threads N] [--compare TOLERANCE]
+//                      <frame directory>...
+//
+// A frame directory holds depth.pfm, normal.pfm, albedo.pfm, optionally specular.pfm, and frame.txt
+// with the projection, view, sky SH and lights (see CpuFrame), as main's --capture writes them. The
+// occlusion, blurred like the GPU blurs it, goes to ssao.pfm and ssdo.pfm next to them, the lit image
+// to lit.pfm. The defaults are those of RendererSettings::medium(); pass the setting frame.txt names
+// for a captured frame. --compare rounds the passes to the GPU's 8-bit targets and diffs the result
+// against the captured gpu_ssao.pfm and gpu_ssdo.pfm over the rendered pixels; a mean error above
+// TOLERANCE fails the frame. Exits with 1 when a frame cannot be read or written or fails.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "../utils_sampling.h"
+#include "../utils_cpu_occlusion.h"
+
+static double millisecondsSince(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    std::string mode = "both", sampling = "low-discrepancy";
+    int kernelSize = 12, blurRadius = 3;
+    float radius = 0.5f, tolerance = -1.0f;
+    unsigned int threadCount = 0;
+    std::vector<std::string> frames;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--", 2) != 0)
+        {
+            frames.push_back(argv[i]);
+            continue;
+        }
+        if (i + 1 == argc)
+        {
+            std::cout << "ERROR::OCCLUSION_REFERENCE:: " << argv[i] << " needs a value" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "--mode") == 0)
+            mode = argv[i + 1];
+        else if (strcmp(argv[i], "--samples") == 0)
+            kernelSize = std::max(1, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--radius") == 0)
+            radius = (float)atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--blur") == 0)
+            blurRadius = std::max(0, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--sampling") == 0)
+            sampling = argv[i + 1];
+        else if (strcmp(argv[i], "--threads") == 0)
+            threadCount = (unsigned int)std::max(0, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--compare") == 0)
+            tolerance = std::max(0.0f, (float)atof(argv[i + 1]));
+        else
+        {
+            std::cout << "ERROR::OCCLUSION_REFERENCE:: unknown option " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+    if (frames.empty() || (mode != "ssao" && mode != "ssdo" && mode != "both") ||
+        (sampling != "random" && sampling != "low-discrepancy"))
+    {
+        printf("usage: %s [--mode ssao|ssdo|both] [--samples N] [--radius R] [--blur N] "
+               "[--sampling random|low-discrepancy] [--threads N] [--compare TOLERANCE] <frame directory>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // the kernel and noise RendererSettings::kernel() and noise() pick for the same setting
+    bool lowDiscrepancy = sampling == "low-discrepancy";
+    CpuOcclusionSettings settings = {
+        lowDiscrepancy ? generateHaltonKernel(kernelSize) : generateSampleKernel(kernelSize), radius,
+        lowDiscrepancy ? blueNoiseRotations() : generateKernelNoise(), lowDiscrepancy ? BLUE_NOISE_SIZE : 4,
+        blurRadius, glm::vec2(1.0f, 0.0f), glm::vec2(0.0f), tolerance >= 0.0f
+    };
+    bool useSsao = mode != "ssdo", useSsdo = mode != "ssao";
+
+    CpuOcclusion occlusion(threadCount);
+    printf("occlusion reference: %s, %d samples, radius %.2f, blur %d, %s sampling, %u threads\n", mode.c_str(),
+           kernelSize, radius, blurRadius, sampling.c_str(), occlusion.threads());
+    int failures = 0;
+    for (size_t f = 0; f < frames.size(); f++)
+    {
+        const std::string &directory = frames[f];
+        CpuGBuffer gBuffer;
+        CpuFrame frame;
+        if (!gBuffer.load(directory) || !frame.load(directory + "/frame.txt"))
+        {
+            failures++;
+            continue;
+        }
+
+        FloatImage ambient, directional, lit;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        occlusion.occlusion(gBuffer, frame, settings, useSsao ? &ambient : NULL, useSsdo ? &directional : NULL);
+        double occlusionMs = millisecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        if (useSsao)
+            occlusion.blur(ambient, gBuffer, blurRadius, settings.unormTargets);
+        if (useSsdo)
+            occlusion.blur(directional, gBuffer, blurRadius, settings.unormTargets);
+        double blurMs = millisecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        occlusion.lighting(gBuffer, frame, useSsao ? &ambient : NULL, useSsdo ? &directional : NULL, lit);
+        double lightingMs = millisecondsSince(start);
+
+        bool written = lit.savePfm(directory + "/lit.pfm");
+        if (useSsao)
+            written = ambient.savePfm(directory + "/ssao.pfm") && written;
+        if (useSsdo)
+            written = directional.savePfm(directory + "/ssdo.pfm") && written;
+        if (!written)
+            failures++;
+        printf("%s: %dx%d, occlusion %.2f ms, blur %.2f ms, lighting %.2f ms\n", directory.c_str(),
+               gBuffer.width(), gBuffer.height(), occlusionMs, blurMs, lightingMs);
+
+        if (tolerance >= 0.0f)
+        {
+            const char *names[] = { "ssao", "ssdo" };
+            const FloatImage *images[] = { useSsao ? &ambient : NULL, useSsdo ? &directional : NULL };
+            for (int p = 0; p < 2; p++)
+            {
+                if (!images[p])
+                    continue;
+                FloatImage gpu;
+                if (!gpu.loadPfm(directory + "/gpu_" + names[p] + ".pfm"))
+                {
+                    failures++;
+                    continue;
+                }
+                OcclusionDifference difference = compareOcclusion(*images[p], gpu, gBuffer.depth);
+                bool passed = difference.meanError <= tolerance;
+                printf("%s: %s against the GPU: mean error %.5f, max error %.5f over %d pixels  %s\n", directory.c_str(),
+                       names[p], difference.meanError, difference.maxError, difference.pixels, passed ? "ok" : "FAILED");
+                if (!passed)
+                    failures++;
+            }
+        }
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+// Generates and validates the sampling tables of the occlusion kernels.
+//
+//   SamplingTables                 checks the compiled-in tables
+//   SamplingTables --write <path>  regenerates utils_blue_noise.h at path, then checks the new map
+//
+// The blue-noise map has to be a permutation of its ranks and keep far less low-frequency power
+// than a white-noise map; whether it reproduces from its seed is only reported, as other math
+// libraries may break the energy ties differently. The Halton kernels have to beat the random
+// kernels on the wrap-around L2 discrepancy of their directions. Exits with 1 when a check fails.
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "../utils_sampling.h"
+
+static const int MAP_SIZE = 64;
+static const float MAP_SIGMA = 1.5f;
+static const unsigned int MAP_SEED = 1;
+
+static bool writeHeader(const char *path, const std::vector<unsigned short> &ranks)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        printf("ERROR::SAMPLING_TABLES:: cannot write %s\n", path);
+        return false;
+    }
+    fprintf(file, "#pragma once\n\n");
+    fprintf(file, "// %dx%d void-and-cluster blue-noise threshold map (sigma %.1f, seed %u), tileable, every rank once.\n",
+            MAP_SIZE, MAP_SIZE, MAP_SIGMA, MAP_SEED);
+    fprintf(file, "// generated by tools/sampling_tables.cpp, do not edit: SamplingTables --write src/utils_blue_noise.h\n");
+    fprintf(file, "static const int BLUE_NOISE_SIZE = %d;\n", MAP_SIZE);
+    fprintf(file, "static const unsigned short BLUE_NOISE_RANKS[BLUE_NOISE_SIZE * BLUE_NOISE_SIZE] = {\n");
+    for (size_t i = 0; i < ranks.size(); i++)
+        fprintf(file, "%s%4u%s", i % 16 == 0 ? "    " : "", ranks[i], i + 1 == ranks.size() ? "\n" : i % 16 == 15 ? ",\n" : ", ");
+    fprintf(file, "};\n");
+    fclose(file);
+    printf("wrote %s\n", path);
+    return true;
+}
+
+// share of the power below a quarter of the Nyquist frequency, DC excluded
+static double lowFrequencyPower(const std::vector<unsigned short> &ranks, int size)
+{
+    std::vector<double> values(ranks.size());
+    double mean = 0.0;
+    for (size_t i = 0; i < ranks.size(); i++)
+        mean += values[i] = ranks[i];
+    mean /= ranks.size();
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] -= mean;
+
+    // separable DFT: rows, then columns
+    const double pi = 3.14159265358979;
+    std::vector<double> rowRe(ranks.size()), rowIm(ranks.size());
+    for (int y = 0; y < size; y++)
+        for (int u = 0; u < size; u++)
+        {
+            double re = 0.0, im = 0.0;
+            for (int x = 0; x < size; x++)
+            {
+                re += values[y * size + x] * std::cos(2.0 * pi * u * x / size);
+                im -= values[y * size + x] * std::sin(2.0 * pi * u * x / size);
+            }
+            rowRe[y * size + u] = re;
+            rowIm[y * size + u] = im;
+        }
+    double low = 0.0, total = 0.0;
+    for (int v = 0; v < size; v++)
+        for (int u = 0; u < size; u++)
+        {
+            double re = 0.0, im = 0.0;
+            for (int y = 0; y < size; y++)
+            {
+                double c = std::cos(2.0 * pi * v * y / size), s = -std::sin(2.0 * pi * v * y / size);
+                re += rowRe[y * size + u] * c - rowIm[y * size + u] * s;
+                im += rowRe[y * size + u] * s + rowIm[y * size + u] * c;
+            }
+            double power = re * re + im * im;
+            int fu = std::min(u, size - u), fv = std::min(v, size - v);
+            total += power;
+            if (fu * fu + fv * fv <= (size / 8) * (size / 8))
+                low += power;
+        }
+    return total > 0.0 ? low / total : 0.0;
+}
+
+// wrap-around L2 discrepancy (Hickernell) of the kernel directions as (cos theta, phi / 2pi), which
+// are uniform in [0, 1)^2 exactly when the directions are uniform over the hemisphere
+static double directionDiscrepancy(const std::vector<glm::vec3> &kernel)
+{
+    std::vector<glm::vec2> points;
+    for (size_t i = 0; i < kernel.size(); i++)
+    {
+        glm::vec3 d = glm::normalize(kernel[i]);
+        float phi = std::atan2(d.y, d.x) / (2.0f * 3.14159265f);
+        points.push_back(glm::vec2(d.z, phi < 0.0f ? phi + 1.0f : phi));
+    }
+    double sum = 0.0;
+    for (size_t i = 0; i < points.size(); i++)
+        for (size_t j = 0; j < points.size(); j++)
+        {
+            double product = 1.0;
+            for (int k = 0; k < 2; k++)
+            {
+                double delta = std::fabs(points[i][k] - points[j][k]);
+                product *= 1.5 - delta * (1.0 - delta);
+            }
+            sum += product;
+        }
+    return std::sqrt(std::max(0.0, -16.0 / 9.0 + sum / (double)(points.size() * points.size())));
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+    std::vector<unsigned short> ranks(BLUE_NOISE_RANKS, BLUE_NOISE_RANKS + BLUE_NOISE_SIZE * BLUE_NOISE_SIZE);
+    std::vector<unsigned short> generated = generateBlueNoise(MAP_SIZE, MAP_SIGMA, MAP_SEED);
+    if (argc == 3 && strcmp(argv[1], "--write") == 0)
+    {
+        if (!writeHeader(argv[2], generated))
+            return 1;
+        ranks = generated;
+    }
+    else if (argc != 1)
+    {
+        printf("usage: %s [--write <utils_blue_noise.h>]\n", argv[0]);
+        return 1;
+    }
+
+    // blue noise
+    int size = (int)std::sqrt((double)ranks.size());
+    std::vector<unsigned short> sorted = ranks;
+    std::sort(sorted.begin(), sorted.end());
+    bool permutation = size * size == (int)ranks.size();
+    for (size_t i = 0; i < sorted.size(); i++)
+        permutation = permutation && sorted[i] == i;
+    bool reproduces = ranks == generated;
+    std::vector<unsigned short> white = sorted;
+    std::mt19937 generator(MAP_SEED);
+    for (size_t i = white.size() - 1; i > 0; i--)
+        std::swap(white[i], white[generator() % (i + 1)]);
+    double bluePower = lowFrequencyPower(ranks, size), whitePower = lowFrequencyPower(white, size);
+    printf("blue noise %dx%d: permutation %s, reproduces from seed %s, low-frequency power %.5f (white noise %.5f)\n",
+           size, size, permutation ? "yes" : "NO", reproduces ? "yes" : "NO", bluePower, whitePower);
+    ok = ok && permutation && bluePower < 0.25 * whitePower;
+
+    // kernels, at the sizes of the quality presets
+    const int sizes[] = { 8, 12, 16, 32 };
+    for (int i = 0; i < 4; i++)
+    {
+        double randomD = directionDiscrepancy(generateSampleKernel(sizes[i]));
+        double haltonD = directionDiscrepancy(generateHaltonKernel(sizes[i]));
+        printf("kernel %2d: direction discrepancy random %.4f, halton %.4f\n", sizes[i], randomD, haltonD);
+        ok = ok && haltonD < randomD;
+    }
+
+    printf(ok ? "sampling tables: ok\n" : "ERROR::SAMPLING_TABLES:: validation failed\n");
+    return ok ? 0 : 1;
+}
@@ -113,11 +113,25 @@ public:
     }
 
     // returns the Field Of Vision
-    float getFov()
+    float getFov() const
     {
         return fov;
     }
 
+    // returns the view direction
+    glm::vec3 getFront() const
+    {
+        return cameraFront;
+    }
+
+    // puts the camera at a position looking along front, for replaying camera paths
+    void place(glm::vec3 position, glm::vec3 front, float fov)
+    {
+        cameraPos = position;
+        cameraFront = glm::normalize(front);
+        this->fov = fov;
+    }
+
     // returns the view matrix
     glm::mat4 getView()
     {
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "utils_camera.h"
+
+// one recorded camera state
+struct CameraKey
+{
+    float time;
+    glm::vec3 position;
+    glm::vec3 front;
+    float fov;
+};
+
+// A camera path for replaying the same views frame by frame: recorded from the interactive camera
+// ("--record-path file" in the viewer) or scripted. The file is plain text, one key per line:
+//   time  x y z  front.x front.y front.z  fov
+// with lines starting with '#' ignored. Between keys the position and fov are interpolated
+// linearly and the view direction along the great circle.
+class CameraPath
+{
+public:
+    std::vector<CameraKey> keys;
+
+    // an orbit around the model at the default camera's distance, looking at the center
+    static CameraPath orbit(int keyCount = 64, float radius = 10.0f, float height = 1.0f)
+    {
+        CameraPath path;
+        for (int i = 0; i <= keyCount; i++)
+        {
+            float angle = 2.0f * 3.14159265f * i / keyCount;
+            CameraKey key;
+            key.time = (float)i / keyCount;
+            key.position = glm::vec3(radius * std::sin(angle), height, radius * std::cos(angle));
+            key.front = glm::normalize(-key.position);
+            key.fov = FOV;
+            path.keys.push_back(key);
+        }
+        return path;
+    }
+
+    bool load(const std::string &path)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+        {
+            std::cout << "ERROR::CAMERA_PATH:: cannot read " << path << std::endl;
+            return false;
+        }
+        keys.clear();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream values(line);
+            CameraKey key;
+            if (!(values >> key.time >> key.position.x >> key.position.y >> key.position.z
+                         >> key.front.x >> key.front.y >> key.front.z >> key.fov))
+            {
+                std::cout << "ERROR::CAMERA_PATH:: bad key in " << path << ": " << line << std::endl;
+                return false;
+            }
+            key.front = glm::normalize(key.front);
+            keys.push_back(key);
+        }
+        if (keys.empty())
+        {
+            std::cout << "ERROR::CAMERA_PATH:: no keys in " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool save(const std::string &path) const
+    {
+        FILE *file = fopen(path.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "ERROR::CAMERA_PATH:: cannot write " << path << std::endl;
+            return false;
+        }
+        fprintf(file, "# time  x y z  front.x front.y front.z  fov\n");
+        for (size_t i = 0; i < keys.size(); i++)
+            fprintf(file, "%.4f  %.5f %.5f %.5f  %.5f %.5f %.5f  %.3f\n", keys[i].time,
+                    keys[i].position.x, keys[i].position.y, keys[i].position.z,
+                    keys[i].front.x, keys[i].front.y, keys[i].front.z, keys[i].fov);
+        fclose(file);
+        return true;
+    }
+
+    // appends the camera as it is at time
+    void record(const Camera &camera, float time)
+    {
+        CameraKey key = { time, camera.cameraPos, camera.getFront(), camera.getFov() };
+        keys.push_back(key);
+    }
+
+    float duration() const { return keys.empty() ? 0.0f : keys.back().time - keys.front().time; }
+
+    // puts the camera where the path is at fraction (0..1) of its duration
+    void apply(Camera &camera, float fraction) const
+    {
+        if (keys.empty())
+            return;
+        float time = keys.front().time + fraction * duration();
+        size_t next = 1;
+        while (next < keys.size() && keys[next].time < time)
+            next++;
+        CameraKey key = keys[std::min(next, keys.size() - 1)];
+        if (next < keys.size())
+        {
+            const CameraKey &previous = keys[next - 1];
+            float span = key.time - previous.time;
+            float f = span > 0.0f ? glm::clamp((time - previous.time) / span, 0.0f, 1.0f) : 1.0f;
+            key.position = glm::mix(previous.position, key.position, f);
+            key.front = slerp(previous.front, key.front, f);
+            key.fov = glm::mix(previous.fov, key.fov, f);
+        }
+        camera.place(key.position, key.front, key.fov);
+    }
+
+private:
+    static glm::vec3 slerp(const glm::vec3 &a, const glm::vec3 &b, float f)
+    {
+        float cosine = glm::clamp(glm::dot(a, b), -1.0f, 1.0f);
+        float angle = std::acos(cosine);
+        if (angle < 1e-4f)
+            return glm::normalize(glm::mix(a, b, f));
+        return (a * std::sin((1.0f - f) * angle) + b * std::sin(f * angle)) / std::sin(angle);
+    }
+};
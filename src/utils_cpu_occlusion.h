@@ -0,0 +1,800 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "utils_thread_pool.h"
+#include "utils_cpu_profiler.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CPU_OCCLUSION_SSE
+#endif
+
+// CPU reference of the occlusion pipeline: the g-buffer through the hemisphere SSAO/SSDO sample loop
+// (ssao/ssao.fs, ssdo/ssdo.fs, both/ssao_ssdo.fs), the bilateral blur (common/bilateral_blur.fs) and the
+// lighting (common/lighting.fs), on plain float images and without any GL. It takes the same kernel and
+// rotation noise as the shaders and follows their arithmetic step by step, so its results are an oracle
+// for shader changes and stand in for the GPU on machines without one. The image is cut into tiles run
+// across a work-stealing ThreadPool; the sample loop processes 4 horizontally adjacent pixels at a time
+// with SSE where available, the rest of a row one by one.
+//
+// Differences to the GPU passes: occlusion runs at the resolution of the given g-buffer (downsampling,
+// temporal accumulation and the horizon estimator are not mirrored), the sky is always the SH9 of
+// SKY_HARMONICS, and the lighting adds every light within its radius instead of walking the clusters,
+// which may also hold lights just out of range (under 5/256 each). Pixels where nothing was rendered
+// get occlusion 1, no directional light and black, where the GPU leaves undefined values under the sky.
+
+// a float image of 1 to 4 interleaved channels, rows bottom to top as in the GL targets. Stored as
+// PFM (portable float map), which has 1 (Pf) or 3 (PF) channels and also runs bottom to top.
+struct FloatImage
+{
+    int width, height, channels;
+    std::vector<float> pixels;
+
+    FloatImage() : width(0), height(0), channels(0) {}
+    FloatImage(int width, int height, int channels, float value = 0.0f)
+        : width(width), height(height), channels(channels), pixels((size_t)width * height * channels, value) {}
+
+    bool empty() const { return pixels.empty(); }
+    float *at(int x, int y) { return &pixels[((size_t)y * width + x) * channels]; }
+    const float *at(int x, int y) const { return &pixels[((size_t)y * width + x) * channels]; }
+
+    bool loadPfm(const std::string &path)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file)
+        {
+            std::cout << "ERROR::FLOAT_IMAGE:: cannot read " << path << std::endl;
+            return false;
+        }
+        char type[3] = { 0 };
+        float scale;
+        if (fscanf(file, "%2s %d %d %f", type, &width, &height, &scale) != 4 || type[0] != 'P' ||
+            (type[1] != 'f' && type[1] != 'F') || width <= 0 || height <= 0 || fgetc(file) == EOF)
+        {
+            std::cout << "ERROR::FLOAT_IMAGE:: not a PFM file: " << path << std::endl;
+            fclose(file);
+            return false;
+        }
+        channels = type[1] == 'F' ? 3 : 1;
+        pixels.resize((size_t)width * height * channels);
+        bool complete = fread(&pixels[0], sizeof(float), pixels.size(), file) == pixels.size();
+        fclose(file);
+        if (!complete)
+        {
+            std::cout << "ERROR::FLOAT_IMAGE:: truncated PFM file: " << path << std::endl;
+            return false;
+        }
+        // a positive scale marks big-endian data; the hosts this runs on are little-endian
+        if (scale > 0.0f)
+            for (size_t i = 0; i < pixels.size(); i++)
+            {
+                unsigned char *bytes = (unsigned char *)&pixels[i];
+                std::swap(bytes[0], bytes[3]);
+                std::swap(bytes[1], bytes[2]);
+            }
+        return true;
+    }
+
+    bool savePfm(const std::string &path) const
+    {
+        if (channels != 1 && channels != 3)
+        {
+            std::cout << "ERROR::FLOAT_IMAGE:: PFM holds 1 or 3 channels, not " << channels << ": " << path << std::endl;
+            return false;
+        }
+        FILE *file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::FLOAT_IMAGE:: cannot write " << path << std::endl;
+            return false;
+        }
+        fprintf(file, "%s\n%d %d\n-1.0\n", channels == 3 ? "PF" : "Pf", width, height);
+        fwrite(&pixels[0], sizeof(float), pixels.size(), file);
+        fclose(file);
+        return true;
+    }
+};
+
+// the g-buffer as the occlusion passes see it, all at the same resolution
+struct CpuGBuffer
+{
+    FloatImage depth;    // 1 channel, linear view depth, 0 where nothing was rendered
+    FloatImage normal;   // 3 channels, unit view-space normal as decodeNormal returns it
+    FloatImage albedo;   // 3 channels, diffuse color
+    FloatImage specular; // 1 channel, specular intensity; may be left empty for none
+
+    int width() const { return depth.width; }
+    int height() const { return depth.height; }
+
+    // depth.pfm, normal.pfm, albedo.pfm and optionally specular.pfm from directory
+    bool load(const std::string &directory)
+    {
+        if (!depth.loadPfm(directory + "/depth.pfm") || !normal.loadPfm(directory + "/normal.pfm") ||
+            !albedo.loadPfm(directory + "/albedo.pfm"))
+            return false;
+        std::ifstream specularFile((directory + "/specular.pfm").c_str());
+        if (specularFile && !specular.loadPfm(directory + "/specular.pfm"))
+            return false;
+        if (depth.channels != 1 || normal.channels != 3 || albedo.channels != 3 || (!specular.empty() && specular.channels != 1) ||
+            !sameSize(normal) || !sameSize(albedo) || (!specular.empty() && !sameSize(specular)))
+        {
+            std::cout << "ERROR::CPU_OCCLUSION:: the g-buffer in " << directory << " has mismatched sizes or channels" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool sameSize(const FloatImage &image) const { return image.width == depth.width && image.height == depth.height; }
+};
+
+// point light of the lighting pass, in view space
+struct CpuLight
+{
+    glm::vec3 position;
+    glm::vec3 color;
+    // attenuation 1 / (1 + linear * d + quadratic * d^2), ignored beyond radius as Light::radius() gives it
+    float linear, quadratic, radius;
+};
+
+// the uniforms of a frame. As text, one entry per line, '#' starting a comment:
+//   projection  16 values, column by column
+//   view        16 values, column by column
+//   sh          r g b     (9 lines, the SH9 of the sky in SkySH order)
+//   light       x y z  r g b  linear quadratic radius   (view-space position, any number of lines)
+struct CpuFrame
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 skySH[9];
+    std::vector<CpuLight> lights;
+
+    bool load(const std::string &path)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+        {
+            std::cout << "ERROR::CPU_OCCLUSION:: cannot read " << path << std::endl;
+            return false;
+        }
+        int shCount = 0;
+        bool hasProjection = false, hasView = false;
+        lights.clear();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream values(line);
+            std::string key;
+            if (!(values >> key) || key[0] == '#')
+                continue;
+            bool read = true;
+            if (key == "projection" || key == "view")
+            {
+                glm::mat4 &matrix = key == "view" ? view : projection;
+                for (int i = 0; i < 16; i++)
+                    read = read && (values >> matrix[i / 4][i % 4]);
+                (key == "view" ? hasView : hasProjection) = true;
+            }
+            else if (key == "sh" && shCount < 9)
+            {
+                read = (bool)(values >> skySH[shCount].r >> skySH[shCount].g >> skySH[shCount].b);
+                shCount++;
+            }
+            else if (key == "light")
+            {
+                CpuLight light;
+                read = (bool)(values >> light.position.x >> light.position.y >> light.position.z >> light.color.r >>
+                              light.color.g >> light.color.b >> light.linear >> light.quadratic >> light.radius);
+                lights.push_back(light);
+            }
+            else
+                read = false;
+            if (!read)
+            {
+                std::cout << "ERROR::CPU_OCCLUSION:: bad line in " << path << ": " << line << std::endl;
+                return false;
+            }
+        }
+        if (!hasProjection || !hasView || shCount != 9)
+        {
+            std::cout << "ERROR::CPU_OCCLUSION:: " << path << " needs a projection, a view and 9 sh lines" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // the format load() reads, comment written as '#' lines ahead of it
+    bool save(const std::string &path, const std::string &comment = "") const
+    {
+        std::ofstream file(path.c_str());
+        if (!file)
+        {
+            std::cout << "ERROR::CPU_OCCLUSION:: cannot write " << path << std::endl;
+            return false;
+        }
+        // enough digits that the matrices read back to the same floats
+        file.precision(9);
+        std::istringstream commentLines(comment);
+        std::string line;
+        while (std::getline(commentLines, line))
+            file << "# " << line << "\n";
+        file << "projection";
+        for (int i = 0; i < 16; i++)
+            file << " " << projection[i / 4][i % 4];
+        file << "\nview";
+        for (int i = 0; i < 16; i++)
+            file << " " << view[i / 4][i % 4];
+        file << "\n";
+        for (int i = 0; i < 9; i++)
+            file << "sh " << skySH[i].r << " " << skySH[i].g << " " << skySH[i].b << "\n";
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            const CpuLight &light = lights[i];
+            file << "light " << light.position.x << " " << light.position.y << " " << light.position.z << " " << light.color.r << " "
+                 << light.color.g << " " << light.color.b << " " << light.linear << " " << light.quadratic << " " << light.radius << "\n";
+        }
+        return (bool)file;
+    }
+};
+
+// what the occlusion passes are built with; fill kernel and noise from RendererSettings::kernel(),
+// noise() and noiseSize() (or utils_sampling.h directly) to match a GPU setting
+struct CpuOcclusionSettings
+{
+    std::vector<glm::vec3> kernel; // hemisphere samples in tangent space
+    float radius;                  // sample radius in view space
+    std::vector<glm::vec3> noise;  // noiseSize x noiseSize rotations, row by row
+    int noiseSize;
+    int blurRadius;                // taps on each side of the bilateral blur, 0 for none
+    glm::vec2 noiseRotation;       // per-frame rotation (cos, sin) and tile offset of the noise,
+    glm::vec2 noiseOffset;         // (1, 0) and (0, 0) unless reproducing a temporal frame
+    bool unormTargets;             // clamp and round every pass's output to 8 bits as the GPU's GL_RED/GL_RGB
+                                   // targets store it, to compare against them; float otherwise
+};
+
+// how far an occlusion image is from the GPU's over the pixels where something was rendered, the
+// only ones either side defines
+struct OcclusionDifference
+{
+    double meanError, maxError; // absolute, over all channels
+    int pixels;
+};
+
+inline OcclusionDifference compareOcclusion(const FloatImage &image, const FloatImage &gpu, const FloatImage &depth)
+{
+    OcclusionDifference difference = { 0.0, 0.0, 0 };
+    if (image.width != gpu.width || image.height != gpu.height || image.channels != gpu.channels ||
+        depth.width != image.width || depth.height != image.height)
+    {
+        difference.meanError = difference.maxError = 1e30;
+        return difference;
+    }
+    double total = 0.0;
+    for (int y = 0; y < image.height; y++)
+        for (int x = 0; x < image.width; x++)
+        {
+            if (*depth.at(x, y) <= 0.0f)
+                continue;
+            for (int c = 0; c < image.channels; c++)
+            {
+                double error = std::fabs((double)image.at(x, y)[c] - gpu.at(x, y)[c]);
+                total += error;
+                difference.maxError = std::max(difference.maxError, error);
+            }
+            difference.pixels++;
+        }
+    if (difference.pixels > 0)
+        difference.meanError = total / ((double)difference.pixels * image.channels);
+    return difference;
+}
+
+#ifdef CPU_OCCLUSION_SSE
+// 4 lanes of the per-pixel loops; comparisons give all-ones masks for select()
+struct Float4
+{
+    __m128 v;
+
+    Float4() {}
+    explicit Float4(__m128 v) : v(v) {}
+    Float4(float value) : v(_mm_set1_ps(value)) {}
+};
+
+inline Float4 operator+(Float4 a, Float4 b) { return Float4(_mm_add_ps(a.v, b.v)); }
+inline Float4 operator-(Float4 a, Float4 b) { return Float4(_mm_sub_ps(a.v, b.v)); }
+inline Float4 operator*(Float4 a, Float4 b) { return Float4(_mm_mul_ps(a.v, b.v)); }
+inline Float4 operator/(Float4 a, Float4 b) { return Float4(_mm_div_ps(a.v, b.v)); }
+inline Float4 lanesMin(Float4 a, Float4 b) { return Float4(_mm_min_ps(a.v, b.v)); }
+inline Float4 lanesMax(Float4 a, Float4 b) { return Float4(_mm_max_ps(a.v, b.v)); }
+inline Float4 lanesSqrt(Float4 a) { return Float4(_mm_sqrt_ps(a.v)); }
+inline Float4 lanesAbs(Float4 a) { return Float4(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)); }
+inline Float4 lanesGreaterEqual(Float4 a, Float4 b) { return Float4(_mm_cmpge_ps(a.v, b.v)); }
+inline Float4 lanesSelect(Float4 mask, Float4 a, Float4 b) { return Float4(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))); }
+inline bool lanesAny(Float4 mask) { return _mm_movemask_ps(mask.v) != 0; }
+inline void lanesStore(Float4 a, float *out) { _mm_storeu_ps(out, a.v); }
+#endif
+
+// the scalar tail: one lane, masks are 1 or 0
+inline float lanesMin(float a, float b) { return std::min(a, b); }
+inline float lanesMax(float a, float b) { return std::max(a, b); }
+inline float lanesSqrt(float a) { return std::sqrt(a); }
+inline float lanesAbs(float a) { return std::fabs(a); }
+inline float lanesGreaterEqual(float a, float b) { return a >= b ? 1.0f : 0.0f; }
+inline float lanesSelect(float mask, float a, float b) { return mask != 0.0f ? a : b; }
+inline bool lanesAny(float mask) { return mask != 0.0f; }
+inline void lanesStore(float a, float *out) { *out = a; }
+
+template <class T> struct LaneCount { static const int value = 1; };
+#ifdef CPU_OCCLUSION_SSE
+template <> struct LaneCount<Float4> { static const int value = 4; };
+#endif
+
+template <class T> inline T lanesLoad(const float *values) { return values[0]; }
+#ifdef CPU_OCCLUSION_SSE
+template <> inline Float4 lanesLoad<Float4>(const float *values) { return Float4(_mm_loadu_ps(values)); }
+#endif
+
+// a vec3 per lane
+template <class T>
+struct Vec3Lanes
+{
+    T x, y, z;
+
+    Vec3Lanes() {}
+    Vec3Lanes(T x, T y, T z) : x(x), y(y), z(z) {}
+    Vec3Lanes(const glm::vec3 &v) : x(v.x), y(v.y), z(v.z) {}
+
+    Vec3Lanes operator+(const Vec3Lanes &o) const { return Vec3Lanes(x + o.x, y + o.y, z + o.z); }
+    Vec3Lanes operator-(const Vec3Lanes &o) const { return Vec3Lanes(x - o.x, y - o.y, z - o.z); }
+    Vec3Lanes operator*(T s) const { return Vec3Lanes(x * s, y * s, z * s); }
+};
+
+template <class T> inline T lanesDot(const Vec3Lanes<T> &a, const Vec3Lanes<T> &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+template <class T> inline Vec3Lanes<T> lanesCross(const Vec3Lanes<T> &a, const Vec3Lanes<T> &b)
+{
+    return Vec3Lanes<T>(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+template <class T> inline Vec3Lanes<T> lanesNormalize(const Vec3Lanes<T> &v) { return v * (T(1.0f) / lanesSqrt(lanesDot(v, v))); }
+
+class CpuOcclusion
+{
+public:
+    static const int TILE_SIZE = 32;
+    // common/hiz.glsl
+    static const int HIZ_LOG_OFFSET = 3;
+    static const int HIZ_MAX_LEVEL = 5;
+
+    // threadCount includes the calling thread; 0 takes one per hardware thread
+    explicit CpuOcclusion(unsigned int threadCount = 0) : pool(threadCount) {}
+
+    unsigned int threads() const { return pool.size(); }
+
+    // the sample loop of both/ssao_ssdo.fs into ambient (1 channel, ssao/ssao.fs) and directional
+    // (3 channels, ssdo/ssdo.fs); either may be NULL to skip it
+    void occlusion(const CpuGBuffer &gBuffer, const CpuFrame &frame, const CpuOcclusionSettings &settings,
+                   FloatImage *ambient, FloatImage *directional)
+    {
+        CPU_PROFILE_SCOPE("CpuOcclusion::occlusion");
+        int width = gBuffer.width(), height = gBuffer.height();
+        buildHiZ(gBuffer.depth);
+        if (ambient)
+            *ambient = FloatImage(width, height, 1);
+        if (directional)
+            *directional = FloatImage(width, height, 3);
+
+        Pass pass;
+        pass.gBuffer = &gBuffer;
+        pass.settings = &settings;
+        pass.projection = frame.projection;
+        pass.invProjection = glm::inverse(frame.projection);
+        pass.iview = glm::mat3(glm::inverse(frame.view));
+        for (int i = 0; i < 9; i++)
+            pass.skySH[i] = frame.skySH[i];
+        pass.ambient = ambient;
+        pass.directional = directional;
+        forTiles(width, height, [this, &pass](int x0, int y0, int x1, int y1)
+        {
+            for (int y = y0; y < y1; y++)
+            {
+                int x = x0;
+#ifdef CPU_OCCLUSION_SSE
+                for (; x + 4 <= x1; x += 4)
+                    occlusionSpan<Float4>(pass, x, y);
+#endif
+                for (; x < x1; x++)
+                    occlusionSpan<float>(pass, x, y);
+            }
+        });
+        if (settings.unormTargets)
+        {
+            if (ambient)
+                toUnorm8(*ambient);
+            if (directional)
+                toUnorm8(*directional);
+        }
+    }
+
+    // common/bilateral_blur.fs: horizontal, then vertical, guided by the g-buffer's depth and normals;
+    // unormTargets rounds after each pass like the 8-bit intermediate and output targets
+    void blur(FloatImage &image, const CpuGBuffer &gBuffer, int radius, bool unormTargets = false)
+    {
+        CPU_PROFILE_SCOPE("CpuOcclusion::blur");
+        if (radius <= 0)
+            return;
+        FloatImage horizontal(image.width, image.height, image.channels);
+        blurPass(image, horizontal, gBuffer, radius, 1, 0);
+        if (unormTargets)
+            toUnorm8(horizontal);
+        blurPass(horizontal, image, gBuffer, radius, 0, 1);
+        if (unormTargets)
+            toUnorm8(image);
+    }
+
+    // common/lighting.fs into lit (3 channels); ambient and directional may be NULL as without
+    // USE_SSAO and USE_SSDO
+    void lighting(const CpuGBuffer &gBuffer, const CpuFrame &frame, const FloatImage *ambient,
+                  const FloatImage *directional, FloatImage &lit)
+    {
+        CPU_PROFILE_SCOPE("CpuOcclusion::lighting");
+        int width = gBuffer.width(), height = gBuffer.height();
+        lit = FloatImage(width, height, 3);
+        glm::mat4 invProjection = glm::inverse(frame.projection);
+        forTiles(width, height, [&](int x0, int y0, int x1, int y1)
+        {
+            for (int y = y0; y < y1; y++)
+                for (int x = x0; x < x1; x++)
+                {
+                    float depth = *gBuffer.depth.at(x, y);
+                    if (depth <= 0.0f)
+                        continue;
+                    glm::vec3 fragPos = viewPosition(invProjection, glm::vec2((x + 0.5f) / width, (y + 0.5f) / height), depth);
+                    glm::vec3 normal = glm::make_vec3(gBuffer.normal.at(x, y));
+                    glm::vec3 diffuseColor = glm::make_vec3(gBuffer.albedo.at(x, y));
+                    float specularIntensity = gBuffer.specular.empty() ? 0.0f : *gBuffer.specular.at(x, y);
+                    float ambientOcclusion = ambient ? *ambient->at(x, y) : 1.0f;
+                    glm::vec3 directionalOcclusion = directional ? glm::make_vec3(directional->at(x, y)) : glm::vec3(0.0f);
+
+                    glm::vec3 result = diffuseColor * 0.5f * ambientOcclusion + directionalOcclusion;
+                    glm::vec3 viewDir = glm::normalize(-fragPos);
+                    for (size_t i = 0; i < frame.lights.size(); i++)
+                    {
+                        const CpuLight &light = frame.lights[i];
+                        float distance = glm::length(light.position - fragPos);
+                        if (distance > light.radius)
+                            continue;
+                        glm::vec3 lightDir = glm::normalize(light.position - fragPos);
+                        glm::vec3 diffuse = std::max(glm::dot(normal, lightDir), 0.0f) * diffuseColor * light.color;
+                        glm::vec3 halfwayDir = glm::normalize(lightDir + viewDir);
+                        float spec = std::pow(std::max(glm::dot(normal, halfwayDir), 0.0f), 16.0f);
+                        glm::vec3 specular = light.color * spec * specularIntensity;
+                        float attenuation = 1.0f / (1.0f + light.linear * distance + light.quadratic * distance * distance);
+                        result += (diffuse + specular) * attenuation;
+                    }
+                    float *out = lit.at(x, y);
+                    out[0] = result.r;
+                    out[1] = result.g;
+                    out[2] = result.b;
+                }
+        });
+    }
+
+private:
+    // what one occlusion pass reads, shared by its tiles
+    struct Pass
+    {
+        const CpuGBuffer *gBuffer;
+        const CpuOcclusionSettings *settings;
+        glm::mat4 projection, invProjection;
+        glm::mat3 iview;
+        glm::vec3 skySH[9];
+        FloatImage *ambient, *directional;
+    };
+
+    ThreadPool pool;
+    // min/max linear depth pyramid as common/hiz_init.fs and hiz_reduce.fs build it, levels 0 .. HIZ_MAX_LEVEL
+    std::vector<FloatImage> hiZ;
+
+    // runs task(x0, y0, x1, y1) on every tile of the image across the pool
+    template <class Task>
+    void forTiles(int width, int height, const Task &task)
+    {
+        int columns = (width + TILE_SIZE - 1) / TILE_SIZE, rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+        pool.parallelFor(columns * rows, [&](int tile)
+        {
+            int x0 = tile % columns * TILE_SIZE, y0 = tile / columns * TILE_SIZE;
+            task(x0, y0, std::min(x0 + TILE_SIZE, width), std::min(y0 + TILE_SIZE, height));
+        });
+    }
+
+    // the texel nearest sampling with clamp-to-edge picks at coordinate u in [0, 1]
+    static int texelIndex(float u, int size)
+    {
+        float texel = u * size;
+        if (!(texel >= 0.0f))
+            return 0;
+        return texel >= (float)size ? size - 1 : (int)texel;
+    }
+
+    // common/gbuffer.glsl
+    static glm::vec3 viewPosition(const glm::mat4 &invProjection, const glm::vec2 &screen, float depth)
+    {
+        glm::vec4 nearPoint = invProjection * glm::vec4(screen * 2.0f - 1.0f, -1.0f, 1.0f);
+        glm::vec3 ray = glm::vec3(nearPoint) / nearPoint.w;
+        return ray * (depth / -ray.z);
+    }
+
+    template <class T>
+    static Vec3Lanes<T> viewPosition(const glm::mat4 &m, T screenX, T screenY, T depth)
+    {
+        T ndcX = screenX * 2.0f - 1.0f, ndcY = screenY * 2.0f - 1.0f;
+        T w = ndcX * m[0][3] + ndcY * m[1][3] + (m[3][3] - m[2][3]);
+        Vec3Lanes<T> ray((ndcX * m[0][0] + ndcY * m[1][0] + (m[3][0] - m[2][0])) / w,
+                         (ndcX * m[0][1] + ndcY * m[1][1] + (m[3][1] - m[2][1])) / w,
+                         (ndcX * m[0][2] + ndcY * m[1][2] + (m[3][2] - m[2][2])) / w);
+        return ray * (depth / (T(0.0f) - ray.z));
+    }
+
+    // common/sky.glsl without SKY_PREFILTERED
+    template <class T>
+    static Vec3Lanes<T> skyRadiance(const glm::vec3 *sh, const Vec3Lanes<T> &dir)
+    {
+        T basis[9] = { T(0.282095f), dir.y * 0.488603f, dir.z * 0.488603f, dir.x * 0.488603f,
+                       dir.x * dir.y * 1.092548f, dir.y * dir.z * 1.092548f, (dir.z * dir.z * 3.0f - 1.0f) * 0.315392f,
+                       dir.x * dir.z * 1.092548f, (dir.x * dir.x - dir.y * dir.y) * 0.546274f };
+        Vec3Lanes<T> radiance(T(0.0f), T(0.0f), T(0.0f));
+        for (int i = 0; i < 9; i++)
+            radiance = radiance + Vec3Lanes<T>(sh[i]) * basis[i];
+        return Vec3Lanes<T>(lanesMax(radiance.x, T(0.0f)), lanesMax(radiance.y, T(0.0f)), lanesMax(radiance.z, T(0.0f)));
+    }
+
+    void buildHiZ(const FloatImage &depth)
+    {
+        CPU_PROFILE_SCOPE("CpuOcclusion::buildHiZ");
+        int levels = 1;
+        while (levels <= HIZ_MAX_LEVEL && std::max(depth.width, depth.height) >> levels > 0)
+            levels++;
+        hiZ.resize(levels);
+        hiZ[0] = FloatImage(depth.width, depth.height, 2);
+        for (size_t i = 0; i < depth.pixels.size(); i++)
+        {
+            // nothing rendered here: as far as the pyramid is concerned it is infinitely far away
+            float value = depth.pixels[i] <= 0.0f ? 10000.0f : depth.pixels[i];
+            hiZ[0].pixels[i * 2] = hiZ[0].pixels[i * 2 + 1] = value;
+        }
+        for (int level = 1; level < levels; level++)
+        {
+            const FloatImage &previous = hiZ[level - 1];
+            FloatImage &current = hiZ[level] = FloatImage(std::max(previous.width / 2, 1), std::max(previous.height / 2, 1), 2);
+            forTiles(current.width, current.height, [&](int x0, int y0, int x1, int y1)
+            {
+                for (int y = y0; y < y1; y++)
+                    for (int x = x0; x < x1; x++)
+                    {
+                        // a texel covers 2x2 of the level below, and the last row/column also takes the odd one out
+                        int extentX = 2 + (x == current.width - 1 ? previous.width & 1 : 0);
+                        int extentY = 2 + (y == current.height - 1 ? previous.height & 1 : 0);
+                        float nearest = 1e20f, farthest = 0.0f;
+                        for (int j = 0; j < extentY; j++)
+                            for (int i = 0; i < extentX; i++)
+                            {
+                                const float *texel = previous.at(std::min(x * 2 + i, previous.width - 1), std::min(y * 2 + j, previous.height - 1));
+                                nearest = std::min(nearest, texel[0]);
+                                farthest = std::max(farthest, texel[1]);
+                            }
+                        current.at(x, y)[0] = nearest;
+                        current.at(x, y)[1] = farthest;
+                    }
+            });
+        }
+    }
+
+    // the sample loop for LaneCount<T> pixels from (x, y) on
+    template <class T>
+    void occlusionSpan(const Pass &pass, int x, int y) const
+    {
+        const int lanes = LaneCount<T>::value;
+        const CpuGBuffer &gBuffer = *pass.gBuffer;
+        const CpuOcclusionSettings &settings = *pass.settings;
+        const int width = gBuffer.width(), height = gBuffer.height();
+        const int kernelSize = (int)settings.kernel.size();
+        const float radius = settings.radius;
+
+        // this pixel's own texel and its noise, tiled one texel per pixel
+        float depths[4], normals[3][4], noise[3][4], screenX[4];
+        bool covered = false;
+        for (int i = 0; i < lanes; i++)
+        {
+            depths[i] = *gBuffer.depth.at(x + i, y);
+            covered = covered || depths[i] > 0.0f;
+            const float *normal = gBuffer.normal.at(x + i, y);
+            int noiseX = (int)std::floor(x + i + 0.5f + settings.noiseOffset.x) % settings.noiseSize;
+            int noiseY = (int)std::floor(y + 0.5f + settings.noiseOffset.y) % settings.noiseSize;
+            const glm::vec3 &rotation = settings.noise[(noiseY + settings.noiseSize) % settings.noiseSize * settings.noiseSize +
+                                                       (noiseX + settings.noiseSize) % settings.noiseSize];
+            for (int c = 0; c < 3; c++)
+                normals[c][i] = normal[c];
+            noise[0][i] = rotation.x * settings.noiseRotation.x - rotation.y * settings.noiseRotation.y;
+            noise[1][i] = rotation.x * settings.noiseRotation.y + rotation.y * settings.noiseRotation.x;
+            noise[2][i] = rotation.z;
+            screenX[i] = (x + i + 0.5f) / width;
+        }
+        if (!covered)
+        {
+            for (int i = 0; i < lanes; i++)
+                writeEmpty(pass, x + i, y);
+            return;
+        }
+
+        T centerX = lanesLoad<T>(screenX), centerY = T((y + 0.5f) / height);
+        Vec3Lanes<T> fragPos = viewPosition(pass.invProjection, centerX, centerY, lanesLoad<T>(depths));
+        Vec3Lanes<T> normal(lanesLoad<T>(normals[0]), lanesLoad<T>(normals[1]), lanesLoad<T>(normals[2]));
+        Vec3Lanes<T> randomVec = lanesNormalize(Vec3Lanes<T>(lanesLoad<T>(noise[0]), lanesLoad<T>(noise[1]), lanesLoad<T>(noise[2])));
+        // create TBN change-of-basis matrix: from tangent-space to view-space
+        Vec3Lanes<T> tangent = lanesNormalize(randomVec - normal * lanesDot(randomVec, normal));
+        Vec3Lanes<T> bitangent = lanesCross(normal, tangent);
+        // and on to world space for the sky
+        const glm::mat3 &iview = pass.iview;
+        Vec3Lanes<T> worldTangent = rotate(iview, tangent), worldBitangent = rotate(iview, bitangent), worldNormal = rotate(iview, normal);
+
+        T occlusion(0.0f);
+        Vec3Lanes<T> directLight(T(0.0f), T(0.0f), T(0.0f)), indirectLight(T(0.0f), T(0.0f), T(0.0f));
+        const glm::mat4 &projection = pass.projection;
+        for (int s = 0; s < kernelSize; ++s)
+        {
+            const glm::vec3 &sample = settings.kernel[s];
+            Vec3Lanes<T> samplePos = fragPos + (tangent * sample.x + bitangent * sample.y + normal * sample.z) * radius;
+
+            // project sample position (to sample texture) (to get position on screen/texture)
+            T clipW = samplePos.x * projection[0][3] + samplePos.y * projection[1][3] + samplePos.z * projection[2][3] + projection[3][3];
+            T offsetX = (samplePos.x * projection[0][0] + samplePos.y * projection[1][0] + samplePos.z * projection[2][0] + projection[3][0]) / clipW * 0.5f + 0.5f;
+            T offsetY = (samplePos.x * projection[0][1] + samplePos.y * projection[1][1] + samplePos.z * projection[2][1] + projection[3][1]) / clipW * 0.5f + 0.5f;
+            T texelsX = (offsetX - centerX) * (float)width, texelsY = (offsetY - centerY) * (float)height;
+            T texels = lanesSqrt(texelsX * texelsX + texelsY * texelsY);
+
+            // the scattered reads, lane by lane: hiZRange(), and for SSDO the occluder's texel
+            float offsetsX[4], offsetsY[4], distances[4], nearestDepths[4], farthestDepths[4];
+            lanesStore(offsetX, offsetsX);
+            lanesStore(offsetY, offsetsY);
+            lanesStore(texels, distances);
+            for (int i = 0; i < lanes; i++)
+            {
+                int level = distances[i] >= 1.0f ? std::min(std::ilogb(distances[i]), 64) - HIZ_LOG_OFFSET : 0;
+                level = std::min(std::max(level, 0), (int)hiZ.size() - 1);
+                const FloatImage &depthLevel = hiZ[level];
+                const float *range = depthLevel.at(texelIndex(offsetsX[i], depthLevel.width), texelIndex(offsetsY[i], depthLevel.height));
+                nearestDepths[i] = -range[0];
+                farthestDepths[i] = -range[1];
+            }
+            // the farthest surface under the sample decides occlusion, the nearest the range check
+            T sampleDepth = lanesLoad<T>(farthestDepths);
+
+            // range check & accumulate
+            T rangeCheck = lanesMin(lanesMax(T(radius) / lanesAbs(fragPos.z - lanesLoad<T>(nearestDepths)), T(0.0f)), T(1.0f));
+            rangeCheck = rangeCheck * rangeCheck * (T(3.0f) - rangeCheck * 2.0f);
+            T occluded = lanesGreaterEqual(sampleDepth, samplePos.z);
+            occlusion = occlusion + lanesSelect(occluded, rangeCheck, T(0.0f));
+            if (!pass.directional)
+                continue;
+
+            if (lanesAny(occluded))
+            {
+                // the occluder's surface is only needed for the indirect bounce
+                float occluderDepths[4], occluderNormals[3][4], occluderColors[3][4];
+                for (int i = 0; i < lanes; i++)
+                {
+                    int texelX = texelIndex(offsetsX[i], width), texelY = texelIndex(offsetsY[i], height);
+                    occluderDepths[i] = *gBuffer.depth.at(texelX, texelY);
+                    const float *occluderNormal = gBuffer.normal.at(texelX, texelY), *occluderColor = gBuffer.albedo.at(texelX, texelY);
+                    for (int c = 0; c < 3; c++)
+                    {
+                        occluderNormals[c][i] = occluderNormal[c];
+                        occluderColors[c][i] = occluderColor[c];
+                    }
+                }
+                Vec3Lanes<T> samplePos1 = viewPosition(pass.invProjection, offsetX, offsetY, lanesLoad<T>(occluderDepths));
+                Vec3Lanes<T> sampleNormal(lanesLoad<T>(occluderNormals[0]), lanesLoad<T>(occluderNormals[1]), lanesLoad<T>(occluderNormals[2]));
+                Vec3Lanes<T> sampleColor(lanesLoad<T>(occluderColors[0]), lanesLoad<T>(occluderColors[1]), lanesLoad<T>(occluderColors[2]));
+                T bounce = lanesSelect(occluded, rangeCheck * lanesMax(lanesDot(sampleNormal, lanesNormalize(fragPos - samplePos1)), T(0.0f)), T(0.0f));
+                indirectLight = indirectLight + sampleColor * bounce;
+            }
+            Vec3Lanes<T> skyboxColor = skyRadiance(pass.skySH, lanesNormalize(worldTangent * sample.x + worldBitangent * sample.y + worldNormal * sample.z));
+            T facing = lanesSelect(occluded, T(0.0f), rangeCheck * lanesDot(normal, lanesNormalize(samplePos - fragPos)));
+            directLight = directLight + skyboxColor * facing;
+        }
+
+        float ambientOut[4], directionalOut[3][4];
+        lanesStore(T(1.0f) - occlusion / (float)kernelSize, ambientOut);
+        Vec3Lanes<T> light = directLight * (T(0.5f) / (float)kernelSize) + indirectLight * (T(5.0f) / (float)kernelSize);
+        lanesStore(light.x, directionalOut[0]);
+        lanesStore(light.y, directionalOut[1]);
+        lanesStore(light.z, directionalOut[2]);
+        for (int i = 0; i < lanes; i++)
+        {
+            if (depths[i] <= 0.0f)
+            {
+                writeEmpty(pass, x + i, y);
+                continue;
+            }
+            if (pass.ambient)
+                *pass.ambient->at(x + i, y) = ambientOut[i];
+            if (pass.directional)
+                for (int c = 0; c < 3; c++)
+                    pass.directional->at(x + i, y)[c] = directionalOut[c][i];
+        }
+    }
+
+    template <class T>
+    static Vec3Lanes<T> rotate(const glm::mat3 &m, const Vec3Lanes<T> &v)
+    {
+        return Vec3Lanes<T>(v.x * m[0][0] + v.y * m[1][0] + v.z * m[2][0],
+                            v.x * m[0][1] + v.y * m[1][1] + v.z * m[2][1],
+                            v.x * m[0][2] + v.y * m[1][2] + v.z * m[2][2]);
+    }
+
+    // nothing rendered: unoccluded and no directional light
+    static void writeEmpty(const Pass &pass, int x, int y)
+    {
+        if (pass.ambient)
+            *pass.ambient->at(x, y) = 1.0f;
+        if (pass.directional)
+            std::fill(pass.directional->at(x, y), pass.directional->at(x, y) + 3, 0.0f);
+    }
+
+    // what writing to an 8-bit normalized target keeps of the values
+    static void toUnorm8(FloatImage &image)
+    {
+        for (size_t i = 0; i < image.pixels.size(); i++)
+            image.pixels[i] = std::floor(std::min(std::max(image.pixels[i], 0.0f), 1.0f) * 255.0f + 0.5f) / 255.0f;
+    }
+
+    // one direction of the blur from source into target
+    void blurPass(const FloatImage &source, FloatImage &target, const CpuGBuffer &gBuffer, int radius, int directionX, int directionY)
+    {
+        const float depthSharpness = 50.0f, normalSharpness = 8.0f;
+        const float sigma = (radius + 1.0f) * 0.5f;
+        int width = source.width, height = source.height, channels = source.channels;
+        forTiles(width, height, [&](int x0, int y0, int x1, int y1)
+        {
+            for (int y = y0; y < y1; y++)
+                for (int x = x0; x < x1; x++)
+                {
+                    float depth = std::max(*gBuffer.depth.at(x, y), 1e-3f);
+                    glm::vec3 normal = glm::make_vec3(gBuffer.normal.at(x, y));
+                    float result[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                    for (int c = 0; c < channels; c++)
+                        result[c] = source.at(x, y)[c];
+                    float total = 1.0f;
+                    for (int i = 1; i <= radius; ++i)
+                    {
+                        float spatial = std::exp(-(float)(i * i) / (2.0f * sigma * sigma));
+                        for (int side = -1; side <= 1; side += 2)
+                        {
+                            int texelX = std::min(std::max(x + directionX * i * side, 0), width - 1);
+                            int texelY = std::min(std::max(y + directionY * i * side, 0), height - 1);
+                            float sampleDepth = *gBuffer.depth.at(texelX, texelY);
+                            glm::vec3 sampleNormal = glm::make_vec3(gBuffer.normal.at(texelX, texelY));
+                            float depthWeight = std::exp(-std::fabs(sampleDepth - depth) / depth * depthSharpness);
+                            float normalWeight = std::pow(std::max(glm::dot(normal, sampleNormal), 0.0f), normalSharpness);
+                            float weight = spatial * depthWeight * normalWeight;
+                            for (int c = 0; c < channels; c++)
+                                result[c] += source.at(texelX, texelY)[c] * weight;
+                            total += weight;
+                        }
+                    }
+                    for (int c = 0; c < channels; c++)
+                        target.at(x, y)[c] = result[c] / total;
+                }
+        });
+    }
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <chrono>
+#include <mutex>
+#include <iostream>
+#include <algorithm>
+
+// CPU time of scopes on any thread, written out as Chrome trace_event JSON (chrome://tracing or
+// ui.perfetto.dev). CPU_PROFILE_SCOPE("name") times the rest of the enclosing block; the name must be
+// a string literal. Every thread records into its own buffer without locking: the first HEAD_EVENTS
+// events are kept for good, so startup stays in the trace, and later ones go around a ring of the
+// last RING_EVENTS, the steady-state frames. The scopes only exist when CPU_PROFILER is defined
+// (cmake -DSSDO_CPU_PROFILER=ON); otherwise they compile to nothing and writeTrace() only reports it.
+
+#ifdef CPU_PROFILER
+#define CPU_PROFILE_CONCAT_INNER(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_INNER(a, b)
+#define CPU_PROFILE_SCOPE(name) CpuProfileScope CPU_PROFILE_CONCAT(cpuProfileScope, __LINE__)(name)
+#define CPU_PROFILE_THREAD(name) CpuProfiler::instance().setThreadName(name)
+#else
+#define CPU_PROFILE_SCOPE(name) ((void)0)
+#define CPU_PROFILE_THREAD(name) ((void)0)
+#endif
+
+class CpuProfiler
+{
+public:
+    static const size_t HEAD_EVENTS = 16384;
+    static const size_t RING_EVENTS = 65536;
+
+    static CpuProfiler &instance()
+    {
+        static CpuProfiler profiler;
+        return profiler;
+    }
+
+    ~CpuProfiler()
+    {
+        for (size_t i = 0; i < buffers.size(); i++)
+            delete buffers[i];
+    }
+
+    // nanoseconds since the profiler was first used
+    static unsigned long long now()
+    {
+        static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+        return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - origin).count();
+    }
+
+    // adds a finished scope to the calling thread's buffer
+    void record(const char *name, unsigned long long start, unsigned long long end)
+    {
+        ThreadBuffer &buffer = threadBuffer();
+        Event event = { name, start, end - start };
+        if (buffer.head.size() < HEAD_EVENTS)
+        {
+            buffer.head.push_back(event);
+            return;
+        }
+        if (buffer.ring.empty())
+            buffer.ring.resize(RING_EVENTS);
+        buffer.ring[buffer.ringWritten++ % RING_EVENTS] = event;
+    }
+
+    // labels the calling thread's row in the trace
+    void setThreadName(const char *name)
+    {
+        threadBuffer().name = name;
+    }
+
+    // writes every thread's events; the other threads must not be inside a scope meanwhile
+    bool writeTrace(const std::string &path)
+    {
+#ifndef CPU_PROFILER
+        std::cout << "ERROR::CPU_PROFILER:: built without CPU_PROFILER, configure with -DSSDO_CPU_PROFILER=ON to record "
+                  << path << std::endl;
+        return false;
+#else
+        FILE *file = fopen(path.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "ERROR::CPU_PROFILER:: cannot write " << path << std::endl;
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        size_t total = 0, dropped = 0;
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool first = true;
+        for (size_t t = 0; t < buffers.size(); t++)
+        {
+            const ThreadBuffer &buffer = *buffers[t];
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buffer.id, escape(buffer.name).c_str());
+            first = false;
+            for (size_t i = 0; i < buffer.head.size(); i++)
+                writeEvent(file, buffer.head[i], buffer.id);
+            // the ring from its oldest event on, after a marker where it lost events
+            size_t kept = std::min(buffer.ringWritten, (size_t)RING_EVENTS);
+            size_t oldest = buffer.ringWritten - kept;
+            if (oldest > 0)
+                fprintf(file, ",\n{\"name\":\"%lu events dropped\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                        (unsigned long)oldest, buffer.ring[oldest % RING_EVENTS].start / 1000.0, buffer.id);
+            for (size_t i = oldest; i < buffer.ringWritten; i++)
+                writeEvent(file, buffer.ring[i % RING_EVENTS], buffer.id);
+            total += buffer.head.size() + kept;
+            dropped += oldest;
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        printf("cpu trace: %lu events of %d threads written to %s, %lu dropped\n",
+               (unsigned long)total, (int)buffers.size(), path.c_str(), (unsigned long)dropped);
+        return true;
+#endif
+    }
+
+private:
+    struct Event
+    {
+        const char *name;
+        unsigned long long start;
+        unsigned long long duration;
+    };
+
+    struct ThreadBuffer
+    {
+        unsigned int id;
+        std::string name;
+        std::vector<Event> head;
+        // allocated once the head is full
+        std::vector<Event> ring;
+        size_t ringWritten;
+    };
+
+    // owned here rather than by the threads, so the events of finished threads still get written
+    std::vector<ThreadBuffer *> buffers;
+    std::mutex buffersMutex;
+
+    CpuProfiler() {}
+    CpuProfiler(const CpuProfiler &);
+    CpuProfiler &operator=(const CpuProfiler &);
+
+    // the calling thread's buffer, registered on its first event
+    ThreadBuffer &threadBuffer()
+    {
+        static thread_local ThreadBuffer *buffer = NULL;
+        if (!buffer)
+        {
+            buffer = new ThreadBuffer();
+            buffer->head.reserve(HEAD_EVENTS);
+            buffer->ringWritten = 0;
+            std::lock_guard<std::mutex> lock(buffersMutex);
+            buffer->id = (unsigned int)buffers.size() + 1;
+            buffer->name = "thread " + std::to_string(buffer->id);
+            buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    static void writeEvent(FILE *file, const Event &event, unsigned int id)
+    {
+        fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                escape(event.name).c_str(), event.start / 1000.0, event.duration / 1000.0, id);
+    }
+
+    static std::string escape(const std::string &text)
+    {
+        std::string escaped;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '"' || text[i] == '\\')
+                escaped += '\\';
+            escaped += text[i];
+        }
+        return escaped;
+    }
+};
+
+// times its own lifetime
+class CpuProfileScope
+{
+public:
+    explicit CpuProfileScope(const char *name) : name(name), start(CpuProfiler::now()) {}
+    ~CpuProfileScope() { CpuProfiler::instance().record(name, start, CpuProfiler::now()); }
+
+private:
+    const char *name;
+    unsigned long long start;
+
+    CpuProfileScope(const CpuProfileScope &);
+    CpuProfileScope &operator=(const CpuProfileScope &);
+};
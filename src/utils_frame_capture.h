@@ -0,0 +1,171 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include "gl_env.h"
+
+#include <glm/glm.hpp>
+
+#include "utils_light.h"
+#include "utils_sky_sh.h"
+#include "utils_cpu_occlusion.h"
+#include "renderer_settings.h"
+
+// Reads a rendered frame back as the CPU reference (utils_cpu_occlusion.h) takes it. The g-buffer
+// is decoded the way common/gbuffer.glsl decodes it: normals from their 16-bit octahedral texels and
+// albedo at its 8 bits, so the reference sees the same inputs as the shaders. The blurred SSAO/SSDO
+// the lighting pass read come along as the GPU's result to diff against. saveCapture() writes all
+// of it as a frame directory for OcclusionReference.
+
+// the targets and uniforms of an occlusion renderer's last frame; the renderers keep one up to date
+struct FrameCapture
+{
+    GLuint gDepth, gNormal, gAlbedo;
+    // the blurred occlusion at the render size, 0 for the pass a renderer does not have
+    GLuint ssao, ssdo;
+    // the rendered part of the targets, from their lower left corner; 0 until the first frame
+    int width, height;
+    glm::mat4 projection, view;
+    glm::vec3 skySH[SkySH::COEFFICIENTS];
+    std::vector<CpuLight> lights; // in view space
+    RendererSettings settings;
+
+    FrameCapture() : gDepth(0), gNormal(0), gAlbedo(0), ssao(0), ssdo(0), width(0), height(0), settings(RendererSettings::medium()) {}
+
+    void setTargets(GLuint gDepth, GLuint gNormal, GLuint gAlbedo, GLuint ssao, GLuint ssdo)
+    {
+        this->gDepth = gDepth;
+        this->gNormal = gNormal;
+        this->gAlbedo = gAlbedo;
+        this->ssao = ssao;
+        this->ssdo = ssdo;
+    }
+
+    void setFrame(const glm::mat4 &projection, const glm::mat4 &view, const std::vector<Light> &lights,
+                  const RendererSettings &settings, int width, int height)
+    {
+        this->projection = projection;
+        this->view = view;
+        this->settings = settings;
+        this->width = width;
+        this->height = height;
+        this->lights.resize(lights.size());
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            CpuLight &light = this->lights[i];
+            light.position = glm::vec3(view * glm::vec4(lights[i].lightPos, 1.0f));
+            light.color = lights[i].lightColor;
+            light.linear = lights[i].linear;
+            light.quadratic = lights[i].quadratic;
+            light.radius = lights[i].radius();
+        }
+    }
+
+    void setSky(const SkySH &sky)
+    {
+        std::copy(sky.coefficients, sky.coefficients + SkySH::COEFFICIENTS, skySH);
+    }
+};
+
+// level 0 of a 2D texture as floats in format's channels, cropped to width x height
+inline FloatImage readTexture(GLuint texture, GLenum format, int channels, int width, int height)
+{
+    GLint textureWidth, textureHeight;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &textureWidth);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &textureHeight);
+    std::vector<float> texels((size_t)textureWidth * textureHeight * channels);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D, 0, format, GL_FLOAT, &texels[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    FloatImage image(std::min(width, (int)textureWidth), std::min(height, (int)textureHeight), channels);
+    for (int y = 0; y < image.height; y++)
+        std::copy(&texels[(size_t)y * textureWidth * channels], &texels[((size_t)y * textureWidth + image.width) * channels], image.at(0, y));
+    return image;
+}
+
+// common/gbuffer.glsl's decodeNormal
+inline glm::vec3 decodeNormal(glm::vec2 e)
+{
+    e = e * 2.0f - 1.0f;
+    glm::vec3 n(e, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    if (n.z < 0.0f)
+    {
+        // octWrap
+        glm::vec2 wrapped = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+        n.x = wrapped.x;
+        n.y = wrapped.y;
+    }
+    return glm::normalize(n);
+}
+
+// the g-buffer of the capture as the occlusion passes read it, and the GPU's occlusion into ssao
+// and ssdo where the renderer has them (left empty otherwise; either may be NULL)
+inline void readCapture(const FrameCapture &capture, CpuGBuffer &gBuffer, CpuFrame &frame, FloatImage *ssao, FloatImage *ssdo)
+{
+    gBuffer.depth = readTexture(capture.gDepth, GL_RED, 1, capture.width, capture.height);
+    FloatImage encoded = readTexture(capture.gNormal, GL_RG, 2, capture.width, capture.height);
+    gBuffer.normal = FloatImage(encoded.width, encoded.height, 3);
+    for (int y = 0; y < encoded.height; y++)
+        for (int x = 0; x < encoded.width; x++)
+        {
+            glm::vec3 normal = decodeNormal(glm::vec2(encoded.at(x, y)[0], encoded.at(x, y)[1]));
+            std::copy(&normal[0], &normal[0] + 3, gBuffer.normal.at(x, y));
+        }
+    FloatImage albedo = readTexture(capture.gAlbedo, GL_RGBA, 4, capture.width, capture.height);
+    gBuffer.albedo = FloatImage(albedo.width, albedo.height, 3);
+    gBuffer.specular = FloatImage(albedo.width, albedo.height, 1);
+    for (size_t i = 0; i < (size_t)albedo.width * albedo.height; i++)
+    {
+        std::copy(&albedo.pixels[i * 4], &albedo.pixels[i * 4 + 3], &gBuffer.albedo.pixels[i * 3]);
+        gBuffer.specular.pixels[i] = albedo.pixels[i * 4 + 3];
+    }
+
+    frame.projection = capture.projection;
+    frame.view = capture.view;
+    std::copy(capture.skySH, capture.skySH + SkySH::COEFFICIENTS, frame.skySH);
+    frame.lights = capture.lights;
+
+    if (ssao)
+        *ssao = capture.ssao ? readTexture(capture.ssao, GL_RED, 1, capture.width, capture.height) : FloatImage();
+    if (ssdo)
+        *ssdo = capture.ssdo ? readTexture(capture.ssdo, GL_RGB, 3, capture.width, capture.height) : FloatImage();
+}
+
+// the capture as a frame directory: depth.pfm, normal.pfm, albedo.pfm, specular.pfm and frame.txt,
+// plus gpu_ssao.pfm and gpu_ssdo.pfm; frame.txt names the setting to run OcclusionReference with
+inline bool saveCapture(const FrameCapture &capture, const std::string &directory)
+{
+    if (capture.width == 0)
+    {
+        std::cout << "ERROR::FRAME_CAPTURE:: nothing rendered to capture" << std::endl;
+        return false;
+    }
+    CpuGBuffer gBuffer;
+    CpuFrame frame;
+    FloatImage ssao, ssdo;
+    readCapture(capture, gBuffer, frame, &ssao, &ssdo);
+
+    const RendererSettings &settings = capture.settings;
+    std::ostringstream comment;
+    comment << "captured at " << capture.width << "x" << capture.height << ": --samples " << settings.kernelSize
+            << " --radius " << settings.radius << " --blur " << settings.blurRadius << " --sampling "
+            << (settings.sampling == SAMPLING_LOW_DISCREPANCY ? "low-discrepancy" : "random") << "\n";
+    // what the reference does not mirror, so the GPU's occlusion is not comparable
+    if (settings.downsample > 1 || settings.temporal || settings.method != AO_HEMISPHERE || settings.sky != SKY_HARMONICS)
+        comment << "not comparable to gpu_ssao/gpu_ssdo: downsampled, temporal, horizon or prefiltered sky\n";
+
+    bool written = gBuffer.depth.savePfm(directory + "/depth.pfm") && gBuffer.normal.savePfm(directory + "/normal.pfm") &&
+                   gBuffer.albedo.savePfm(directory + "/albedo.pfm") && gBuffer.specular.savePfm(directory + "/specular.pfm") &&
+                   frame.save(directory + "/frame.txt", comment.str());
+    if (written && !ssao.empty())
+        written = ssao.savePfm(directory + "/gpu_ssao.pfm");
+    if (written && !ssdo.empty())
+        written = ssdo.savePfm(directory + "/gpu_ssdo.pfm");
+    return written;
+}
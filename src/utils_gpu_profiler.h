@@ -0,0 +1,255 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+
+#include "utils_shader_program.h"
+
+// GPU time of every render pass. The renderers mark where each pass starts with pass(), which ends
+// the previous one, so the frame is covered by back-to-back GL_TIME_ELAPSED queries. The queries
+// are double-buffered: endFrame() reads the previous frame's set, and only once all of it is
+// available, so the profiler never waits on the GPU. Results feed a rolling per-pass average for
+// the overlay bar and the window title, and optionally one CSV row per pass and frame.
+class GpuProfiler
+{
+public:
+    // time of one pass, averaged over the last frames
+    struct PassTime
+    {
+        std::string name;
+        double ms;
+        double lastMs;
+    };
+
+    // the budget the overlay bar spans
+    static const int BUDGET_MS = 16;
+
+    bool enabled;
+
+    static GpuProfiler &instance()
+    {
+        static GpuProfiler profiler;
+        return profiler;
+    }
+
+    ~GpuProfiler()
+    {
+        if (csv)
+            fclose(csv);
+    }
+
+    // ends the running pass, if any, and times the GPU work from here on as `name`
+    void pass(const char *name)
+    {
+        if (!enabled)
+            return;
+        end();
+        Frame &frame = frames[current];
+        if (frame.count == frame.queries.size())
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+            frame.names.push_back(std::string());
+        }
+        frame.names[frame.count] = name;
+        glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.count++]);
+        running = true;
+    }
+
+    // ends the running pass; work after it goes untimed until the next pass()
+    void end()
+    {
+        if (!running)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        running = false;
+    }
+
+    // closes this frame's queries and collects the previous frame's
+    void endFrame()
+    {
+        end();
+        frames[current].frameNumber = frameNumber++;
+        current = 1 - current;
+        collect(frames[current]);
+    }
+
+    // streams every collected frame to path as frame,pass,ms rows
+    bool openCsv(const std::string &path)
+    {
+        if (csv)
+            fclose(csv);
+        csv = fopen(path.c_str(), "w");
+        if (!csv)
+        {
+            std::cout << "ERROR::GPU_PROFILER:: cannot write " << path << std::endl;
+            return false;
+        }
+        fprintf(csv, "frame,pass,ms\n");
+        return true;
+    }
+
+    const std::vector<PassTime> &passes() const { return averages; }
+
+    // averaged pass time by name, 0 when it did not run lately
+    double averageMs(const std::string &name) const
+    {
+        for (size_t i = 0; i < averages.size(); i++)
+            if (averages[i].name == name)
+                return averages[i].ms;
+        return 0.0;
+    }
+
+    // latest collected pass time by name, 0 when it did not run in that frame
+    double lastMs(const std::string &name) const
+    {
+        for (size_t i = 0; i < averages.size(); i++)
+            if (averages[i].name == name)
+                return averages[i].lastMs;
+        return 0.0;
+    }
+
+    // "GPU 3.21 ms | geometry 0.41 | ssao 1.20 | ..." in the order of the passes
+    std::string summary() const
+    {
+        double total = 0.0;
+        std::string text;
+        char buffer[64];
+        for (size_t i = 0; i < averages.size(); i++)
+        {
+            total += averages[i].ms;
+            snprintf(buffer, sizeof(buffer), " | %s %.2f", averages[i].name.c_str(), averages[i].ms);
+            text += buffer;
+        }
+        snprintf(buffer, sizeof(buffer), "GPU %.2f ms", total);
+        return buffer + text;
+    }
+
+    // stacked bar of the averaged passes along the top of the current framebuffer, BUDGET_MS wide;
+    // the colors follow the order of summary()
+    void drawOverlay()
+    {
+        if (averages.empty())
+            return;
+        if (!overlayVAO)
+            createOverlay();
+        glDisable(GL_DEPTH_TEST);
+        shaderOverlay.use();
+        glBindVertexArray(overlayVAO);
+        // the budget as a dark backdrop, then the passes from the left
+        shaderOverlay.setVec4("rect", glm::vec4(-0.95f, 0.93f, 0.95f, 0.97f));
+        shaderOverlay.setVec3("color", glm::vec3(0.15f));
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        float x = -0.95f;
+        for (size_t i = 0; i < averages.size() && x < 0.95f; i++)
+        {
+            float right = std::min(0.95f, x + 1.9f * (float)(averages[i].ms / BUDGET_MS));
+            shaderOverlay.setVec4("rect", glm::vec4(x, 0.93f, right, 0.97f));
+            shaderOverlay.setVec3("color", paletteColor(i));
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            x = right;
+        }
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+private:
+    // one frame's queries in the order the passes ran
+    struct Frame
+    {
+        std::vector<GLuint> queries;
+        std::vector<std::string> names;
+        size_t count;
+        unsigned long frameNumber;
+        Frame() : count(0), frameNumber(0) {}
+    };
+
+    Frame frames[2];
+    int current;
+    bool running;
+    unsigned long frameNumber;
+    std::vector<PassTime> averages;
+    FILE *csv;
+
+    ShaderProgram shaderOverlay;
+    GLuint overlayVAO, overlayVBO;
+
+    GpuProfiler() : enabled(true), current(0), running(false), frameNumber(0), csv(NULL), overlayVAO(0), overlayVBO(0) {}
+    GpuProfiler(const GpuProfiler &);
+    GpuProfiler &operator=(const GpuProfiler &);
+
+    void collect(Frame &frame)
+    {
+        if (frame.count == 0)
+            return;
+        // the queries finish in order, so the last one being ready means all are
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            frame.count = 0;
+            return;
+        }
+
+        std::vector<PassTime> updated;
+        for (size_t i = 0; i < frame.count; i++)
+        {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &elapsed);
+            double ms = elapsed / 1.0e6;
+            // a pass marked twice in a frame adds up
+            size_t j = 0;
+            while (j < updated.size() && updated[j].name != frame.names[i])
+                j++;
+            if (j == updated.size())
+            {
+                PassTime time = { frame.names[i], 0.0, 0.0 };
+                updated.push_back(time);
+            }
+            updated[j].lastMs += ms;
+        }
+        // passes that stopped running drop out, new ones start from their first time
+        double total = 0.0;
+        for (size_t i = 0; i < updated.size(); i++)
+        {
+            double previous = averageMs(updated[i].name);
+            updated[i].ms = previous > 0.0 ? previous + (updated[i].lastMs - previous) * 0.05 : updated[i].lastMs;
+            total += updated[i].lastMs;
+            if (csv)
+                fprintf(csv, "%lu,%s,%.4f\n", frame.frameNumber, updated[i].name.c_str(), updated[i].lastMs);
+        }
+        if (csv)
+            fprintf(csv, "%lu,total,%.4f\n", frame.frameNumber, total);
+        averages = updated;
+        frame.count = 0;
+    }
+
+    static glm::vec3 paletteColor(size_t i)
+    {
+        static const float PALETTE[8][3] = {
+            { 0.90f, 0.30f, 0.25f }, { 0.95f, 0.65f, 0.20f }, { 0.90f, 0.90f, 0.30f }, { 0.40f, 0.80f, 0.35f },
+            { 0.30f, 0.75f, 0.85f }, { 0.35f, 0.45f, 0.90f }, { 0.70f, 0.40f, 0.85f }, { 0.85f, 0.85f, 0.85f } };
+        const float *color = PALETTE[i % 8];
+        return glm::vec3(color[0], color[1], color[2]);
+    }
+
+    void createOverlay()
+    {
+        shaderOverlay = ShaderProgram(SRC_DIR"/src/shader/image/profile.vs", SRC_DIR"/src/shader/image/profile.fs");
+        float corners[] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+        glGenVertexArrays(1, &overlayVAO);
+        glGenBuffers(1, &overlayVBO);
+        glBindVertexArray(overlayVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, overlayVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glBindVertexArray(0);
+    }
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+// an RGBA8 image, rows bottom to top as glReadPixels returns them
+struct Image
+{
+    int width, height;
+    std::vector<unsigned char> pixels;
+
+    Image() : width(0), height(0) {}
+    Image(int width, int height) : width(width), height(height), pixels((size_t)width * height * 4, 0) {}
+
+    // the files are stored top to bottom like any PNG
+    bool savePng(const std::string &path) const
+    {
+        std::vector<unsigned char> flipped = flip();
+        if (!stbi_write_png(path.c_str(), width, height, 4, &flipped[0], width * 4))
+        {
+            std::cout << "ERROR::IMAGE:: cannot write " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool loadPng(const std::string &path)
+    {
+        int channels;
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+        if (!data)
+            return false;
+        pixels.assign(data, data + (size_t)width * height * 4);
+        stbi_image_free(data);
+        pixels = flip();
+        return true;
+    }
+
+private:
+    // stbi_set_flip_vertically_on_load is global state, so flip here instead
+    std::vector<unsigned char> flip() const
+    {
+        std::vector<unsigned char> flipped(pixels.size());
+        size_t rowSize = (size_t)width * 4;
+        for (int y = 0; y < height; y++)
+            std::memcpy(&flipped[(size_t)(height - 1 - y) * rowSize], &pixels[(size_t)y * rowSize], rowSize);
+        return flipped;
+    }
+};
+
+// how close an image is to a reference
+struct ImageComparison
+{
+    // over the RGB channels, capped at MAX_PSNR for identical images
+    double psnr;
+    // mean structural similarity of the luma, 11x11 Gaussian windows (sigma 1.5) as in Wang et al. 2004
+    double ssim;
+
+    static const int MAX_PSNR = 100;
+};
+
+inline ImageComparison compareImages(const Image &image, const Image &reference)
+{
+    ImageComparison result = { 0.0, 0.0 };
+    if (image.width != reference.width || image.height != reference.height || image.pixels.empty())
+        return result;
+    int width = image.width, height = image.height;
+    size_t count = (size_t)width * height;
+
+    // PSNR and the luma of both
+    double squaredError = 0.0;
+    std::vector<float> x(count), y(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const unsigned char *a = &image.pixels[i * 4], *b = &reference.pixels[i * 4];
+        for (int c = 0; c < 3; c++)
+        {
+            double d = (double)a[c] - (double)b[c];
+            squaredError += d * d;
+        }
+        x[i] = 0.299f * a[0] + 0.587f * a[1] + 0.114f * a[2];
+        y[i] = 0.299f * b[0] + 0.587f * b[1] + 0.114f * b[2];
+    }
+    double mse = squaredError / (count * 3.0);
+    result.psnr = mse > 0.0 ? std::min((double)ImageComparison::MAX_PSNR, 10.0 * std::log10(255.0 * 255.0 / mse))
+                            : (double)ImageComparison::MAX_PSNR;
+
+    // local means, variances and covariance through a separable Gaussian, clamped at the borders
+    const int radius = 5;
+    float weights[2 * radius + 1], weightSum = 0.0f;
+    for (int i = -radius; i <= radius; i++)
+        weightSum += weights[i + radius] = std::exp(-(float)(i * i) / (2.0f * 1.5f * 1.5f));
+    for (int i = 0; i <= 2 * radius; i++)
+        weights[i] /= weightSum;
+    std::vector<float> xx(count), yy(count), xy(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        xx[i] = x[i] * x[i];
+        yy[i] = y[i] * y[i];
+        xy[i] = x[i] * y[i];
+    }
+    std::vector<float> scratch(count);
+    std::vector<float> *maps[5] = { &x, &y, &xx, &yy, &xy };
+    for (int m = 0; m < 5; m++)
+    {
+        std::vector<float> &map = *maps[m];
+        for (int row = 0; row < height; row++)
+            for (int column = 0; column < width; column++)
+            {
+                float sum = 0.0f;
+                for (int i = -radius; i <= radius; i++)
+                    sum += weights[i + radius] * map[(size_t)row * width + std::min(std::max(column + i, 0), width - 1)];
+                scratch[(size_t)row * width + column] = sum;
+            }
+        for (int row = 0; row < height; row++)
+            for (int column = 0; column < width; column++)
+            {
+                float sum = 0.0f;
+                for (int i = -radius; i <= radius; i++)
+                    sum += weights[i + radius] * scratch[(size_t)std::min(std::max(row + i, 0), height - 1) * width + column];
+                map[(size_t)row * width + column] = sum;
+            }
+    }
+    const double c1 = (0.01 * 255.0) * (0.01 * 255.0), c2 = (0.03 * 255.0) * (0.03 * 255.0);
+    double ssimSum = 0.0;
+    for (size_t i = 0; i < count; i++)
+    {
+        double muX = x[i], muY = y[i];
+        double varianceX = std::max(0.0, xx[i] - muX * muX), varianceY = std::max(0.0, yy[i] - muY * muY);
+        double covariance = xy[i] - muX * muY;
+        ssimSum += ((2.0 * muX * muY + c1) * (2.0 * covariance + c2)) /
+                   ((muX * muX + muY * muY + c1) * (varianceX + varianceY + c2));
+    }
+    result.ssim = ssimSum / count;
+    return result;
+}
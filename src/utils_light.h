@@ -2,6 +2,11 @@
 
 #include "gl_env.h"
 
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
@@ -13,10 +18,42 @@ public:
     glm::vec3 lightPos;
     // color
     glm::vec3 lightColor;
+    // attenuation 1 / (1 + linear * d + quadratic * d^2)
+    float linear, quadratic;
 
-    Light(glm::vec3 pos, glm::vec3 color)
+    Light(glm::vec3 pos, glm::vec3 color, float linear = 0.7f, float quadratic = 1.8f)
     {
         lightPos = pos;
         lightColor = color;
+        this->linear = linear;
+        this->quadratic = quadratic;
+    }
+
+    // distance at which the brightest channel falls below 5/256, the lighting pass ignores the light beyond it
+    float radius() const
+    {
+        float brightest = std::max(std::max(lightColor.r, lightColor.g), lightColor.b);
+        return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * (1.0f - brightest * 256.0f / 5.0f))) / (2.0f * quadratic);
+    }
+};
+
+// the scene's lights: count of them at seeded random positions and colors, the same on every run;
+// more lights get shorter ranges so the scene keeps its brightness
+inline std::vector<Light> scatterLights(unsigned int count)
+{
+    std::vector<Light> lights;
+    srand(114514);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        // calculate slightly random offsets
+        float xPos = static_cast<float>(((rand() % 100) / 100.0) * 4.0 - 2.0);
+        float yPos = static_cast<float>(((rand() % 100) / 100.0) * 4.0 - 2.0);
+        float zPos = static_cast<float>(((rand() % 100) / 100.0) * 8.0 - 4.0);
+        // also calculate random color
+        float rColor = static_cast<float>(((rand() % 100) / 200.0f) + 0.5); // between 0.5 and 1.0
+        float gColor = static_cast<float>(((rand() % 100) / 200.0f) + 0.5); // between 0.5 and 1.0
+        float bColor = static_cast<float>(((rand() % 100) / 200.0f) + 0.5); // between 0.5 and 1.0
+        lights.push_back(Light(glm::vec3(xPos, yPos, zPos), glm::vec3(rColor, gColor, bColor), 0.7f, 1.8f * count / 8.0f));
     }
-};
\ No newline at end of file
+    return lights;
+}
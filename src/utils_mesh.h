@@ -6,87 +6,115 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "utils_shader_program.h"
+#include "utils_vertex_layout.h"
 
 #include <string>
 #include <vector>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-	//bone indexes which will influence this vertex
-	int m_BoneIDs[MAX_BONE_INFLUENCE];
-	//weights from each bone
-	float m_Weights[MAX_BONE_INFLUENCE];
-};
-
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
+// sampler uniform of each texture, following the texture_diffuseN/texture_specularN/... convention
+inline vector<string> samplerNames(const vector<Texture> &textures)
+{
+    unsigned int diffuseNr  = 1;
+    unsigned int specularNr = 1;
+    unsigned int normalNr   = 1;
+    unsigned int heightNr   = 1;
+    vector<string> samplers;
+    for(unsigned int i = 0; i < textures.size(); i++)
+    {
+        // retrieve texture number (the N in diffuse_textureN)
+        string number;
+        string name = textures[i].type;
+        if(name == "texture_diffuse")
+            number = std::to_string(diffuseNr++);
+        else if(name == "texture_specular")
+            number = std::to_string(specularNr++); // transfer unsigned int to string
+        else if(name == "texture_normal")
+            number = std::to_string(normalNr++); // transfer unsigned int to string
+        else if(name == "texture_height")
+            number = std::to_string(heightNr++); // transfer unsigned int to string
+        samplers.push_back(name + number);
+    }
+    return samplers;
+}
+
+// one imported mesh before it reaches the GPU
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    vector<Texture>      textures;
+    unsigned int streams;
+    unsigned int material;
+};
+
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    vector<string>       samplers;
     unsigned int VAO;
+    unsigned int indexCount;
+    // streams the mesh has data for (see VertexStream) and how they are stored in the VBO
+    unsigned int streams;
+    VertexLayout layout;
+    size_t vertexBytes;
 
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,
+         unsigned int streams = STREAM_ALL, VertexLayout layout = VERTEX_LAYOUT_FULL)
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->samplers = samplerNames(textures);
+        this->streams = streams;
+        this->layout = layout;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(vertices.empty() ? NULL : &vertices[0], vertices.size(), indices.empty() ? NULL : &indices[0], indices.size());
+    }
+
+    // constructor for data that already lives elsewhere (e.g. a memory-mapped mesh cache).
+    // the data is uploaded straight into the VBO/EBO and no CPU-side copy is kept.
+    Mesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount, vector<Texture> textures,
+         unsigned int streams = STREAM_ALL, VertexLayout layout = VERTEX_LAYOUT_FULL)
+    {
+        this->textures = textures;
+        this->samplers = samplerNames(textures);
+        this->streams = streams;
+        this->layout = layout;
+        setupMesh(vertexData, vertexCount, indexData, indexCount);
     }
 
     // render the mesh
     void Draw(ShaderProgram &shaderProgram)
     {
         // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
             glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-             else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
             // now set the sampler to the correct texture unit
-            glUniform1i(shaderProgram.locateUnifrom((name + number).c_str()), i);
+            glUniform1i(shaderProgram.locateUnifrom(samplers[i]), i);
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
 
+        // how to decode the vertex layout
+        glUniform3fv(shaderProgram.locateUnifrom("positionScale"), 1, &positionScale[0]);
+        glUniform3fv(shaderProgram.locateUnifrom("positionOffset"), 1, &positionOffset[0]);
+        glUniform1i(shaderProgram.locateUnifrom("octNormals"), octNormals);
+
         // draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
@@ -96,49 +124,36 @@ public:
 private:
     // render data
     unsigned int VBO, EBO;
+    glm::vec3 positionScale, positionOffset;
+    bool octNormals;
 
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount)
     {
+        this->indexCount = static_cast<unsigned int>(indexCount);
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
+        // encode the streams the layout keeps
+        EncodedVertices encoded = VertexEncoder::encode(vertexData, vertexCount, layout, streams);
+        positionScale = encoded.positionScale;
+        positionOffset = encoded.positionOffset;
+        octNormals = encoded.octNormals;
+        vertexBytes = encoded.data.size();
+
         glBindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, encoded.data.size(), encoded.data.empty() ? NULL : &encoded.data[0], GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+
+        // set the vertex attribute pointers to match the encoded layout
+        VertexEncoder::applyAttributes(encoded);
         glBindVertexArray(0);
     }
 };
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <glm/glm.hpp>
+
+#include "utils_shader_program.h"
+#include "utils_mesh.h"
+#include "utils_vertex_layout.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+// one entry of the per-mesh draw table
+struct BatchMesh {
+    unsigned int firstVertex;
+    unsigned int vertexCount;
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    unsigned int material;
+};
+
+// one draw call: a contiguous index range whose meshes all share a material
+struct BatchDraw {
+    unsigned int material;
+    unsigned int firstIndex;
+    unsigned int indexCount;
+};
+
+// the textures of one material and the sampler each one goes to
+struct BatchMaterial {
+    vector<Texture> textures;
+    vector<string> samplers;
+};
+
+// All meshes of a model in one VBO/EBO behind one VAO. The index buffer is ordered by material and
+// already offset by each mesh's first vertex, so every material is a single glDrawElements and a
+// geometry pass costs one draw call per material instead of one per mesh.
+class MeshBatch {
+public:
+    vector<BatchMesh>     meshes;
+    vector<BatchDraw>     draws;
+    vector<BatchMaterial> materials;
+    unsigned int VAO;
+    size_t vertexBytes;
+
+    MeshBatch() : VAO(0), vertexBytes(0), VBO(0), EBO(0), streams(0) {}
+
+    // stages a mesh; nothing is uploaded until build()
+    void add(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount,
+             unsigned int material, const vector<Texture> &textures, unsigned int meshStreams)
+    {
+        if (material >= materials.size())
+            materials.resize(material + 1);
+        if (materials[material].textures.empty() && !textures.empty())
+        {
+            materials[material].textures = textures;
+            materials[material].samplers = samplerNames(textures);
+        }
+
+        BatchMesh mesh;
+        mesh.firstVertex = (unsigned int)stagedVertices.size();
+        mesh.vertexCount = (unsigned int)vertexCount;
+        mesh.firstIndex = (unsigned int)stagedIndices.size();
+        mesh.indexCount = (unsigned int)indexCount;
+        mesh.material = material;
+        meshes.push_back(mesh);
+
+        stagedVertices.insert(stagedVertices.end(), vertexData, vertexData + vertexCount);
+        stagedIndices.insert(stagedIndices.end(), indexData, indexData + indexCount);
+        // the shared buffer carries the union of all streams, so zero what this mesh doesn't have
+        for (size_t i = mesh.firstVertex; i < stagedVertices.size(); i++)
+            clearMissing(stagedVertices[i], meshStreams);
+        streams |= meshStreams;
+    }
+
+    // sorts the staged meshes by material, merges them into one buffer pair and frees the staging copy
+    void build(const VertexLayout &layout)
+    {
+        vector<unsigned int> order(meshes.size());
+        for (unsigned int i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), MaterialLess(meshes));
+
+        // rebase the indices in material order, one draw per run of equal materials
+        vector<unsigned int> indices;
+        indices.reserve(stagedIndices.size());
+        draws.clear();
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            BatchMesh &mesh = meshes[order[i]];
+            if (draws.empty() || draws.back().material != mesh.material)
+            {
+                BatchDraw draw = { mesh.material, (unsigned int)indices.size(), 0 };
+                draws.push_back(draw);
+            }
+            unsigned int firstIndex = (unsigned int)indices.size();
+            for (unsigned int j = 0; j < mesh.indexCount; j++)
+                indices.push_back(stagedIndices[mesh.firstIndex + j] + mesh.firstVertex);
+            mesh.firstIndex = firstIndex;
+            draws.back().indexCount += mesh.indexCount;
+        }
+
+        // quantization bounds are shared by the whole model
+        EncodedVertices encoded = VertexEncoder::encode(stagedVertices.empty() ? NULL : &stagedVertices[0], stagedVertices.size(), layout, streams);
+        positionScale = encoded.positionScale;
+        positionOffset = encoded.positionOffset;
+        octNormals = encoded.octNormals;
+        vertexBytes = encoded.data.size();
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, encoded.data.size(), encoded.data.empty() ? NULL : &encoded.data[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+        VertexEncoder::applyAttributes(encoded);
+        glBindVertexArray(0);
+
+        vector<Vertex>().swap(stagedVertices);
+        vector<unsigned int>().swap(stagedIndices);
+    }
+
+    // one VAO bind, then per material only the textures that actually change
+    void Draw(ShaderProgram &shaderProgram)
+    {
+        glUniform3fv(shaderProgram.locateUnifrom("positionScale"), 1, &positionScale[0]);
+        glUniform3fv(shaderProgram.locateUnifrom("positionOffset"), 1, &positionOffset[0]);
+        glUniform1i(shaderProgram.locateUnifrom("octNormals"), octNormals);
+
+        vector<unsigned int> bound;
+        vector<string> samplers;
+        glBindVertexArray(VAO);
+        for (size_t i = 0; i < draws.size(); i++)
+        {
+            const BatchMaterial &material = materials[draws[i].material];
+            for (unsigned int unit = 0; unit < material.textures.size(); unit++)
+            {
+                if (unit >= bound.size())
+                {
+                    bound.resize(unit + 1, 0);
+                    samplers.resize(unit + 1);
+                }
+                if (samplers[unit] != material.samplers[unit])
+                {
+                    glUniform1i(shaderProgram.locateUnifrom(material.samplers[unit]), unit);
+                    samplers[unit] = material.samplers[unit];
+                }
+                if (bound[unit] != material.textures[unit].id)
+                {
+                    glActiveTexture(GL_TEXTURE0 + unit);
+                    glBindTexture(GL_TEXTURE_2D, material.textures[unit].id);
+                    bound[unit] = material.textures[unit].id;
+                }
+            }
+            glDrawElements(GL_TRIANGLES, draws[i].indexCount, GL_UNSIGNED_INT, (void*)(draws[i].firstIndex * sizeof(unsigned int)));
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    unsigned int VBO, EBO;
+    unsigned int streams;
+    glm::vec3 positionScale, positionOffset;
+    bool octNormals;
+    vector<Vertex> stagedVertices;
+    vector<unsigned int> stagedIndices;
+
+    struct MaterialLess {
+        const vector<BatchMesh> &meshes;
+        MaterialLess(const vector<BatchMesh> &meshes) : meshes(meshes) {}
+        bool operator()(unsigned int a, unsigned int b) const { return meshes[a].material < meshes[b].material; }
+    };
+
+    static void clearMissing(Vertex &v, unsigned int meshStreams)
+    {
+        if (!(meshStreams & STREAM_NORMAL))
+            v.Normal = glm::vec3(0.0f);
+        if (!(meshStreams & STREAM_TEXCOORD))
+            v.TexCoords = glm::vec2(0.0f);
+        if (!(meshStreams & STREAM_TANGENT))
+            v.Tangent = v.Bitangent = glm::vec3(0.0f);
+        if (!(meshStreams & STREAM_BONES))
+        {
+            for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+            {
+                v.m_BoneIDs[i] = 0;
+                v.m_Weights[i] = 0.0f;
+            }
+        }
+    }
+};
@@ -0,0 +1,412 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include "utils_mesh.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// bump whenever the on-disk layout or the Vertex struct changes
+#define MESH_CACHE_VERSION 2
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile()
+    {
+        mData = NULL;
+        mSize = 0;
+#ifdef _WIN32
+        hFile = INVALID_HANDLE_VALUE;
+        hMapping = NULL;
+#endif
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping == NULL)
+        {
+            close();
+            return false;
+        }
+        mData = (const unsigned char *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        mSize = (size_t)size.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED)
+            return false;
+        mData = (const unsigned char *)ptr;
+        mSize = (size_t)st.st_size;
+#endif
+        if (mData == NULL)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (mData) UnmapViewOfFile(mData);
+        if (hMapping) CloseHandle(hMapping);
+        if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+        hMapping = NULL;
+        hFile = INVALID_HANDLE_VALUE;
+#else
+        if (mData) munmap((void *)mData, mSize);
+#endif
+        mData = NULL;
+        mSize = 0;
+    }
+
+    const unsigned char *data() const { return mData; }
+    size_t size() const { return mSize; }
+
+private:
+    const unsigned char *mData;
+    size_t mSize;
+#ifdef _WIN32
+    HANDLE hFile;
+    HANDLE hMapping;
+#endif
+
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+};
+
+// on-disk layout of the mesh cache
+// --------------------------------
+// header | mesh table | material table | vertex data | index data
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t importFlags;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint32_t vertexStride;
+    uint32_t meshCount;
+    uint32_t materialCount;
+    uint32_t reserved;
+    uint64_t materialTableOffset;
+    uint64_t vertexDataOffset;
+    uint64_t indexDataOffset;
+    uint64_t fileSize;
+};
+
+struct MeshCacheEntry
+{
+    uint64_t firstVertex;
+    uint64_t firstIndex;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t materialIndex;
+    uint32_t streams;
+};
+
+// the textures used by one material, as (type, path) pairs relative to the model directory
+struct MeshCacheMaterial
+{
+    vector<string> types;
+    vector<string> paths;
+};
+
+// Versioned binary cache of an imported model. The vertex and index blobs are memory-mapped
+// so a cached model can be uploaded straight into its VBO/EBO without going through Assimp.
+class MeshCache
+{
+public:
+    vector<MeshCacheEntry>    meshes;
+    vector<MeshCacheMaterial> materials;
+
+    MeshCache()
+    {
+        vertexData = NULL;
+        indexData = NULL;
+    }
+
+    // maps the cache file and validates it against the source file and import flags
+    bool open(const string &cachePath, uint64_t sourceHash, uint64_t sourceSize, unsigned int importFlags)
+    {
+        meshes.clear();
+        materials.clear();
+        if (!file.open(cachePath))
+            return false;
+
+        const unsigned char *base = file.data();
+        size_t size = file.size();
+        if (size < sizeof(MeshCacheHeader))
+            return fail();
+        MeshCacheHeader header;
+        std::memcpy(&header, base, sizeof(header));
+        if (std::memcmp(header.magic, "SSDOMSH", 8) != 0 ||
+            header.version != MESH_CACHE_VERSION ||
+            header.importFlags != importFlags ||
+            header.sourceHash != sourceHash ||
+            header.sourceSize != sourceSize ||
+            header.vertexStride != sizeof(Vertex) ||
+            header.fileSize != size ||
+            header.materialTableOffset > header.vertexDataOffset ||
+            header.vertexDataOffset > header.indexDataOffset ||
+            header.indexDataOffset > size)
+            return fail();
+
+        // mesh table follows the header directly
+        size_t cursor = sizeof(MeshCacheHeader);
+        if (cursor + header.meshCount * sizeof(MeshCacheEntry) > header.materialTableOffset)
+            return fail();
+        meshes.resize(header.meshCount);
+        if (header.meshCount > 0)
+            std::memcpy(&meshes[0], base + cursor, header.meshCount * sizeof(MeshCacheEntry));
+
+        // material table: count-prefixed strings
+        cursor = (size_t)header.materialTableOffset;
+        materials.resize(header.materialCount);
+        for (uint32_t i = 0; i < header.materialCount; i++)
+        {
+            uint32_t textureCount;
+            if (!readU32(cursor, header.vertexDataOffset, textureCount))
+                return fail();
+            for (uint32_t j = 0; j < textureCount; j++)
+            {
+                string type, path;
+                if (!readString(cursor, header.vertexDataOffset, type) || !readString(cursor, header.vertexDataOffset, path))
+                    return fail();
+                materials[i].types.push_back(type);
+                materials[i].paths.push_back(path);
+            }
+        }
+
+        // bounds-check every mesh against the blobs
+        vertexData = (const Vertex *)(base + header.vertexDataOffset);
+        indexData = (const unsigned int *)(base + header.indexDataOffset);
+        uint64_t totalVertices = (header.indexDataOffset - header.vertexDataOffset) / sizeof(Vertex);
+        uint64_t totalIndices = (size - header.indexDataOffset) / sizeof(unsigned int);
+        for (uint32_t i = 0; i < header.meshCount; i++)
+        {
+            if (meshes[i].firstVertex + meshes[i].vertexCount > totalVertices ||
+                meshes[i].firstIndex + meshes[i].indexCount > totalIndices ||
+                meshes[i].materialIndex >= header.materialCount)
+                return fail();
+        }
+        return true;
+    }
+
+    const Vertex *vertices(const MeshCacheEntry &entry) const
+    {
+        return vertexData + entry.firstVertex;
+    }
+
+    const unsigned int *indices(const MeshCacheEntry &entry) const
+    {
+        return indexData + entry.firstIndex;
+    }
+
+    // releases the mapping once the data has been uploaded
+    void close()
+    {
+        file.close();
+        vertexData = NULL;
+        indexData = NULL;
+    }
+
+    // writes the imported meshes; srcMeshes[i].material indexes into srcMaterials
+    static bool write(const string &cachePath, uint64_t sourceHash, uint64_t sourceSize, unsigned int importFlags,
+                      const vector<MeshData> &srcMeshes, const vector<MeshCacheMaterial> &srcMaterials)
+    {
+        // serialize the material table first so the blob offsets are known
+        string materialTable;
+        for (size_t i = 0; i < srcMaterials.size(); i++)
+        {
+            appendU32(materialTable, (uint32_t)srcMaterials[i].paths.size());
+            for (size_t j = 0; j < srcMaterials[i].paths.size(); j++)
+            {
+                appendString(materialTable, srcMaterials[i].types[j]);
+                appendString(materialTable, srcMaterials[i].paths[j]);
+            }
+        }
+
+        MeshCacheHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "SSDOMSH", 8);
+        header.version = MESH_CACHE_VERSION;
+        header.importFlags = importFlags;
+        header.sourceHash = sourceHash;
+        header.sourceSize = sourceSize;
+        header.vertexStride = sizeof(Vertex);
+        header.meshCount = (uint32_t)srcMeshes.size();
+        header.materialCount = (uint32_t)srcMaterials.size();
+
+        vector<MeshCacheEntry> entries(srcMeshes.size());
+        uint64_t totalVertices = 0, totalIndices = 0;
+        for (size_t i = 0; i < srcMeshes.size(); i++)
+        {
+            std::memset(&entries[i], 0, sizeof(MeshCacheEntry));
+            entries[i].firstVertex = totalVertices;
+            entries[i].firstIndex = totalIndices;
+            entries[i].vertexCount = (uint32_t)srcMeshes[i].vertices.size();
+            entries[i].indexCount = (uint32_t)srcMeshes[i].indices.size();
+            entries[i].materialIndex = srcMeshes[i].material;
+            entries[i].streams = srcMeshes[i].streams;
+            totalVertices += srcMeshes[i].vertices.size();
+            totalIndices += srcMeshes[i].indices.size();
+        }
+
+        header.materialTableOffset = sizeof(MeshCacheHeader) + entries.size() * sizeof(MeshCacheEntry);
+        header.vertexDataOffset = align(header.materialTableOffset + materialTable.size(), 16);
+        header.indexDataOffset = align(header.vertexDataOffset + totalVertices * sizeof(Vertex), 16);
+        header.fileSize = header.indexDataOffset + totalIndices * sizeof(unsigned int);
+
+        // write to a temporary file and rename so a crash never leaves a half-written cache behind
+        string tmpPath = cachePath + ".tmp";
+        FILE *fp = std::fopen(tmpPath.c_str(), "wb");
+        if (!fp)
+        {
+            std::cout << "ERROR::MESH_CACHE:: cannot write " << tmpPath << std::endl;
+            return false;
+        }
+        bool ok = std::fwrite(&header, sizeof(header), 1, fp) == 1;
+        if (!entries.empty())
+            ok = ok && std::fwrite(&entries[0], sizeof(MeshCacheEntry), entries.size(), fp) == entries.size();
+        ok = ok && std::fwrite(materialTable.data(), 1, materialTable.size(), fp) == materialTable.size();
+        ok = ok && pad(fp, header.vertexDataOffset - header.materialTableOffset - materialTable.size());
+        for (size_t i = 0; ok && i < srcMeshes.size(); i++)
+            if (!srcMeshes[i].vertices.empty())
+                ok = std::fwrite(&srcMeshes[i].vertices[0], sizeof(Vertex), srcMeshes[i].vertices.size(), fp) == srcMeshes[i].vertices.size();
+        ok = ok && pad(fp, header.indexDataOffset - header.vertexDataOffset - totalVertices * sizeof(Vertex));
+        for (size_t i = 0; ok && i < srcMeshes.size(); i++)
+            if (!srcMeshes[i].indices.empty())
+                ok = std::fwrite(&srcMeshes[i].indices[0], sizeof(unsigned int), srcMeshes[i].indices.size(), fp) == srcMeshes[i].indices.size();
+        ok = (std::fclose(fp) == 0) && ok;
+
+        std::remove(cachePath.c_str());
+        if (!ok || std::rename(tmpPath.c_str(), cachePath.c_str()) != 0)
+        {
+            std::cout << "ERROR::MESH_CACHE:: failed to write " << cachePath << std::endl;
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // 64-bit FNV-1a hash of a file's contents; returns false if the file can't be read
+    static bool hashFile(const string &path, uint64_t &hash, uint64_t &size)
+    {
+        FILE *fp = std::fopen(path.c_str(), "rb");
+        if (!fp)
+            return false;
+        hash = 14695981039346656037ULL;
+        size = 0;
+        unsigned char buffer[1 << 16];
+        size_t n;
+        while ((n = std::fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                hash ^= buffer[i];
+                hash *= 1099511628211ULL;
+            }
+            size += n;
+        }
+        std::fclose(fp);
+        return true;
+    }
+
+private:
+    MappedFile file;
+    const Vertex *vertexData;
+    const unsigned int *indexData;
+
+    bool fail()
+    {
+        close();
+        meshes.clear();
+        materials.clear();
+        return false;
+    }
+
+    bool readU32(size_t &cursor, uint64_t limit, uint32_t &value)
+    {
+        if (cursor + sizeof(uint32_t) > limit)
+            return false;
+        std::memcpy(&value, file.data() + cursor, sizeof(uint32_t));
+        cursor += sizeof(uint32_t);
+        return true;
+    }
+
+    bool readString(size_t &cursor, uint64_t limit, string &value)
+    {
+        uint32_t length;
+        if (!readU32(cursor, limit, length) || cursor + length > limit)
+            return false;
+        value.assign((const char *)file.data() + cursor, length);
+        cursor += length;
+        return true;
+    }
+
+    static void appendU32(string &out, uint32_t value)
+    {
+        out.append((const char *)&value, sizeof(uint32_t));
+    }
+
+    static void appendString(string &out, const string &value)
+    {
+        appendU32(out, (uint32_t)value.size());
+        out.append(value);
+    }
+
+    static uint64_t align(uint64_t offset, uint64_t alignment)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    static bool pad(FILE *fp, uint64_t count)
+    {
+        static const char zeros[16] = {0};
+        return count == 0 || std::fwrite(zeros, 1, (size_t)count, fp) == count;
+    }
+};
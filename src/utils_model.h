@@ -11,6 +11,10 @@
 
 #include "utils_shader_program.h"
 #include "utils_mesh.h"
+#include "utils_mesh_batch.h"
+#include "utils_mesh_cache.h"
+#include "utils_texture_loader.h"
+#include "utils_cpu_profiler.h"
 
 #include <string>
 #include <fstream>
@@ -20,7 +24,10 @@
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, TextureLoader *loader = NULL);
+
+// post-processing applied on import; part of the mesh cache key
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
 
 class Model
 {
@@ -28,11 +35,19 @@ public:
     // model data
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    // batched mode: every mesh lives in here instead of meshes
+    MeshBatch       batch;
     string directory;
     bool gammaCorrection;
+    bool batched;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // if a texture loader is given the textures are only queued and appear once it finishes.
+    // the vertex layout selects which streams are uploaded and how they are encoded.
+    // batched merges all meshes into one buffer drawn with one call per material.
+    Model(string const &path, bool gamma = false, TextureLoader *loader = NULL, VertexLayout layout = VERTEX_LAYOUT_FULL,
+          bool batched = false)
+        : gammaCorrection(gamma), batched(batched), textureLoader(loader), vertexLayout(layout)
     {
         loadModel(path);
     }
@@ -40,32 +55,125 @@ public:
     // draws the model, and thus all its meshes
     void Draw(ShaderProgram &shaderProgram)
     {
+        CPU_PROFILE_SCOPE("Model::Draw");
+        if (batched)
+        {
+            batch.Draw(shaderProgram);
+            return;
+        }
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shaderProgram);
     }
 
 private:
+    TextureLoader *textureLoader;
+    VertexLayout vertexLayout;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // a binary mesh cache keyed by the file's hash and the import flags lets later runs skip ASSIMP entirely.
     void loadModel(string const &path)
     {
+        CPU_PROFILE_SCOPE("Model::loadModel");
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // try the mesh cache first
+        uint64_t sourceHash = 0, sourceSize = 0;
+        bool hashed = MeshCache::hashFile(path, sourceHash, sourceSize);
+        string cachePath = string(CACHE_DIR) + "/" + path.substr(path.find_last_of('/') + 1) + ".meshcache";
+        if (hashed && loadFromCache(cachePath, sourceHash, sourceSize))
+            return;
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        vector<MeshData> imported;
+        processNode(scene->mRootNode, scene, imported);
+
+        // store the result for the next run
+        if (hashed)
+            MeshCache::write(cachePath, sourceHash, sourceSize, MODEL_IMPORT_FLAGS, imported, collectMaterials(scene));
+
+        // and upload it
+        for (unsigned int i = 0; i < imported.size(); i++)
+        {
+            const MeshData &data = imported[i];
+            addMesh(data.vertices.empty() ? NULL : &data.vertices[0], data.vertices.size(),
+                    data.indices.empty() ? NULL : &data.indices[0], data.indices.size(), data.textures, data.streams, data.material);
+        }
+        if (batched)
+            batch.build(vertexLayout);
+    }
+
+    // uploads one mesh on its own or stages it in the batch
+    void addMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount,
+                 const vector<Texture> &textures, unsigned int streams, unsigned int material)
+    {
+        if (batched)
+            batch.add(vertexData, vertexCount, indexData, indexCount, material, textures, streams);
+        else
+            meshes.push_back(Mesh(vertexData, vertexCount, indexData, indexCount, textures, streams, vertexLayout));
+    }
+
+    // rebuilds the meshes from a valid mesh cache, uploading the mapped data directly
+    bool loadFromCache(const string &cachePath, uint64_t sourceHash, uint64_t sourceSize)
+    {
+        MeshCache cache;
+        if (!cache.open(cachePath, sourceHash, sourceSize, MODEL_IMPORT_FLAGS))
+            return false;
+
+        // resolve every material's textures once
+        vector< vector<Texture> > materialTextures(cache.materials.size());
+        for (unsigned int i = 0; i < cache.materials.size(); i++)
+            for (unsigned int j = 0; j < cache.materials[i].paths.size(); j++)
+                materialTextures[i].push_back(loadTexture(cache.materials[i].paths[j], cache.materials[i].types[j]));
+
+        if (!batched)
+            meshes.reserve(cache.meshes.size());
+        for (unsigned int i = 0; i < cache.meshes.size(); i++)
+        {
+            const MeshCacheEntry &entry = cache.meshes[i];
+            addMesh(cache.vertices(entry), entry.vertexCount, cache.indices(entry), entry.indexCount,
+                    materialTextures[entry.materialIndex], entry.streams, entry.materialIndex);
+        }
+        if (batched)
+            batch.build(vertexLayout);
+        cache.close();
+        return true;
+    }
+
+    // gathers the texture paths of every material in the same order processMesh binds them
+    vector<MeshCacheMaterial> collectMaterials(const aiScene *scene)
+    {
+        const aiTextureType types[4] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+        const char *typeNames[4] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+        vector<MeshCacheMaterial> materials(scene->mNumMaterials);
+        for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+        {
+            for (unsigned int t = 0; t < 4; t++)
+            {
+                for (unsigned int j = 0; j < scene->mMaterials[i]->GetTextureCount(types[t]); j++)
+                {
+                    aiString str;
+                    scene->mMaterials[i]->GetTexture(types[t], j, &str);
+                    materials[i].types.push_back(typeNames[t]);
+                    materials[i].paths.push_back(str.C_Str());
+                }
+            }
+        }
+        return materials;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    void processNode(aiNode *node, const aiScene *scene, vector<MeshData> &imported)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -73,22 +181,23 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            imported.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, imported);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vector<Texture> &textures = data.textures;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -163,8 +272,19 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // note which streams the mesh really has so the layout can drop the rest
+        unsigned int streams = STREAM_POSITION;
+        if (mesh->HasNormals())
+            streams |= STREAM_NORMAL;
+        if (mesh->mTextureCoords[0])
+            streams |= STREAM_TEXCOORD | STREAM_TANGENT;
+        if (mesh->HasBones())
+            streams |= STREAM_BONES;
+
+        // return the extracted mesh data
+        data.streams = streams;
+        data.material = mesh->mMaterialIndex;
+        return data;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -176,33 +296,32 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // loads a texture relative to the model directory unless it has been loaded already
+    Texture loadTexture(const string &path, const string &typeName)
+    {
+        // check if texture was loaded before and if so, reuse it: skip loading a new texture
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(textures_loaded[j].path == path)
+                return textures_loaded[j]; // a texture with the same filepath has already been loaded. (optimization)
+        }
+        // if texture hasn't been loaded already, load it
+        Texture texture;
+        texture.id = TextureFromFile(path.c_str(), this->directory, gammaCorrection, textureLoader);
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
+    }
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, TextureLoader *loader)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
@@ -210,35 +329,15 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    stbi_set_flip_vertically_on_load(false);
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // decode (possibly on a worker thread) and upload with mipmaps
+    TextureJob job = { filename, textureID, GL_TEXTURE_2D, GL_TEXTURE_2D, 0, false, true };
+    TextureLoader::load(job, loader);
 
     return textureID;
-}
+}
\ No newline at end of file
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+
+// header of a program binary file in CACHE_DIR
+struct ProgramBinaryHeader
+{
+    char magic[8];      // "SSDOPRG"
+    uint32_t format;    // binaryFormat from glGetProgramBinary
+    uint32_t length;    // bytes following the header
+    uint64_t key;       // guards against hash-named files being swapped
+};
+
+// Keeps linked program binaries around twice over: within a run identical sources are linked once and
+// every later owner gets its own program object made from the binary in memory, and across runs the
+// binary is stored in CACHE_DIR so the next launch skips compiling and linking. Owners never share a
+// program object, so uniforms set once at construction (sampler units, kernels) stay theirs. Keys hash
+// the shader sources, the defines and the driver strings, so a shader edit or a driver update just
+// misses the cache and compiles again. Without program binary support every owner compiles its own;
+// owners switching between variants keep them in ShaderVariants, so switching back builds nothing.
+class ProgramCache
+{
+public:
+    unsigned int compiled, loaded, reused;
+
+    static ProgramCache &instance()
+    {
+        static ProgramCache cache;
+        return cache;
+    }
+
+    uint64_t key(const std::string &vertexSource, const std::string &fragmentSource, const std::string &defines)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        hash = fnv1a(hash, driver());
+        hash = fnv1a(hash, defines);
+        hash = fnv1a(hash, vertexSource);
+        hash = fnv1a(hash, fragmentSource);
+        return hash;
+    }
+
+    // a new program object from the binary of one linked earlier in this run or on an earlier launch,
+    // owned by the caller; 0 if it has to be compiled
+    GLuint find(uint64_t key)
+    {
+        std::map<uint64_t, ProgramBinary>::iterator it = binaries.find(key);
+        if (it != binaries.end())
+        {
+            GLuint program = createProgram(it->second);
+            if (program)
+                reused++;
+            return program;
+        }
+        ProgramBinary binary;
+        if (!loadBinary(key, binary))
+            return 0;
+        GLuint program = createProgram(binary);
+        if (program)
+        {
+            binaries[key] = binary;
+            loaded++;
+        }
+        return program;
+    }
+
+    // call before glLinkProgram so the driver keeps the binary around
+    void prepare(GLuint program)
+    {
+        if (supported())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // remembers the binary of a freshly linked program and writes it
+    void store(uint64_t key, GLuint program)
+    {
+        compiled++;
+        if (!supported())
+            return;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        ProgramBinary &binary = binaries[key];
+        binary.bytes.resize(length);
+        glGetProgramBinary(program, length, NULL, &binary.format, &binary.bytes[0]);
+
+        ProgramBinaryHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "SSDOPRG", 8);
+        header.format = binary.format;
+        header.length = (uint32_t)length;
+        header.key = key;
+
+        // write to a temporary file and rename so a crash never leaves a half-written binary behind
+        std::string path = binaryPath(key), tmpPath = path + ".tmp";
+        FILE *fp = std::fopen(tmpPath.c_str(), "wb");
+        if (!fp)
+        {
+            std::cout << "ERROR::PROGRAM_CACHE:: cannot write " << tmpPath << std::endl;
+            return;
+        }
+        bool ok = std::fwrite(&header, sizeof(header), 1, fp) == 1;
+        ok = ok && std::fwrite(&binary.bytes[0], 1, binary.bytes.size(), fp) == binary.bytes.size();
+        ok = std::fclose(fp) == 0 && ok;
+        std::remove(path.c_str());
+        if (!ok || std::rename(tmpPath.c_str(), path.c_str()) != 0)
+        {
+            std::remove(tmpPath.c_str());
+            std::cout << "ERROR::PROGRAM_CACHE:: failed to write " << path << std::endl;
+        }
+    }
+
+    void printStats() const
+    {
+        printf("shaders: %u programs compiled, %u loaded from binaries, %u made from binaries of this run%s\n",
+               compiled, loaded, reused, supported() ? "" : " (program binaries unsupported)");
+    }
+
+private:
+    struct ProgramBinary
+    {
+        GLenum format;
+        std::vector<unsigned char> bytes;
+    };
+
+    std::map<uint64_t, ProgramBinary> binaries;
+    std::string driverString;
+    // whether the driver hands out program binaries, -1 until asked
+    mutable int binarySupport;
+
+    ProgramCache() : compiled(0), loaded(0), reused(0), binarySupport(-1) {}
+    ProgramCache(const ProgramCache &);
+    ProgramCache &operator=(const ProgramCache &);
+
+    // needs GL 4.1 or ARB_get_program_binary, and a driver that offers at least one format
+    bool supported() const
+    {
+        if (binarySupport < 0)
+        {
+            GLint formats = 0;
+            if (GLEW_ARB_get_program_binary)
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            binarySupport = formats > 0 ? 1 : 0;
+        }
+        return binarySupport == 1;
+    }
+
+    const std::string &driver()
+    {
+        if (driverString.empty())
+        {
+            const GLenum names[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+            for (int i = 0; i < 3; i++)
+            {
+                const GLubyte *value = glGetString(names[i]);
+                driverString += value ? (const char *)value : "?";
+                driverString += '\n';
+            }
+        }
+        return driverString;
+    }
+
+    static std::string binaryPath(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+        return std::string(CACHE_DIR) + "/" + name + ".progbin";
+    }
+
+    // reads a cached binary file; a missing or damaged file counts as a miss
+    bool loadBinary(uint64_t key, ProgramBinary &binary)
+    {
+        if (!supported())
+            return false;
+        FILE *fp = std::fopen(binaryPath(key).c_str(), "rb");
+        if (!fp)
+            return false;
+        ProgramBinaryHeader header;
+        bool ok = std::fread(&header, sizeof(header), 1, fp) == 1 &&
+                  std::memcmp(header.magic, "SSDOPRG", 8) == 0 && header.key == key && header.length > 0;
+        if (ok)
+        {
+            binary.format = header.format;
+            binary.bytes.resize(header.length);
+            ok = std::fread(&binary.bytes[0], 1, binary.bytes.size(), fp) == binary.bytes.size();
+        }
+        std::fclose(fp);
+        return ok;
+    }
+
+    // a new program object from a binary; one the driver rejects counts as a miss
+    static GLuint createProgram(const ProgramBinary &binary)
+    {
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, binary.format, &binary.bytes[0], (GLsizei)binary.bytes.size());
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    static uint64_t fnv1a(uint64_t hash, const std::string &data)
+    {
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            hash ^= (unsigned char)data[i];
+            hash *= 1099511628211ULL;
+        }
+        // separator so "ab"+"c" and "a"+"bc" differ
+        hash ^= 0xff;
+        hash *= 1099511628211ULL;
+        return hash;
+    }
+};
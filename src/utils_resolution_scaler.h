@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+// Frame-time feedback controller for the internal render scale. It keeps a moving average of the
+// frame time and every few frames nudges the scale so the pixel count follows the budget, i.e.
+// scale *= sqrt(target / average). Steps are clamped and small errors ignored so the scale settles
+// instead of oscillating, and the result is quantized so the viewport doesn't change every frame.
+class ResolutionScaler
+{
+public:
+    ResolutionScaler(float targetMs = 16.6f, float minScale = 0.5f, float maxScale = 1.0f)
+        : targetMs(targetMs), minScale(minScale), maxScale(maxScale),
+          currentScale(maxScale), avgMs(targetMs), frames(0), enabled(true) {}
+
+    // feed the duration of the last frame
+    void update(float frameMs)
+    {
+        if (!enabled || frameMs <= 0.0f)
+            return;
+        // spikes like window drags or shader rebuilds shouldn't throw the average
+        frameMs = std::min(frameMs, targetMs * 4.0f);
+        avgMs += (frameMs - avgMs) * 0.1f;
+        if (++frames < 15)
+            return;
+        frames = 0;
+
+        float error = targetMs / avgMs;
+        // within 5% of the budget: leave it alone
+        if (error > 0.95f && error < 1.05f)
+            return;
+        // drop quickly when over budget, recover slowly when under
+        float step = std::max(0.85f, std::min(1.1f, std::sqrt(error)));
+        float scale = std::floor(currentScale * step * 32.0f + 0.5f) / 32.0f;
+        currentScale = std::max(minScale, std::min(maxScale, scale));
+    }
+
+    void setEnabled(bool enable)
+    {
+        enabled = enable;
+        if (!enabled)
+            currentScale = maxScale;
+        avgMs = targetMs;
+        frames = 0;
+    }
+
+    bool isEnabled() const { return enabled; }
+    float scale() const { return currentScale; }
+    float averageMs() const { return avgMs; }
+
+private:
+    float targetMs, minScale, maxScale;
+    float currentScale;
+    float avgMs;
+    int frames;
+    bool enabled;
+};
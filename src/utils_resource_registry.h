@@ -0,0 +1,524 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <glm/glm.hpp>
+
+#include "utils_texture_loader.h"
+#include "renderer_cube_quad.h"
+#include "utils_sky_sh.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+// deferred shading g-buffer in the compact layout of shader/common/gbuffer.glsl: linear depth,
+// packed normal, albedo + specular, and the depth buffer
+struct GBuffer
+{
+    GLuint fbo;
+    GLuint gDepth, gNormal, gAlbedo;
+    GLuint rboDepth;
+};
+
+// a framebuffer with a single color texture attached
+struct RenderTarget
+{
+    GLuint fbo;
+    GLuint texture;
+};
+
+// downsampled copy of the g-buffer's linear depth and packed normal
+struct DepthNormalTarget
+{
+    GLuint fbo;
+    GLuint depth, normal;
+};
+
+// framebuffer drawing into two textures at once, e.g. both outputs of a fused pass
+struct RenderTargetPair
+{
+    GLuint fbo;
+    GLuint textures[2];
+};
+
+// mip-mapped min/max linear depth with one framebuffer per level
+struct DepthPyramid
+{
+    GLuint texture;
+    std::vector<GLuint> fbos;
+};
+
+// accumulated occlusion (value, frame count in alpha) and the guide it was accumulated for
+// (world-space normal, linear depth in alpha)
+struct HistoryTarget
+{
+    GLuint fbo;
+    GLuint value, guide;
+};
+
+// Reference-counted GPU resources shared between the renderers. Every resource is keyed by its
+// source path or by a descriptor string, so identical skyboxes, g-buffers, occlusion targets and
+// noise textures are created once no matter how many renderers ask for them.
+class ResourceRegistry
+{
+public:
+    explicit ResourceRegistry(TextureLoader *loader = NULL) : textureLoader(loader) {}
+
+    // cubemap from 6 faces, keyed by the face paths
+    GLuint acquireCubemap(const std::vector<std::string> &faces)
+    {
+        std::string key = "cubemap";
+        for (size_t i = 0; i < faces.size(); i++)
+            key += " " + faces[i];
+        Resource *resource = find(key);
+        if (!resource)
+        {
+            resource = create(key);
+            GLuint texture = rendererCubeQuad.loadCubemap(faces, textureLoader);
+            resource->textures.push_back(texture);
+            resource->textureTargets.push_back(GL_TEXTURE_CUBE_MAP);
+        }
+        return resource->textures[0];
+    }
+
+    // spherical harmonics of a cubemap's radiance, projected the first time they are asked for after the
+    // upload and again whenever a different cubemap is passed in
+    const SkySH &acquireSkySH(GLuint cubemap)
+    {
+        std::map<GLuint, SkySH>::iterator it = skyLights.find(cubemap);
+        if (it == skyLights.end())
+            it = skyLights.insert(std::make_pair(cubemap, SkySH::project(cubemap))).first;
+        return it->second;
+    }
+
+    // empty cubemap with a full RGB16F mip chain to hold the prefiltered copy of another cubemap;
+    // created tells whether it is new and still has to be filtered
+    GLuint acquirePrefilteredCubemap(GLuint source, int size, bool &created)
+    {
+        std::string key = "prefiltered cubemap " + std::to_string(source) + " " + std::to_string(size);
+        Resource *resource = find(key);
+        created = resource == NULL;
+        if (!resource)
+        {
+            resource = create(key);
+            int levels = 1;
+            while ((size >> levels) > 0)
+                levels++;
+            GLuint texture;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+            for (int level = 0; level < levels; level++)
+                for (int face = 0; face < 6; face++)
+                    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB16F, std::max(1, size >> level),
+                                 std::max(1, size >> level), 0, GL_RGB, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            resource->textures.push_back(texture);
+            resource->textureTargets.push_back(GL_TEXTURE_CUBE_MAP);
+        }
+        return resource->textures[0];
+    }
+
+    // g-buffer of the given size
+    GBuffer acquireGBuffer(int width, int height)
+    {
+        std::string key = "gbuffer " + std::to_string(width) + "x" + std::to_string(height);
+        Resource *resource = find(key);
+        if (!resource)
+        {
+            resource = create(key);
+            GBuffer gBuffer;
+            glGenFramebuffers(1, &gBuffer.fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, gBuffer.fbo);
+            // linear depth buffer, positions are rebuilt from it
+            glGenTextures(1, &gBuffer.gDepth);
+            glBindTexture(GL_TEXTURE_2D, gBuffer.gDepth);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gBuffer.gDepth, 0);
+            // octahedral normal buffer
+            glGenTextures(1, &gBuffer.gNormal);
+            glBindTexture(GL_TEXTURE_2D, gBuffer.gNormal);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, width, height, 0, GL_RG, GL_UNSIGNED_SHORT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gBuffer.gNormal, 0);
+            // color + specular color buffer
+            glGenTextures(1, &gBuffer.gAlbedo);
+            glBindTexture(GL_TEXTURE_2D, gBuffer.gAlbedo);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gBuffer.gAlbedo, 0);
+            // tell OpenGL which color attachments we'll use (of this framebuffer) for rendering
+            unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+            glDrawBuffers(3, attachments);
+            // create and attach depth buffer (renderbuffer)
+            glGenRenderbuffers(1, &gBuffer.rboDepth);
+            glBindRenderbuffer(GL_RENDERBUFFER, gBuffer.rboDepth);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, gBuffer.rboDepth);
+            // finally check if framebuffer is complete
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "Framebuffer not complete!" << std::endl;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+            resource->framebuffers.push_back(gBuffer.fbo);
+            resource->textures.push_back(gBuffer.gDepth);
+            resource->textures.push_back(gBuffer.gNormal);
+            resource->textures.push_back(gBuffer.gAlbedo);
+            resource->textureTargets.assign(3, GL_TEXTURE_2D);
+            resource->renderbuffers.push_back(gBuffer.rboDepth);
+        }
+        GBuffer gBuffer;
+        gBuffer.fbo = resource->framebuffers[0];
+        gBuffer.gDepth = resource->textures[0];
+        gBuffer.gNormal = resource->textures[1];
+        gBuffer.gAlbedo = resource->textures[2];
+        gBuffer.rboDepth = resource->renderbuffers[0];
+        return gBuffer;
+    }
+
+    // depth + normal pair the reduced-resolution occlusion passes read instead of the g-buffer, in its layout
+    DepthNormalTarget acquireDepthNormalTarget(int width, int height)
+    {
+        Resource *resource = acquireTexturePair("depth normal " + std::to_string(width) + "x" + std::to_string(height), width, height,
+                                                GL_R32F, GL_RG16);
+        DepthNormalTarget target;
+        target.fbo = resource->framebuffers[0];
+        target.depth = resource->textures[0];
+        target.normal = resource->textures[1];
+        return target;
+    }
+
+    // one side of a ping-pong history; unlike the other targets each name belongs to a single owner
+    HistoryTarget acquireHistoryTarget(const std::string &name, int width, int height)
+    {
+        Resource *resource = acquireTexturePair("history " + name + " " + std::to_string(width) + "x" + std::to_string(height), width, height,
+                                                GL_RGBA16F, GL_RGBA16F);
+        HistoryTarget target;
+        target.fbo = resource->framebuffers[0];
+        target.value = resource->textures[0];
+        target.guide = resource->textures[1];
+        return target;
+    }
+
+    // depth pyramid with a full mip chain down to 1x1, at most maxLevels levels
+    DepthPyramid acquireDepthPyramid(int width, int height, int maxLevels)
+    {
+        std::string key = "depth pyramid " + std::to_string(width) + "x" + std::to_string(height) + " " + std::to_string(maxLevels);
+        Resource *resource = find(key);
+        if (!resource)
+        {
+            resource = create(key);
+            int levels = 1;
+            while (levels < maxLevels && ((width >> levels) > 0 || (height >> levels) > 0))
+                levels++;
+            GLuint texture;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            for (int level = 0; level < levels; level++)
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RG32F, std::max(1, width >> level), std::max(1, height >> level), 0, GL_RG, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            resource->framebuffers.resize(levels);
+            glGenFramebuffers(levels, &resource->framebuffers[0]);
+            for (int level = 0; level < levels; level++)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, resource->framebuffers[level]);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level);
+                if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                    std::cout << "Framebuffer depth pyramid level " << level << " not complete!" << std::endl;
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+            resource->textures.push_back(texture);
+            resource->textureTargets.push_back(GL_TEXTURE_2D);
+        }
+        DepthPyramid pyramid;
+        pyramid.texture = resource->textures[0];
+        pyramid.fbos = resource->framebuffers;
+        return pyramid;
+    }
+
+    // single-texture render target; renderers asking for the same name and format share it.
+    // an existing depth renderbuffer (e.g. the g-buffer's) can be attached to depth-test against it.
+    RenderTarget acquireRenderTarget(const std::string &name, int width, int height, GLenum internalFormat, GLenum format,
+                                     GLuint depthRenderbuffer = 0)
+    {
+        std::string key = "target " + name + " " + std::to_string(width) + "x" + std::to_string(height) +
+                          " " + std::to_string(internalFormat);
+        if (depthRenderbuffer)
+            key += " depth " + std::to_string(depthRenderbuffer);
+        Resource *resource = find(key);
+        if (!resource)
+        {
+            resource = create(key);
+            RenderTarget target;
+            glGenFramebuffers(1, &target.fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+            glGenTextures(1, &target.texture);
+            glBindTexture(GL_TEXTURE_2D, target.texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture, 0);
+            if (depthRenderbuffer)
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "Framebuffer " << name << " not complete!" << std::endl;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+            resource->framebuffers.push_back(target.fbo);
+            resource->textures.push_back(target.texture);
+            resource->textureTargets.push_back(GL_TEXTURE_2D);
+        }
+        RenderTarget target;
+        target.fbo = resource->framebuffers[0];
+        target.texture = resource->textures[0];
+        return target;
+    }
+
+    // framebuffer over two textures of other resources, which have to outlive it
+    RenderTargetPair acquireRenderTargetPair(const std::string &name, GLuint texture0, GLuint texture1)
+    {
+        std::string key = "pair " + name + " " + std::to_string(texture0) + " " + std::to_string(texture1);
+        Resource *resource = find(key);
+        if (!resource)
+        {
+            resource = create(key);
+            GLuint fbo;
+            glGenFramebuffers(1, &fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture0, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, texture1, 0);
+            unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+            glDrawBuffers(2, attachments);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "Framebuffer " << name << " not complete!" << std::endl;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            resource->framebuffers.push_back(fbo);
+        }
+        RenderTargetPair target;
+        target.fbo = resource->framebuffers[0];
+        target.textures[0] = texture0;
+        target.textures[1] = texture1;
+        return target;
+    }
+
+    // square tiled rotation noise; the first caller's data is used
+    GLuint acquireNoiseTexture(const std::string &name, const std::vector<glm::vec3> &noise)
+    {
+        std::string key = "noise " + name;
+        Resource *resource = find(key);
+        if (!resource)
+        {
+            resource = create(key);
+            GLuint texture;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            int size = (int)std::sqrt((double)noise.size());
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size, size, 0, GL_RGB, GL_FLOAT, &noise[0]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            resource->textures.push_back(texture);
+            resource->textureTargets.push_back(GL_TEXTURE_2D);
+        }
+        return resource->textures[0];
+    }
+
+    // drops one reference to the resource whose (first) framebuffer is fbo
+    void releaseFramebuffer(GLuint fbo)
+    {
+        for (std::map<std::string, Resource>::iterator it = resources.begin(); it != resources.end(); ++it)
+            if (!it->second.framebuffers.empty() && it->second.framebuffers[0] == fbo)
+            {
+                release(it);
+                return;
+            }
+        std::cout << "ERROR::RESOURCE_REGISTRY:: releasing unknown framebuffer " << fbo << std::endl;
+    }
+
+    // drops one reference to a texture-only resource (cubemap, noise); textures and framebuffers are
+    // numbered independently, so a texture's name never matches a resource by its framebuffer
+    void releaseTexture(GLuint texture)
+    {
+        for (std::map<std::string, Resource>::iterator it = resources.begin(); it != resources.end(); ++it)
+            if (it->second.framebuffers.empty() && !it->second.textures.empty() && it->second.textures[0] == texture)
+            {
+                release(it);
+                return;
+            }
+        std::cout << "ERROR::RESOURCE_REGISTRY:: releasing unknown texture " << texture << std::endl;
+    }
+
+    // total bytes held on the GPU, measured from the allocated levels of every texture and renderbuffer
+    size_t gpuBytes()
+    {
+        size_t total = 0;
+        for (std::map<std::string, Resource>::iterator it = resources.begin(); it != resources.end(); ++it)
+            total += resourceBytes(it->second);
+        return total;
+    }
+
+    void printUsage()
+    {
+        size_t total = 0;
+        for (std::map<std::string, Resource>::iterator it = resources.begin(); it != resources.end(); ++it)
+        {
+            size_t bytes = resourceBytes(it->second);
+            total += bytes;
+            printf("resource %-48.48s refs %d  %8.2f MB\n", it->first.c_str(), it->second.refCount, bytes / (1024.0 * 1024.0));
+        }
+        printf("resources: %d shared, %.2f MB on the GPU\n", (int)resources.size(), total / (1024.0 * 1024.0));
+    }
+
+private:
+    struct Resource
+    {
+        int refCount;
+        std::vector<GLuint> framebuffers;
+        std::vector<GLuint> textures;
+        std::vector<GLenum> textureTargets;
+        std::vector<GLuint> renderbuffers;
+    };
+
+    std::map<std::string, Resource> resources;
+    std::map<GLuint, SkySH> skyLights;
+    TextureLoader *textureLoader;
+    RendererCubeQuad rendererCubeQuad;
+
+    Resource *find(const std::string &key)
+    {
+        std::map<std::string, Resource>::iterator it = resources.find(key);
+        if (it == resources.end())
+            return NULL;
+        it->second.refCount++;
+        return &it->second;
+    }
+
+    void release(std::map<std::string, Resource>::iterator it)
+    {
+        Resource &resource = it->second;
+        if (--resource.refCount > 0)
+            return;
+        if (!resource.framebuffers.empty())
+            glDeleteFramebuffers((GLsizei)resource.framebuffers.size(), &resource.framebuffers[0]);
+        if (!resource.textures.empty())
+            glDeleteTextures((GLsizei)resource.textures.size(), &resource.textures[0]);
+        // the name may come back for a different cubemap
+        for (size_t i = 0; i < resource.textures.size(); i++)
+            skyLights.erase(resource.textures[i]);
+        if (!resource.renderbuffers.empty())
+            glDeleteRenderbuffers((GLsizei)resource.renderbuffers.size(), &resource.renderbuffers[0]);
+        resources.erase(it);
+    }
+
+    Resource *create(const std::string &key)
+    {
+        Resource &resource = resources[key];
+        resource.refCount = 1;
+        return &resource;
+    }
+
+    // framebuffer with two color attachments of the given internal formats, both drawn to
+    Resource *acquireTexturePair(const std::string &key, int width, int height, GLenum format0, GLenum format1)
+    {
+        const GLenum formats[2] = { format0, format1 };
+        Resource *resource = find(key);
+        if (resource)
+            return resource;
+        resource = create(key);
+        GLuint fbo, textures[2];
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glGenTextures(2, textures);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, formats[i], width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, textures[i], 0);
+        }
+        unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Framebuffer " << key << " not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        resource->framebuffers.push_back(fbo);
+        resource->textures.push_back(textures[0]);
+        resource->textures.push_back(textures[1]);
+        resource->textureTargets.assign(2, GL_TEXTURE_2D);
+        return resource;
+    }
+
+    static size_t levelBytes(GLenum target, GLint level)
+    {
+        GLint width = 0, height = 0, bits = 0, size;
+        glGetTexLevelParameteriv(target, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(target, level, GL_TEXTURE_HEIGHT, &height);
+        const GLenum sizes[5] = { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE };
+        for (int i = 0; i < 5; i++)
+        {
+            glGetTexLevelParameteriv(target, level, sizes[i], &size);
+            bits += size;
+        }
+        return (size_t)width * height * bits / 8;
+    }
+
+    static size_t resourceBytes(const Resource &resource)
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < resource.textures.size(); i++)
+        {
+            GLenum target = resource.textureTargets[i];
+            glBindTexture(target, resource.textures[i]);
+            for (GLint level = 0; level < 16; level++)
+            {
+                size_t bytes = 0;
+                if (target == GL_TEXTURE_CUBE_MAP)
+                    for (GLenum face = 0; face < 6; face++)
+                        bytes += levelBytes(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level);
+                else
+                    bytes = levelBytes(target, level);
+                if (bytes == 0)
+                    break;
+                total += bytes;
+            }
+        }
+        for (size_t i = 0; i < resource.renderbuffers.size(); i++)
+        {
+            GLint width = 0, height = 0, depth = 0, stencil = 0;
+            glBindRenderbuffer(GL_RENDERBUFFER, resource.renderbuffers[i]);
+            glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_WIDTH, &width);
+            glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_HEIGHT, &height);
+            glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_DEPTH_SIZE, &depth);
+            glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_STENCIL_SIZE, &stencil);
+            total += (size_t)width * height * (depth + stencil) / 8;
+        }
+        return total;
+    }
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "utils_blue_noise.h"
+
+#ifndef MY_LERP
+#define MY_LERP(a, b, f) ((a) + (f) * ((b) - (a)))
+#endif
+
+// Sampling patterns for the occlusion kernels: a low-discrepancy hemisphere kernel from the Halton
+// sequence, and the rotations of a tileable blue-noise threshold map. The map is precomputed by
+// tools/sampling_tables.cpp with the void-and-cluster method, which also validates both tables.
+
+// generate sample kernel: random directions in the +z hemisphere, scaled to gather near the origin
+inline std::vector<glm::vec3> generateSampleKernel(int kernelSize)
+{
+    std::vector<glm::vec3> kernel;
+    std::uniform_real_distribution<float> randomFloats(0.0, 1.0); // generates random floats between 0.0 and 1.0
+    std::default_random_engine generator;
+    for (int i = 0; i < kernelSize; ++i)
+    {
+        glm::vec3 sample(randomFloats(generator) * 2.0 - 1.0, randomFloats(generator) * 2.0 - 1.0, randomFloats(generator));
+        sample = glm::normalize(sample);
+        sample *= randomFloats(generator);
+        float scale = float(i) / float(kernelSize);
+
+        // scale samples s.t. they're more aligned to center of kernel
+        scale = MY_LERP(0.1f, 1.0f, scale * scale);
+        sample *= scale;
+        kernel.push_back(sample);
+    }
+    return kernel;
+}
+
+// generate noise texture data: 4x4 random rotations around z-axis (in tangent space)
+inline std::vector<glm::vec3> generateKernelNoise()
+{
+    std::vector<glm::vec3> noise;
+    std::uniform_real_distribution<float> randomFloats(0.0, 1.0);
+    std::default_random_engine generator;
+    // continue the sequence where the 32-sample kernel stops, as the renderers always did
+    generator.discard(32 * 4);
+    for (unsigned int i = 0; i < 16; i++)
+        noise.push_back(glm::vec3(randomFloats(generator) * 2.0 - 1.0, randomFloats(generator) * 2.0 - 1.0, 0.0f));
+    return noise;
+}
+
+// radical inverse of i in a prime base, the i-th Halton point along that axis
+inline float halton(unsigned int i, unsigned int base)
+{
+    float result = 0.0f, digit = 1.0f / base;
+    for (; i > 0; i /= base, digit /= base)
+        result += digit * (i % base);
+    return result;
+}
+
+// directions spread evenly over the solid angle of the +z hemisphere by Halton bases 2 and 3, and
+// lengths stratified per sample (jittered by base 5) and gathered near the origin like the random kernel
+inline std::vector<glm::vec3> generateHaltonKernel(int kernelSize)
+{
+    std::vector<glm::vec3> kernel;
+    for (int i = 0; i < kernelSize; ++i)
+    {
+        // 0 is the corner of every axis, start at 1
+        unsigned int index = (unsigned int)i + 1;
+        float z = halton(index, 2);
+        float phi = 2.0f * 3.14159265f * halton(index, 3);
+        float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        float scale = (i + halton(index, 5)) / kernelSize;
+        scale = 0.1f + 0.9f * scale * scale;
+        kernel.push_back(glm::vec3(r * std::cos(phi), r * std::sin(phi), z) * scale);
+    }
+    return kernel;
+}
+
+// rotations (cos, sin, 0) of the blue-noise tile: threshold rank r of the map turns by 2*pi*r/N
+inline std::vector<glm::vec3> blueNoiseRotations()
+{
+    const int count = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+    std::vector<glm::vec3> noise;
+    for (int i = 0; i < count; i++)
+    {
+        float angle = 2.0f * 3.14159265f * (BLUE_NOISE_RANKS[i] + 0.5f) / count;
+        noise.push_back(glm::vec3(std::cos(angle), std::sin(angle), 0.0f));
+    }
+    return noise;
+}
+
+// void-and-cluster threshold map of size x size (Ulichney 1993): every pixel gets a distinct rank, and
+// the pixels below any threshold are spread as evenly as possible. Energies are Gaussian-weighted
+// toroidal distances, so the map tiles.
+inline std::vector<unsigned short> generateBlueNoise(int size, float sigma = 1.5f, unsigned int seed = 1)
+{
+    const int count = size * size;
+    std::vector<float> gaussian(count);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+        {
+            int dx = std::min(x, size - x), dy = std::min(y, size - y);
+            gaussian[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+        }
+    std::vector<unsigned char> pattern(count, 0);
+    std::vector<float> energy(count, 0.0f);
+    // flips one pixel and spreads its energy over the torus
+    auto toggle = [&](int p) {
+        float sign = pattern[p] ? -1.0f : 1.0f;
+        pattern[p] = !pattern[p];
+        int px = p % size, py = p / size;
+        for (int y = 0; y < size; y++)
+        {
+            const float *row = &gaussian[((y - py + size) % size) * size];
+            for (int x = 0; x < size; x++)
+                energy[y * size + x] += sign * row[(x - px + size) % size];
+        }
+    };
+    // the set pixel with the most energy around it, or the empty one with the least
+    auto tightestCluster = [&]() {
+        int best = -1;
+        for (int p = 0; p < count; p++)
+            if (pattern[p] && (best < 0 || energy[p] > energy[best]))
+                best = p;
+        return best;
+    };
+    auto largestVoid = [&]() {
+        int best = -1;
+        for (int p = 0; p < count; p++)
+            if (!pattern[p] && (best < 0 || energy[p] < energy[best]))
+                best = p;
+        return best;
+    };
+
+    // initial pattern: a tenth of the pixels at random, relaxed until moving the tightest cluster
+    // into the largest void puts it back where it was
+    std::mt19937 generator(seed);
+    int ones = std::max(1, count / 10);
+    for (int placed = 0; placed < ones;)
+    {
+        int p = (int)(generator() % (unsigned int)count);
+        if (!pattern[p])
+        {
+            toggle(p);
+            placed++;
+        }
+    }
+    for (int iteration = 0; iteration < count; iteration++)
+    {
+        int cluster = tightestCluster();
+        toggle(cluster);
+        int hole = largestVoid();
+        toggle(hole);
+        if (hole == cluster)
+            break;
+    }
+    std::vector<unsigned char> initial = pattern;
+    std::vector<float> initialEnergy = energy;
+
+    std::vector<unsigned short> ranks(count, 0);
+    // below the initial pattern: take its clusters away one by one
+    for (int rank = ones - 1; rank >= 0; rank--)
+    {
+        int cluster = tightestCluster();
+        toggle(cluster);
+        ranks[cluster] = (unsigned short)rank;
+    }
+    // above it: fill the voids; past half full the largest void of the set pixels is also the
+    // tightest cluster of the empty ones, as the energies of both sum to a constant
+    pattern = initial;
+    energy = initialEnergy;
+    for (int rank = ones; rank < count; rank++)
+    {
+        int hole = largestVoid();
+        toggle(hole);
+        ranks[hole] = (unsigned short)rank;
+    }
+    return ranks;
+}
@@ -7,6 +7,12 @@
 #include <sstream>
 #include <cstring>
 #include <iostream>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+#include "utils_program_cache.h"
+#include "utils_cpu_profiler.h"
 
 // defines several possible options for shader categories
 enum ShaderCategory
@@ -15,21 +21,76 @@ enum ShaderCategory
     SHADER_FRAGMENT
 };
 
+// preprocessor defines of one shader variant, name -> value. Kept sorted so equal sets give equal cache keys.
+typedef std::map<std::string, std::string> ShaderDefines;
+
+// one active uniform as reported by the driver at link time
+struct UniformInfo
+{
+    GLint location;
+    GLint size;   // array length, 1 for plain uniforms
+    GLenum type;
+};
+
 
 // Shader Program
 class ShaderProgram
 {
 private:
-    // load shader from file
-    GLuint loadShader(const char *path, ShaderCategory category)
-    {
-        // read code from file
-        std::string strcode;
-        std::ifstream shaderFile(path);
-        std::stringstream shaderStream;
-        shaderStream << shaderFile.rdbuf();
-        shaderFile.close();
-        strcode = shaderStream.str();
+    // read shader code from file, expanding #include "file" relative to the including file
+    static std::string readShader(const std::string &path, int depth = 0)
+    {
+        if (depth > 16)
+        {
+            std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP " << path << std::endl;
+            return "";
+        }
+        std::ifstream shaderFile(path.c_str());
+        if (!shaderFile)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_FOUND " << path << std::endl;
+            return "";
+        }
+        std::string directory = path.substr(0, path.find_last_of('/') + 1);
+        std::string code, line;
+        while (std::getline(shaderFile, line))
+        {
+            size_t start = line.find_first_not_of(" \t");
+            if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+            {
+                size_t open = line.find('"', start);
+                size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+                if (close == std::string::npos)
+                    std::cout << "ERROR::SHADER::BAD_INCLUDE " << path << ": " << line << std::endl;
+                else
+                    code += readShader(directory + line.substr(open + 1, close - open - 1), depth + 1) + "\n";
+            }
+            else
+                code += line + "\n";
+        }
+        return code;
+    }
+
+    // puts the defines right after the #version line
+    static std::string applyDefines(const std::string &code, const ShaderDefines &defines)
+    {
+        if (defines.empty())
+            return code;
+        std::string header;
+        for (ShaderDefines::const_iterator it = defines.begin(); it != defines.end(); ++it)
+            header += "#define " + it->first + " " + it->second + "\n";
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (version == std::string::npos)
+            return header + code;
+        if (lineEnd == std::string::npos)
+            return code + "\n" + header;
+        return code.substr(0, lineEnd + 1) + header + code.substr(lineEnd + 1);
+    }
+
+    // compile shader from source
+    GLuint loadShader(const std::string &strcode, ShaderCategory category)
+    {
         const char *code = strcode.c_str();
 
         // compile shader
@@ -53,20 +114,102 @@ private:
         return shader;
     }
 
+    // reads every active uniform once so lookups never go back to the driver.
+    // arrays of basic types are registered under "name", "name[0]" and each "name[i]";
+    // struct arrays are reported member by member, e.g. "lights[3].Position".
+    void reflectUniforms()
+    {
+        uniforms.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> buffer(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            UniformInfo info;
+            glGetActiveUniform(programID, i, (GLsizei)buffer.size(), &length, &info.size, &info.type, &buffer[0]);
+            std::string name(&buffer[0], length);
+            // arrays come back as "name[0]", which the driver resolves like any element
+            info.location = glGetUniformLocation(programID, name.c_str());
+            if (info.location < 0)
+                continue;
+            uniforms[name] = info;
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                uniforms[base] = info;
+                for (GLint e = 1; e < info.size; e++)
+                {
+                    std::string element = base + "[" + std::to_string(e) + "]";
+                    UniformInfo elementInfo = { glGetUniformLocation(programID, element.c_str()), info.size - e, info.type };
+                    uniforms[element] = elementInfo;
+                }
+            }
+        }
+    }
+
+    // not copyable: the program object belongs to exactly one ShaderProgram
+    ShaderProgram(const ShaderProgram &);
+    ShaderProgram &operator=(const ShaderProgram &);
+
 public:
     GLuint programID;
+    // active uniforms by name, filled once after linking
+    std::unordered_map<std::string, UniformInfo> uniforms;
 
-    ShaderProgram() {programID = -1;}
+    ShaderProgram() {programID = 0;}
 
-    ShaderProgram(const char* vertexPath, const char* fragmentPath)
+    // owns its program object, deleted with it; moving hands it on
+    ShaderProgram(ShaderProgram &&other) : programID(other.programID), uniforms(std::move(other.uniforms))
     {
+        other.programID = 0;
+    }
+
+    ShaderProgram &operator=(ShaderProgram &&other)
+    {
+        if (this != &other)
+        {
+            if (programID)
+                glDeleteProgram(programID);
+            programID = other.programID;
+            uniforms = std::move(other.uniforms);
+            other.programID = 0;
+        }
+        return *this;
+    }
+
+    ~ShaderProgram()
+    {
+        if (programID)
+            glDeleteProgram(programID);
+    }
+
+    // each distinct set of defines is its own variant, compiled the first time it is asked for
+    ShaderProgram(const char* vertexPath, const char* fragmentPath, const ShaderDefines &defines = ShaderDefines())
+    {
+        CPU_PROFILE_SCOPE("ShaderProgram::ShaderProgram");
+        std::string vertexSource   = applyDefines(readShader(vertexPath), defines);
+        std::string fragmentSource = applyDefines(readShader(fragmentPath), defines);
+
+        // a program object of our own from the binary of the same sources, from this run or from the on-disk cache
+        ProgramCache &cache = ProgramCache::instance();
+        uint64_t key = cache.key(vertexSource, fragmentSource, definesString(defines));
+        programID = cache.find(key);
+        if (programID)
+        {
+            reflectUniforms();
+            return;
+        }
+
         // load shaders
         GLuint vertexShader, fragmentShader;
-        vertexShader   = loadShader(vertexPath, SHADER_VERTEX);
-        fragmentShader = loadShader(fragmentPath, SHADER_FRAGMENT);
+        vertexShader   = loadShader(vertexSource, SHADER_VERTEX);
+        fragmentShader = loadShader(fragmentSource, SHADER_FRAGMENT);
 
         // link the program
         programID = glCreateProgram();
+        cache.prepare(programID);
         glAttachShader(programID, vertexShader);
         glAttachShader(programID, fragmentShader);
         glLinkProgram(programID);
@@ -85,6 +228,17 @@ public:
         // delete the shaders
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
+
+        cache.store(key, programID);
+        reflectUniforms();
+    }
+
+    static std::string definesString(const ShaderDefines &defines)
+    {
+        std::string result;
+        for (ShaderDefines::const_iterator it = defines.begin(); it != defines.end(); ++it)
+            result += it->first + "=" + it->second + ";";
+        return result;
     }
 
     // activate the shaders
@@ -93,68 +247,104 @@ public:
         glUseProgram(programID);
     }
 
-    // locate uniform from shader program
-    GLint locateUnifrom(const char *unifrom)
+    // locate uniform from the reflected table; -1 if the program has no such active uniform
+    GLint locateUnifrom(const std::string &unifrom) const
     {
-        return glGetUniformLocation(programID, unifrom);
+        std::unordered_map<std::string, UniformInfo>::const_iterator it = uniforms.find(unifrom);
+        return it == uniforms.end() ? -1 : it->second.location;
     }
 
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(programID, name.c_str()), (int)value);
+        glUniform1i(locateUnifrom(name), (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     {
-        glUniform1i(glGetUniformLocation(programID, name.c_str()), value);
+        glUniform1i(locateUnifrom(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     {
-        glUniform1f(glGetUniformLocation(programID, name.c_str()), value);
+        glUniform1f(locateUnifrom(name), value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(programID, name.c_str()), 1, &value[0]);
+        glUniform2fv(locateUnifrom(name), 1, &value[0]);
     }
     void setVec2(const std::string &name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(programID, name.c_str()), x, y);
+        glUniform2f(locateUnifrom(name), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     {
-        glUniform3fv(glGetUniformLocation(programID, name.c_str()), 1, &value[0]);
+        glUniform3fv(locateUnifrom(name), 1, &value[0]);
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(programID, name.c_str()), x, y, z);
+        glUniform3f(locateUnifrom(name), x, y, z);
+    }
+    // ------------------------------------------------------------------------
+    void setIVec3(const std::string &name, const glm::ivec3 &value) const
+    {
+        glUniform3iv(locateUnifrom(name), 1, &value[0]);
+    }
+    void setIVec3(const std::string &name, int x, int y, int z) const
+    {
+        glUniform3i(locateUnifrom(name), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     {
-        glUniform4fv(glGetUniformLocation(programID, name.c_str()), 1, &value[0]);
+        glUniform4fv(locateUnifrom(name), 1, &value[0]);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(programID, name.c_str()), x, y, z, w);
+        glUniform4f(locateUnifrom(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(programID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(locateUnifrom(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(programID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(locateUnifrom(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(programID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(locateUnifrom(name), 1, GL_FALSE, &mat[0][0]);
+    }
+
+    // a whole vec3 array in one call, e.g. the kernel samples and skySH
+    // ------------------------------------------------------------------------
+    void setVec3Array(const std::string &name, const glm::vec3 *values, GLsizei count) const
+    {
+        glUniform3fv(locateUnifrom(name), count, &values[0][0]);
     }
-};
\ No newline at end of file
+};
+
+// the variants of its passes one owner switches between. Each is built the first time it is asked
+// for and kept for the owner's lifetime, so switching back to a setting reuses its program (and the
+// sampler units set on it) instead of building another, with or without program binaries.
+class ShaderVariants
+{
+public:
+    ShaderProgram &get(const char *vertexPath, const char *fragmentPath, const ShaderDefines &defines = ShaderDefines())
+    {
+        std::string key = std::string(vertexPath) + "\n" + fragmentPath + "\n" + ShaderProgram::definesString(defines);
+        std::map<std::string, ShaderProgram>::iterator it = programs.find(key);
+        if (it == programs.end())
+            it = programs.emplace(key, ShaderProgram(vertexPath, fragmentPath, defines)).first;
+        return it->second;
+    }
+
+private:
+    std::map<std::string, ShaderProgram> programs;
+};
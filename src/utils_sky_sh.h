@@ -0,0 +1,193 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "utils_cpu_profiler.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SKY_SH_SSE
+#endif
+
+// Radiance of a skybox as second-order spherical harmonics (9 RGB coefficients), which
+// shader/common/sky.glsl evaluates instead of sampling the cubemap. The projection weighs every
+// texel by its solid angle; the rows of the 6 faces are split over all cores, and each row is
+// processed 4 texels at a time with SSE where available.
+struct SkySH
+{
+    static const int COEFFICIENTS = 9;
+    glm::vec3 coefficients[COEFFICIENTS];
+
+    SkySH()
+    {
+        for (int i = 0; i < COEFFICIENTS; i++)
+            coefficients[i] = glm::vec3(0.0f);
+    }
+
+    // reads level 0 of an uploaded cubemap back and projects it
+    static SkySH project(GLuint cubemap, unsigned int threadCount = 0)
+    {
+        GLint size = 0;
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+        glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &size);
+        if (size <= 0)
+        {
+            std::cout << "ERROR::SKY_SH:: cubemap " << cubemap << " has no pixels to project" << std::endl;
+            return SkySH();
+        }
+        std::vector<std::vector<float> > faces(6);
+        for (int i = 0; i < 6; i++)
+        {
+            faces[i].resize((size_t)size * size * 3);
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, GL_FLOAT, &faces[i][0]);
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        return projectFaces(faces, size, threadCount);
+    }
+
+    // projects 6 square RGB faces in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, rows top to bottom
+    static SkySH projectFaces(const std::vector<std::vector<float> > &faces, int size, unsigned int threadCount = 0)
+    {
+        CPU_PROFILE_SCOPE("SkySH::projectFaces");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 4;
+        int rows = 6 * size;
+        threadCount = std::min(threadCount, (unsigned int)rows);
+
+        // 27 weighted color sums and the total solid angle weight per thread
+        std::vector<std::vector<float> > partials(threadCount, std::vector<float>(SUMS, 0.0f));
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threadCount; t++)
+        {
+            int first = rows * t / threadCount, last = rows * (t + 1) / threadCount;
+            workers.push_back(std::thread([&faces, &partials, size, first, last, t]() {
+                for (int row = first; row < last; row++)
+                    projectRow(&faces[row / size][0], size, row / size, row % size, &partials[t][0]);
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); t++)
+            workers[t].join();
+
+        float sums[SUMS] = { 0.0f };
+        for (size_t t = 0; t < partials.size(); t++)
+            for (int i = 0; i < SUMS; i++)
+                sums[i] += partials[t][i];
+        // the weights integrate to the full sphere
+        SkySH sh;
+        float normalization = sums[SUMS - 1] > 0.0f ? 4.0f * 3.14159265f / sums[SUMS - 1] : 0.0f;
+        for (int i = 0; i < COEFFICIENTS; i++)
+            sh.coefficients[i] = glm::vec3(sums[i * 3], sums[i * 3 + 1], sums[i * 3 + 2]) * normalization;
+
+        printf("sky SH: projected 6x%dx%d cubemap on %d threads in %.2f ms\n", size, size, (int)threadCount,
+               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        return sh;
+    }
+
+private:
+    static const int SUMS = COEFFICIENTS * 3 + 1;
+
+    // the 9 real SH basis functions at a unit direction
+    static void basis(float x, float y, float z, float *out)
+    {
+        out[0] = 0.282095f;
+        out[1] = 0.488603f * y;
+        out[2] = 0.488603f * z;
+        out[3] = 0.488603f * x;
+        out[4] = 1.092548f * x * y;
+        out[5] = 1.092548f * y * z;
+        out[6] = 0.315392f * (3.0f * z * z - 1.0f);
+        out[7] = 1.092548f * x * z;
+        out[8] = 0.546274f * (x * x - y * y);
+    }
+
+    // adds one row of a face to sums: a texel at face coordinates (s, t) looks along
+    // major + s * sAxis + t * tAxis, the cubemap face layout of the GL spec
+    static void projectRow(const float *face, int size, int faceIndex, int y, float *sums)
+    {
+        static const float MAJOR[6][3]  = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+        static const float S_AXIS[6][3] = { { 0, 0, -1 }, { 0, 0, 1 }, { 1, 0, 0 }, { 1, 0, 0 }, { 1, 0, 0 }, { -1, 0, 0 } };
+        static const float T_AXIS[6][3] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+        const float *major = MAJOR[faceIndex], *sAxis = S_AXIS[faceIndex], *tAxis = T_AXIS[faceIndex];
+        const float *pixels = face + (size_t)y * size * 3;
+        float step = 2.0f / size;
+        float t = (y + 0.5f) * step - 1.0f;
+        float rowX = major[0] + t * tAxis[0], rowY = major[1] + t * tAxis[1], rowZ = major[2] + t * tAxis[2];
+
+        int x = 0;
+#ifdef SKY_SH_SSE
+        __m128 acc[SUMS];
+        for (int i = 0; i < SUMS; i++)
+            acc[i] = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 lanes = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 tt1 = _mm_set1_ps(1.0f + t * t);
+        for (; x + 4 <= size; x += 4)
+        {
+            __m128 s = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)x), lanes), _mm_set1_ps(step)), one);
+            // the solid angle of a texel falls off as (1 + s^2 + t^2)^-3/2
+            __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(tt1, _mm_mul_ps(s, s))));
+            __m128 weight = _mm_mul_ps(invLength, _mm_mul_ps(invLength, invLength));
+            __m128 dx = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(rowX), _mm_mul_ps(s, _mm_set1_ps(sAxis[0]))), invLength);
+            __m128 dy = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(rowY), _mm_mul_ps(s, _mm_set1_ps(sAxis[1]))), invLength);
+            __m128 dz = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(rowZ), _mm_mul_ps(s, _mm_set1_ps(sAxis[2]))), invLength);
+            __m128 b[COEFFICIENTS];
+            b[0] = _mm_set1_ps(0.282095f);
+            b[1] = _mm_mul_ps(_mm_set1_ps(0.488603f), dy);
+            b[2] = _mm_mul_ps(_mm_set1_ps(0.488603f), dz);
+            b[3] = _mm_mul_ps(_mm_set1_ps(0.488603f), dx);
+            b[4] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(dx, dy));
+            b[5] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(dy, dz));
+            b[6] = _mm_mul_ps(_mm_set1_ps(0.315392f), _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(dz, dz)), one));
+            b[7] = _mm_mul_ps(_mm_set1_ps(1.092548f), _mm_mul_ps(dx, dz));
+            b[8] = _mm_mul_ps(_mm_set1_ps(0.546274f), _mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+            const float *p = pixels + x * 3;
+            __m128 r = _mm_mul_ps(weight, _mm_set_ps(p[9], p[6], p[3], p[0]));
+            __m128 g = _mm_mul_ps(weight, _mm_set_ps(p[10], p[7], p[4], p[1]));
+            __m128 bl = _mm_mul_ps(weight, _mm_set_ps(p[11], p[8], p[5], p[2]));
+            for (int i = 0; i < COEFFICIENTS; i++)
+            {
+                acc[i * 3]     = _mm_add_ps(acc[i * 3], _mm_mul_ps(b[i], r));
+                acc[i * 3 + 1] = _mm_add_ps(acc[i * 3 + 1], _mm_mul_ps(b[i], g));
+                acc[i * 3 + 2] = _mm_add_ps(acc[i * 3 + 2], _mm_mul_ps(b[i], bl));
+            }
+            acc[SUMS - 1] = _mm_add_ps(acc[SUMS - 1], weight);
+        }
+        for (int i = 0; i < SUMS; i++)
+        {
+            float lanesOut[4];
+            _mm_storeu_ps(lanesOut, acc[i]);
+            sums[i] += (lanesOut[0] + lanesOut[1]) + (lanesOut[2] + lanesOut[3]);
+        }
+#endif
+        // the rest of the row, or all of it without SSE
+        for (; x < size; x++)
+        {
+            float s = (x + 0.5f) * step - 1.0f;
+            float invLength = 1.0f / std::sqrt(1.0f + s * s + t * t);
+            float weight = invLength * invLength * invLength;
+            float b[COEFFICIENTS];
+            basis((rowX + s * sAxis[0]) * invLength, (rowY + s * sAxis[1]) * invLength, (rowZ + s * sAxis[2]) * invLength, b);
+            const float *p = pixels + x * 3;
+            for (int i = 0; i < COEFFICIENTS; i++)
+            {
+                sums[i * 3]     += b[i] * weight * p[0];
+                sums[i * 3 + 1] += b[i] * weight * p[1];
+                sums[i * 3 + 2] += b[i] * weight * p[2];
+            }
+            sums[SUMS - 1] += weight;
+        }
+    }
+};
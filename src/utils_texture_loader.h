@@ -0,0 +1,244 @@
+#pragma once
+
+#include "gl_env.h"
+#include <stb_image.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "utils_cpu_profiler.h"
+
+// describes one image file and where its pixels go once they reach the GL thread
+struct TextureJob
+{
+    std::string path;
+    GLuint texture;
+    GLenum bindTarget;  // GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+    GLenum imageTarget; // GL_TEXTURE_2D or one of the GL_TEXTURE_CUBE_MAP_* faces
+    int channels;       // channel count to decode to, 0 keeps the file's own
+    bool flip;          // flip vertically on load
+    bool mipmap;        // generate mipmaps after the upload
+};
+
+// pixels decoded on a worker thread, waiting for their upload
+struct DecodedImage
+{
+    TextureJob job;
+    unsigned char *data;
+    int width, height, channels;
+    double decodeMs;
+};
+
+// per-file timings, in milliseconds
+struct TextureTiming
+{
+    std::string path;
+    int width, height;
+    double decodeMs;
+    double uploadMs;
+};
+
+// Decodes image files on a pool of worker threads and hands the pixels back to the thread that owns
+// the GL context, which does the glTexImage2D/glGenerateMipmap calls in finish(). Texture names are
+// generated up front so callers can keep them right away.
+class TextureLoader
+{
+public:
+    std::vector<TextureTiming> timings;
+
+    explicit TextureLoader(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 4;
+        stopping = false;
+        pending = 0;
+        batchMs = 0.0;
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.push_back(std::thread(&TextureLoader::workerLoop, this));
+    }
+
+    ~TextureLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            stopping = true;
+        }
+        jobCondition.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        // free anything that was decoded but never uploaded
+        for (size_t i = 0; i < decoded.size(); i++)
+            stbi_image_free(decoded[i].data);
+    }
+
+    // queues a file for decoding; must be called from the GL thread
+    void enqueue(const TextureJob &job)
+    {
+        if (pending == 0)
+            batchStart = std::chrono::steady_clock::now();
+        pending++;
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            jobs.push_back(job);
+        }
+        jobCondition.notify_one();
+    }
+
+    // uploads every queued texture as soon as it is decoded and returns once all are on the GPU
+    void finish()
+    {
+        CPU_PROFILE_SCOPE("TextureLoader::finish");
+        while (pending > 0)
+        {
+            DecodedImage image;
+            {
+                std::unique_lock<std::mutex> lock(decodedMutex);
+                while (decoded.empty())
+                    decodedCondition.wait(lock);
+                image = decoded.front();
+                decoded.pop_front();
+            }
+            upload(image, timings);
+            pending--;
+        }
+        batchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batchStart).count();
+    }
+
+    // prints the per-file decode/upload timings of the last batch
+    void printTimings() const
+    {
+        double decodeSum = 0.0, uploadSum = 0.0;
+        for (size_t i = 0; i < timings.size(); i++)
+        {
+            printf("texture %-60s %5dx%-5d decode %8.2f ms  upload %8.2f ms\n", timings[i].path.c_str(),
+                   timings[i].width, timings[i].height, timings[i].decodeMs, timings[i].uploadMs);
+            decodeSum += timings[i].decodeMs;
+            uploadSum += timings[i].uploadMs;
+        }
+        printf("textures: %d files on %d threads, decode sum %.2f ms, upload sum %.2f ms, wall %.2f ms\n",
+               (int)timings.size(), (int)workers.size(), decodeSum, uploadSum, batchMs);
+    }
+
+    // loads through the loader if there is one, otherwise decodes and uploads right here
+    static void load(const TextureJob &job, TextureLoader *loader)
+    {
+        if (loader)
+        {
+            loader->enqueue(job);
+            return;
+        }
+        DecodedImage image = decode(job);
+        std::vector<TextureTiming> ignored;
+        upload(image, ignored);
+    }
+
+    static DecodedImage decode(const TextureJob &job)
+    {
+        CPU_PROFILE_SCOPE("TextureLoader::decode");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        DecodedImage image;
+        image.job = job;
+        int fileChannels;
+        image.data = stbi_load(job.path.c_str(), &image.width, &image.height, &fileChannels, job.channels);
+        image.channels = job.channels ? job.channels : fileChannels;
+        // stbi_set_flip_vertically_on_load is global state, so flip here instead
+        if (image.data && job.flip)
+        {
+            size_t rowSize = (size_t)image.width * image.channels;
+            std::vector<unsigned char> row(rowSize);
+            for (int y = 0; y < image.height / 2; y++)
+            {
+                unsigned char *top = image.data + y * rowSize;
+                unsigned char *bottom = image.data + (image.height - 1 - y) * rowSize;
+                std::memcpy(&row[0], top, rowSize);
+                std::memcpy(top, bottom, rowSize);
+                std::memcpy(bottom, &row[0], rowSize);
+            }
+        }
+        image.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return image;
+    }
+
+    static void upload(DecodedImage &image, std::vector<TextureTiming> &timings)
+    {
+        CPU_PROFILE_SCOPE("TextureLoader::upload");
+        if (!image.data)
+        {
+            std::cout << "Texture failed to load at path: " << image.job.path << std::endl;
+            return;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GLenum format = GL_RGB;
+        if (image.channels == 1)
+            format = GL_RED;
+        else if (image.channels == 2)
+            format = GL_RG;
+        else if (image.channels == 4)
+            format = GL_RGBA;
+
+        glBindTexture(image.job.bindTarget, image.job.texture);
+        glTexImage2D(image.job.imageTarget, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+        if (image.job.mipmap)
+            glGenerateMipmap(image.job.bindTarget);
+        stbi_image_free(image.data);
+        image.data = NULL;
+
+        TextureTiming timing;
+        timing.path = image.job.path;
+        timing.width = image.width;
+        timing.height = image.height;
+        timing.decodeMs = image.decodeMs;
+        timing.uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        timings.push_back(timing);
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<TextureJob> jobs;
+    std::deque<DecodedImage> decoded;
+    std::mutex jobMutex, decodedMutex;
+    std::condition_variable jobCondition, decodedCondition;
+    bool stopping;
+
+    // only touched on the GL thread
+    unsigned int pending;
+    std::chrono::steady_clock::time_point batchStart;
+    double batchMs;
+
+    void workerLoop()
+    {
+        CPU_PROFILE_THREAD("texture decode");
+        while (true)
+        {
+            TextureJob job;
+            {
+                std::unique_lock<std::mutex> lock(jobMutex);
+                while (jobs.empty() && !stopping)
+                    jobCondition.wait(lock);
+                if (jobs.empty())
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            DecodedImage image = decode(job);
+            {
+                std::lock_guard<std::mutex> lock(decodedMutex);
+                decoded.push_back(image);
+            }
+            decodedCondition.notify_one();
+        }
+    }
+
+    TextureLoader(const TextureLoader &);
+    TextureLoader &operator=(const TextureLoader &);
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <algorithm>
+
+#include "utils_cpu_profiler.h"
+
+// Work-stealing pool for data-parallel loops: parallelFor(count, task) deals the indices out in
+// contiguous runs, one run per thread, and returns once task(i) has run for all of them. Each thread
+// works through its own run from the front and, when that is empty, steals single indices from the
+// back of the others', so uneven tasks (tiles with more geometry, slower cores) still finish together.
+// The calling thread takes part as the first of the threads.
+class ThreadPool
+{
+public:
+    // threadCount includes the caller; 0 takes one per hardware thread
+    explicit ThreadPool(unsigned int threadCount = 0) : task(NULL), remaining(0), generation(0), stopping(false)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        queues.resize(threadCount);
+        for (unsigned int i = 1; i < threadCount; i++)
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wakeCondition.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    unsigned int size() const { return (unsigned int)queues.size(); }
+
+    // runs task(0) .. task(count - 1) across the pool; one loop at a time
+    void parallelFor(int count, const std::function<void(int)> &task)
+    {
+        if (count <= 0)
+            return;
+        std::lock_guard<std::mutex> loopLock(loopMutex);
+        // set before any index is visible: a worker still leaving the last loop may take one right away
+        this->task = &task;
+        remaining = count;
+        int threads = (int)queues.size();
+        for (int t = 0; t < threads; t++)
+        {
+            std::lock_guard<std::mutex> lock(queues[t].mutex);
+            for (int i = (int)((long long)count * t / threads); i < (int)((long long)count * (t + 1) / threads); i++)
+                queues[t].indices.push_back(i);
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            generation++;
+        }
+        wakeCondition.notify_all();
+
+        runUntilEmpty(0);
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [this] { return remaining.load() == 0; });
+        this->task = NULL;
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<int> indices;
+    };
+
+    std::vector<std::thread> workers;
+    // one per thread, the caller's first
+    std::deque<Queue> queues;
+    const std::function<void(int)> *task;
+    std::atomic<int> remaining;
+    unsigned long long generation;
+    bool stopping;
+    std::mutex loopMutex, wakeMutex, doneMutex;
+    std::condition_variable wakeCondition, doneCondition;
+
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    void workerLoop(unsigned int self)
+    {
+        CPU_PROFILE_THREAD("pool worker");
+        unsigned long long seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wakeCondition.wait(lock, [this, seen] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            runUntilEmpty(self);
+        }
+    }
+
+    // own indices first, then whatever the others still have
+    void runUntilEmpty(unsigned int self)
+    {
+        int index;
+        while (pop(self, index) || steal(self, index))
+        {
+            (*task)(index);
+            if (--remaining == 0)
+            {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                doneCondition.notify_all();
+            }
+        }
+    }
+
+    bool pop(unsigned int self, int &index)
+    {
+        Queue &queue = queues[self];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.indices.empty())
+            return false;
+        index = queue.indices.front();
+        queue.indices.pop_front();
+        return true;
+    }
+
+    bool steal(unsigned int self, int &index)
+    {
+        for (size_t i = 1; i < queues.size(); i++)
+        {
+            Queue &queue = queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.indices.empty())
+                continue;
+            index = queue.indices.back();
+            queue.indices.pop_back();
+            return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "gl_env.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+
+#define MAX_BONE_INFLUENCE 4
+
+// the vertex as it comes out of the importer
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+	//bone indexes which will influence this vertex
+	int m_BoneIDs[MAX_BONE_INFLUENCE];
+	//weights from each bone
+	float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+// vertex streams; each one maps to fixed attribute locations
+enum VertexStream
+{
+    STREAM_POSITION = 1 << 0, // location 0
+    STREAM_NORMAL   = 1 << 1, // location 1
+    STREAM_TEXCOORD = 1 << 2, // location 2
+    STREAM_TANGENT  = 1 << 3, // locations 3 (tangent) and 4 (bitangent)
+    STREAM_BONES    = 1 << 4, // locations 5 (ids) and 6 (weights)
+    STREAM_ALL      = 0x1f
+};
+
+// defines several possible options for how the streams are stored in the VBO
+enum VertexEncoding
+{
+    // 32-bit floats for everything, matching the Vertex struct
+    VERTEX_FLOAT,
+    // positions as 16-bit unorm relative to the mesh bounds, octahedral 16-bit normals/tangents, half-float uvs
+    VERTEX_PACKED
+};
+
+// which streams to keep and how to encode them. A stream is only uploaded if the layout asks for it
+// and the mesh actually has it, so e.g. the never-filled bone data is dropped for static meshes.
+struct VertexLayout
+{
+    VertexEncoding encoding;
+    unsigned int streams;
+};
+
+const VertexLayout VERTEX_LAYOUT_FULL    = { VERTEX_FLOAT, STREAM_ALL };
+const VertexLayout VERTEX_LAYOUT_COMPACT = { VERTEX_PACKED, STREAM_POSITION | STREAM_NORMAL | STREAM_TEXCOORD };
+
+// one enabled vertex attribute of an encoded buffer
+struct VertexAttribute
+{
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    bool integer;
+    size_t offset;
+};
+
+// an interleaved vertex buffer encoded for a layout, ready for glBufferData
+struct EncodedVertices
+{
+    std::vector<unsigned char> data;
+    std::vector<VertexAttribute> attributes;
+    GLsizei stride;
+    // position = positionOffset + attribute * positionScale in the vertex shader
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+    bool octNormals;
+};
+
+// octahedral encoding of a unit vector into [-1, 1]^2
+inline glm::vec2 octEncode(glm::vec3 n)
+{
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0.0f)
+        return glm::vec2(0.0f);
+    n /= l1;
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        glm::vec2 signNotZero(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+        e = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * signNotZero;
+    }
+    return e;
+}
+
+class VertexEncoder
+{
+public:
+    // encodes the streams that are both in the layout and in meshStreams
+    static EncodedVertices encode(const Vertex *vertices, size_t vertexCount, const VertexLayout &layout, unsigned int meshStreams)
+    {
+        EncodedVertices out;
+        out.positionScale = glm::vec3(1.0f);
+        out.positionOffset = glm::vec3(0.0f);
+        out.octNormals = layout.encoding == VERTEX_PACKED;
+        unsigned int streams = (layout.streams & meshStreams) | STREAM_POSITION;
+        bool packed = layout.encoding == VERTEX_PACKED;
+
+        // lay out the attributes
+        size_t stride = 0;
+        if (packed)
+        {
+            addAttribute(out, 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, false, stride, 8);
+            if (streams & STREAM_NORMAL)
+                addAttribute(out, 1, 2, GL_SHORT, GL_TRUE, false, stride, 4);
+            if (streams & STREAM_TEXCOORD)
+                addAttribute(out, 2, 2, GL_HALF_FLOAT, GL_FALSE, false, stride, 4);
+            if (streams & STREAM_TANGENT)
+            {
+                addAttribute(out, 3, 2, GL_SHORT, GL_TRUE, false, stride, 4);
+                addAttribute(out, 4, 2, GL_SHORT, GL_TRUE, false, stride, 4);
+            }
+        }
+        else
+        {
+            addAttribute(out, 0, 3, GL_FLOAT, GL_FALSE, false, stride, 12);
+            if (streams & STREAM_NORMAL)
+                addAttribute(out, 1, 3, GL_FLOAT, GL_FALSE, false, stride, 12);
+            if (streams & STREAM_TEXCOORD)
+                addAttribute(out, 2, 2, GL_FLOAT, GL_FALSE, false, stride, 8);
+            if (streams & STREAM_TANGENT)
+            {
+                addAttribute(out, 3, 3, GL_FLOAT, GL_FALSE, false, stride, 12);
+                addAttribute(out, 4, 3, GL_FLOAT, GL_FALSE, false, stride, 12);
+            }
+        }
+        if (streams & STREAM_BONES)
+        {
+            addAttribute(out, 5, 4, GL_INT, GL_FALSE, true, stride, 16);
+            addAttribute(out, 6, 4, GL_FLOAT, GL_FALSE, false, stride, 16);
+        }
+        out.stride = (GLsizei)stride;
+
+        // quantize positions against the mesh bounds
+        if (packed && vertexCount > 0)
+        {
+            glm::vec3 lo = vertices[0].Position, hi = vertices[0].Position;
+            for (size_t i = 1; i < vertexCount; i++)
+            {
+                lo = glm::min(lo, vertices[i].Position);
+                hi = glm::max(hi, vertices[i].Position);
+            }
+            out.positionOffset = lo;
+            out.positionScale = hi - lo;
+        }
+
+        // fill the interleaved buffer
+        out.data.resize(stride * vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            const Vertex &v = vertices[i];
+            unsigned char *dst = &out.data[0] + i * stride;
+            size_t a = 0;
+            if (packed)
+            {
+                glm::vec3 p = (v.Position - out.positionOffset) / glm::max(out.positionScale, glm::vec3(1e-20f));
+                unsigned short position[4] = { glm::packUnorm1x16(p.x), glm::packUnorm1x16(p.y), glm::packUnorm1x16(p.z), 0 };
+                write(dst, out.attributes[a++], position, sizeof(position));
+                if (streams & STREAM_NORMAL)
+                    writeOct(dst, out.attributes[a++], v.Normal);
+                if (streams & STREAM_TEXCOORD)
+                {
+                    unsigned short uv[2] = { glm::packHalf1x16(v.TexCoords.x), glm::packHalf1x16(v.TexCoords.y) };
+                    write(dst, out.attributes[a++], uv, sizeof(uv));
+                }
+                if (streams & STREAM_TANGENT)
+                {
+                    writeOct(dst, out.attributes[a++], v.Tangent);
+                    writeOct(dst, out.attributes[a++], v.Bitangent);
+                }
+            }
+            else
+            {
+                write(dst, out.attributes[a++], &v.Position, sizeof(glm::vec3));
+                if (streams & STREAM_NORMAL)
+                    write(dst, out.attributes[a++], &v.Normal, sizeof(glm::vec3));
+                if (streams & STREAM_TEXCOORD)
+                    write(dst, out.attributes[a++], &v.TexCoords, sizeof(glm::vec2));
+                if (streams & STREAM_TANGENT)
+                {
+                    write(dst, out.attributes[a++], &v.Tangent, sizeof(glm::vec3));
+                    write(dst, out.attributes[a++], &v.Bitangent, sizeof(glm::vec3));
+                }
+            }
+            if (streams & STREAM_BONES)
+            {
+                write(dst, out.attributes[a++], v.m_BoneIDs, sizeof(v.m_BoneIDs));
+                write(dst, out.attributes[a++], v.m_Weights, sizeof(v.m_Weights));
+            }
+        }
+        return out;
+    }
+
+    // sets the attribute pointers of the currently bound VAO/VBO, starting baseOffset bytes into the buffer
+    static void applyAttributes(const EncodedVertices &encoded, size_t baseOffset = 0)
+    {
+        for (GLuint location = 0; location < 7; location++)
+            glDisableVertexAttribArray(location);
+        for (size_t i = 0; i < encoded.attributes.size(); i++)
+        {
+            const VertexAttribute &attribute = encoded.attributes[i];
+            glEnableVertexAttribArray(attribute.location);
+            if (attribute.integer)
+                glVertexAttribIPointer(attribute.location, attribute.size, attribute.type, encoded.stride, (void*)(baseOffset + attribute.offset));
+            else
+                glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, encoded.stride, (void*)(baseOffset + attribute.offset));
+        }
+    }
+
+private:
+    static void addAttribute(EncodedVertices &out, GLuint location, GLint size, GLenum type, GLboolean normalized, bool integer, size_t &stride, size_t bytes)
+    {
+        VertexAttribute attribute = { location, size, type, normalized, integer, stride };
+        out.attributes.push_back(attribute);
+        stride += bytes;
+    }
+
+    static void write(unsigned char *dst, const VertexAttribute &attribute, const void *src, size_t bytes)
+    {
+        std::memcpy(dst + attribute.offset, src, bytes);
+    }
+
+    static void writeOct(unsigned char *dst, const VertexAttribute &attribute, const glm::vec3 &v)
+    {
+        glm::vec2 e = octEncode(v);
+        short packed[2] = { (short)glm::packSnorm1x16(e.x), (short)glm::packSnorm1x16(e.y) };
+        write(dst, attribute, packed, sizeof(packed));
+    }
+};